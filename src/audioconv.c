@@ -0,0 +1,182 @@
+/*
+ * audioconv.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <libavutil/audio_fifo.h>
+#include "audioconv.h"
+#include "debug.h"
+
+
+struct audioconv {
+  int in_rate, out_rate;
+  enum AVSampleFormat out_fmt;
+  int frame_size;
+
+  struct SwrContext * swr;  /* NULL for passthrough */
+  AVAudioFifo * fifo;       /* out_fmt samples waiting for full encoder frame */
+  uint8_t * tmp;            /* swr_convert() output */
+  int tmp_samples;
+
+  int64_t head_pts;         /* pts of the first sample in fifo, 1/out_rate */
+};
+
+
+audioconv * audioconv_create(int in_rate, enum AVSampleFormat out_fmt, int out_rate, int frame_size)
+{
+  audioconv * ac = NULL;
+  int status;
+
+  bool fok = false;
+
+  if ( !(ac = av_mallocz(sizeof(*ac))) ) {
+    PERROR("av_mallocz(audioconv) fails");
+    goto end;
+  }
+
+  ac->in_rate = in_rate;
+  ac->out_rate = out_rate;
+  ac->out_fmt = out_fmt;
+  ac->frame_size = frame_size;
+  ac->head_pts = AV_NOPTS_VALUE;
+
+  /* mono S16P and S16 have the same layout */
+  if ( in_rate != out_rate || (out_fmt != AV_SAMPLE_FMT_S16 && out_fmt != AV_SAMPLE_FMT_S16P) ) {
+
+    ac->swr = swr_alloc_set_opts(NULL,
+        AV_CH_LAYOUT_MONO, out_fmt, out_rate,
+        AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, in_rate,
+        0, NULL);
+
+    if ( !ac->swr ) {
+      PERROR("swr_alloc_set_opts() fails");
+      goto end;
+    }
+
+    /* soxr is not linked in, tune the default resampler for quality at modest cost */
+    av_opt_set_int(ac->swr, "filter_size", 32, 0);
+    av_opt_set_int(ac->swr, "phase_shift", 10, 0);
+    av_opt_set_double(ac->swr, "cutoff", 0.91, 0);
+
+    if ( (status = swr_init(ac->swr)) < 0 ) {
+      PERROR("swr_init(%d -> %d %s) fails: %s", in_rate, out_rate, av_get_sample_fmt_name(out_fmt), av_err2str(status));
+      goto end;
+    }
+  }
+
+  if ( !(ac->fifo = av_audio_fifo_alloc(out_fmt, 1, FFMAX(frame_size, 1024) * 4)) ) {
+    PERROR("av_audio_fifo_alloc() fails");
+    goto end;
+  }
+
+  PDBG("%d Hz -> %d Hz %s, frame_size=%d%s", in_rate, out_rate, av_get_sample_fmt_name(out_fmt), frame_size,
+      ac->swr ? "" : " passthrough");
+
+  fok = true;
+
+end:
+
+  if ( !fok ) {
+    audioconv_destroy(&ac);
+  }
+
+  return ac;
+}
+
+void audioconv_destroy(audioconv ** ac)
+{
+  if ( ac && *ac ) {
+    swr_free(&(*ac)->swr);
+    if ( (*ac)->fifo ) {
+      av_audio_fifo_free((*ac)->fifo);
+    }
+    av_free((*ac)->tmp);
+    av_freep(ac);
+  }
+}
+
+bool audioconv_is_passthrough(const audioconv * ac)
+{
+  return !ac->swr;
+}
+
+int audioconv_write(audioconv * ac, const int16_t * samples, int nb_samples, int64_t pts)
+{
+  const uint8_t * in[1] = { (const uint8_t *) samples };
+  int64_t delay = 0;
+  int n, status;
+
+  if ( !ac->swr ) {
+    n = nb_samples;
+    if ( (status = av_audio_fifo_write(ac->fifo, (void **) in, n)) < n ) {
+      return status < 0 ? status : AVERROR(ENOMEM);
+    }
+  }
+  else {
+
+    n = swr_get_out_samples(ac->swr, nb_samples);
+
+    if ( n > ac->tmp_samples ) {
+      av_freep(&ac->tmp);
+      if ( (status = av_samples_alloc(&ac->tmp, NULL, 1, n, ac->out_fmt, 0)) < 0 ) {
+        ac->tmp_samples = 0;
+        return status;
+      }
+      ac->tmp_samples = n;
+    }
+
+    if ( (n = swr_convert(ac->swr, &ac->tmp, ac->tmp_samples, in, nb_samples)) < 0 ) {
+      PERROR("swr_convert() fails: %s", av_err2str(n));
+      return n;
+    }
+
+    if ( n > 0 && (status = av_audio_fifo_write(ac->fifo, (void **) &ac->tmp, n)) < n ) {
+      return status < 0 ? status : AVERROR(ENOMEM);
+    }
+
+    /* samples still inside the resampler filter, in 1/in_rate */
+    delay = swr_get_delay(ac->swr, ac->in_rate);
+  }
+
+  /*
+   * Re-anchor fifo head on every input buffer, so pts corrections made by
+   * media clock on capture side pass through to the encoder
+   */
+  ac->head_pts = av_rescale(pts + nb_samples - delay, ac->out_rate, ac->in_rate) - av_audio_fifo_size(ac->fifo);
+
+  return 0;
+}
+
+int audioconv_read(audioconv * ac, AVFrame * frame)
+{
+  const int available = av_audio_fifo_size(ac->fifo);
+  int n;
+
+  if ( ac->frame_size > 0 ) {
+    if ( available < ac->frame_size ) {
+      return 0;
+    }
+    n = ac->frame_size;
+  }
+  else if ( !(n = available) ) {
+    return 0;
+  }
+
+  if ( (n = av_audio_fifo_read(ac->fifo, (void **) frame->data, n)) < 0 ) {
+    PERROR("av_audio_fifo_read() fails: %s", av_err2str(n));
+    return n;
+  }
+
+  frame->nb_samples = n;
+  frame->pts = ac->head_pts;
+  ac->head_pts += n;
+
+  return 1;
+}
+
+int audioconv_delay(const audioconv * ac)
+{
+  return av_audio_fifo_size(ac->fifo) + (ac->swr ? (int) swr_get_delay(ac->swr, ac->out_rate) : 0);
+}
@@ -0,0 +1,59 @@
+/*
+ * audioconv.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Audio stage between capture and encoder:
+ *    mono S16 at capture rate -> encoder sample format and rate, cut into encoder frames
+ */
+
+#pragma once
+
+#ifndef __audioconv_h__
+#define __audioconv_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct audioconv
+  audioconv;
+
+
+/**
+ * in_rate: capture rate; out_fmt, out_rate: encoder input;
+ * frame_size: encoder frame size in samples, 0 if encoder accepts any
+ */
+audioconv * audioconv_create(int in_rate, enum AVSampleFormat out_fmt, int out_rate, int frame_size);
+
+void audioconv_destroy(audioconv ** ac);
+
+/* true when no resampling nor sample format conversion is needed */
+bool audioconv_is_passthrough(const audioconv * ac);
+
+/**
+ * Feed nb_samples of captured mono S16 audio,
+ *  pts of the first sample is in 1/in_rate units
+ */
+int audioconv_write(audioconv * ac, const int16_t * samples, int nb_samples, int64_t pts);
+
+/**
+ * Fill encoder frame allocated for out_fmt and at least frame_size samples.
+ *  frame->pts is set in 1/out_rate units.
+ *  Returns 1 if frame is filled, 0 if there is not enough data yet, or negative AVERROR code
+ */
+int audioconv_read(audioconv * ac, AVFrame * frame);
+
+/* samples buffered inside, in 1/out_rate units */
+int audioconv_delay(const audioconv * ac);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __audioconv_h__ */
@@ -0,0 +1,103 @@
+/*
+ * campixfmt.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include "campixfmt.h"
+
+
+static const campixfmt formats[] = {
+  { campixfmt_nv21, "nv21", android_format_nv21, AV_PIX_FMT_NV21 },
+  { campixfmt_yv12, "yv12", android_format_yv12, AV_PIX_FMT_YUV420P },
+  { campixfmt_yuy2, "yuy2", android_format_yuy2, AV_PIX_FMT_YUYV422 },
+  { campixfmt_rgba, "rgba", android_format_rgba_8888, AV_PIX_FMT_RGBA },
+};
+
+#define NB_FORMATS  (sizeof(formats) / sizeof(formats[0]))
+
+
+const campixfmt * campixfmt_get(campixfmt_id id)
+{
+  for ( size_t i = 0; i < NB_FORMATS; ++i ) {
+    if ( formats[i].id == id ) {
+      return &formats[i];
+    }
+  }
+  return NULL;
+}
+
+const campixfmt * campixfmt_from_android(int android_format)
+{
+  for ( size_t i = 0; i < NB_FORMATS; ++i ) {
+    if ( formats[i].android_format == android_format ) {
+      return &formats[i];
+    }
+  }
+  return NULL;
+}
+
+const campixfmt * campixfmt_from_name(const char * name)
+{
+  for ( size_t i = 0; name && i < NB_FORMATS; ++i ) {
+    if ( strcasecmp(formats[i].name, name) == 0 ) {
+      return &formats[i];
+    }
+  }
+  return NULL;
+}
+
+
+/* see android.graphics.ImageFormat.YV12 */
+static void yv12_strides(int cx, int * ystride, int * cstride)
+{
+  *ystride = FFALIGN(cx, 16);
+  *cstride = FFALIGN(*ystride / 2, 16);
+}
+
+size_t campixfmt_frame_size(const campixfmt * fmt, int cx, int cy)
+{
+  int ystride, cstride, size;
+
+  if ( !fmt || cx < 1 || cy < 1 ) {
+    return 0;
+  }
+
+  if ( fmt->id == campixfmt_yv12 ) {
+    if ( cy & 1 ) {
+      return 0;
+    }
+    yv12_strides(cx, &ystride, &cstride);
+    return (size_t) ystride * cy + (size_t) cstride * cy;
+  }
+
+  return (size = av_image_get_buffer_size(fmt->avfmt, cx, cy, 1)) > 0 ? size : 0;
+}
+
+int campixfmt_fill_arrays(uint8_t * planes[4], int linesizes[4], const uint8_t * data,
+    const campixfmt * fmt, int cx, int cy)
+{
+  int ystride, cstride;
+
+  if ( !fmt || !campixfmt_frame_size(fmt, cx, cy) ) {
+    return AVERROR(EINVAL);
+  }
+
+  if ( fmt->id != campixfmt_yv12 ) {
+    return av_image_fill_arrays(planes, linesizes, data, fmt->avfmt, cx, cy, 1);
+  }
+
+  yv12_strides(cx, &ystride, &cstride);
+
+  planes[0] = (uint8_t *) data;
+  planes[2] = planes[0] + ystride * cy;       /* V goes first */
+  planes[1] = planes[2] + cstride * (cy / 2);
+  planes[3] = NULL;
+
+  linesizes[0] = ystride;
+  linesizes[1] = linesizes[2] = cstride;
+  linesizes[3] = 0;
+
+  return ystride * cy + cstride * cy;
+}
@@ -0,0 +1,71 @@
+/*
+ * campixfmt.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Camera frame formats: buffer size, plane layout and the AVPixelFormat
+ *  which ffmpeg sees after campixfmt_fill_arrays().
+ *  YV12 is Android layout: Y, V, U planes with 16 byte aligned rows,
+ *  it is given to ffmpeg as YUV420P with swapped chroma pointers, without copy.
+ */
+
+#pragma once
+
+#ifndef __campixfmt_h__
+#define __campixfmt_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+enum campixfmt_id {
+  campixfmt_none = 0,
+  campixfmt_nv21 = 1,   /* Y plane, interleaved V U plane, Android camera default */
+  campixfmt_yv12 = 2,   /* Y, V, U planes, Android row alignment */
+  campixfmt_yuy2 = 3,   /* packed Y0 U Y1 V */
+  campixfmt_rgba = 4,   /* packed R G B A */
+} campixfmt_id;
+
+/* android.graphics.ImageFormat and PixelFormat codes */
+enum {
+  android_format_rgba_8888 = 0x1,
+  android_format_nv21 = 0x11,
+  android_format_yuy2 = 0x14,
+  android_format_yv12 = 0x32315659,
+};
+
+typedef
+struct campixfmt {
+  campixfmt_id id;
+  const char * name;
+  int android_format;
+  enum AVPixelFormat avfmt;
+} campixfmt;
+
+
+/* NULL if unknown */
+const campixfmt * campixfmt_get(campixfmt_id id);
+const campixfmt * campixfmt_from_android(int android_format);
+const campixfmt * campixfmt_from_name(const char * name);
+
+/* Bytes per cx x cy frame, 0 if the format can not have such size (odd YV12 height) */
+size_t campixfmt_frame_size(const campixfmt * fmt, int cx, int cy);
+
+/**
+ * Set plane pointers and line sizes into frame data, in avfmt plane order.
+ *  Returns frame size or negative AVERROR code.
+ */
+int campixfmt_fill_arrays(uint8_t * planes[4], int linesizes[4], const uint8_t * data,
+    const campixfmt * fmt, int cx, int cy);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __campixfmt_h__ */
@@ -0,0 +1,489 @@
+/*
+ * caprec.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+/* pread64() / pwrite64() and O_LARGEFILE: off_t is 32-bit on armeabi-v7a, records pass 2 GiB in a minute */
+#define _LARGEFILE64_SOURCE 1
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "caprec.h"
+#include "debug.h"
+
+#define CAPREC_DEFAULT_BUFFER   (32 * 1024 * 1024)
+#define CAPREC_SLOT_ALIGN       8
+
+
+/*
+ * Record in the writer ring, followed by data.
+ *  Producers reserve slots under the lock and copy data without it, the writer thread
+ *  takes slots in reservation order once they are ready.
+ */
+struct slot {
+  struct caprec_record_header rh;
+  uint32_t ready;           /* data is copied */
+  uint32_t wrap;            /* no record, the rest of the ring up to its end is unused */
+};
+
+struct caprec {
+  int fd;
+  char * path;
+  bool writer;
+  int64_t pos;              /* writer: end of data, writer thread only */
+
+  /* writer: producers -> ring -> writer thread -> file */
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+  pthread_t tid;
+  uint8_t * ring;
+  size_t ringsize;
+  uint64_t head, tail;      /* bytes reserved and bytes released by the writer since start */
+  int drops;                /* records not recorded: ring overflow or after write error */
+  int wstatus;              /* write error, recording has stopped */
+  bool stop;
+
+  struct caprec_header hdr;
+  struct caprec_entry * index;
+  int nrecords, capacity;
+};
+
+
+static int add_entry(caprec * rec, const struct caprec_entry * e)
+{
+  struct caprec_entry * index;
+  int capacity;
+
+  if ( rec->nrecords == rec->capacity ) {
+    capacity = rec->capacity ? rec->capacity * 2 : 4096;
+    if ( !(index = av_realloc_array(rec->index, capacity, sizeof(*index))) ) {
+      return AVERROR(ENOMEM);
+    }
+    rec->index = index;
+    rec->capacity = capacity;
+  }
+
+  rec->index[rec->nrecords++] = *e;
+
+  return 0;
+}
+
+static void destroy(caprec * rec)
+{
+  if ( rec->fd >= 0 ) {
+    close(rec->fd);
+  }
+  if ( rec->writer ) {
+    pthread_cond_destroy(&rec->cond);
+    pthread_mutex_destroy(&rec->mtx);
+  }
+  av_free(rec->ring);
+  av_free(rec->path);
+  av_free(rec->index);
+  av_free(rec);
+}
+
+
+/* Writer thread: file I/O of the record, producers only copy into the ring */
+static void * writer_thread(void * arg)
+{
+  caprec * rec = arg;
+  struct slot * slot;
+  struct caprec_entry e;
+  size_t offset, contig;
+  int status;
+
+  pthread_mutex_lock(&rec->mtx);
+
+  while ( !rec->stop || rec->tail < rec->head ) {
+
+    if ( rec->tail == rec->head ) {
+      pthread_cond_wait(&rec->cond, &rec->mtx);
+      continue;
+    }
+
+    offset = rec->tail % rec->ringsize;
+    contig = rec->ringsize - offset;
+
+    if ( contig < sizeof(struct slot) ) {
+      rec->tail += contig;
+      continue;
+    }
+
+    slot = (struct slot *) (rec->ring + offset);
+
+    if ( !slot->ready ) {
+      /* producer is still copying */
+      pthread_cond_wait(&rec->cond, &rec->mtx);
+      continue;
+    }
+
+    if ( slot->wrap ) {
+      rec->tail += contig;
+      continue;
+    }
+
+    pthread_mutex_unlock(&rec->mtx);
+
+    status = 0;
+
+    if ( !rec->wstatus ) {
+
+      e = (struct caprec_entry ) {
+            .offset = rec->pos + sizeof(slot->rh),
+            .time = slot->rh.time,
+            .size = slot->rh.size,
+            .type = slot->rh.type,
+          };
+
+      if ( pwrite64(rec->fd, &slot->rh, sizeof(slot->rh), rec->pos) != sizeof(slot->rh) ||
+          pwrite64(rec->fd, slot + 1, e.size, e.offset) != (ssize_t) e.size ) {
+        status = AVERROR(errno ? errno : EIO);
+        PERROR("pwrite('%s') fails: %s, recording stopped", rec->path, av_err2str(status));
+      }
+      else if ( (status = add_entry(rec, &e)) == 0 ) {
+        rec->pos = e.offset + e.size;
+      }
+    }
+
+    pthread_mutex_lock(&rec->mtx);
+
+    if ( status ) {
+      rec->wstatus = status;
+    }
+
+    rec->tail += FFALIGN(sizeof(*slot) + slot->rh.size, CAPREC_SLOT_ALIGN);
+  }
+
+  pthread_mutex_unlock(&rec->mtx);
+
+  return NULL;
+}
+
+
+caprec * caprec_create(const char * path, int cx, int cy, int pixfmt, int sample_rate, size_t buffer_size)
+{
+  caprec * rec = NULL;
+  int status;
+  bool fok = false;
+
+  if ( !(rec = av_mallocz(sizeof(*rec))) ) {
+    return NULL;
+  }
+
+  rec->fd = -1;
+
+  if ( !(rec->path = av_strdup(path)) ) {
+    goto end;
+  }
+
+  if ( (rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_LARGEFILE, 0664)) < 0 ) {
+    PERROR("open('%s') fails: %s", path, strerror(errno));
+    goto end;
+  }
+
+  rec->ringsize = FFALIGN(buffer_size ? buffer_size : CAPREC_DEFAULT_BUFFER, CAPREC_SLOT_ALIGN);
+
+  if ( !(rec->ring = av_malloc(rec->ringsize)) ) {
+    PERROR("av_malloc(%zu bytes record buffer) fails", rec->ringsize);
+    goto end;
+  }
+
+  pthread_mutex_init(&rec->mtx, NULL);
+  pthread_cond_init(&rec->cond, NULL);
+  rec->writer = true;
+
+  rec->hdr = (struct caprec_header ) {
+        .magic = CAPREC_MAGIC,
+        .version = CAPREC_VERSION,
+        .cx = cx,
+        .cy = cy,
+        .pixfmt = pixfmt,
+        .sample_rate = sample_rate,
+      };
+
+  if ( pwrite64(rec->fd, &rec->hdr, sizeof(rec->hdr), 0) != sizeof(rec->hdr) ) {
+    PERROR("pwrite('%s') fails: %s", path, strerror(errno));
+    goto end;
+  }
+
+  rec->pos = sizeof(rec->hdr);
+
+  if ( (status = pthread_create(&rec->tid, NULL, writer_thread, rec)) ) {
+    PERROR("pthread_create(writer_thread) fails: %s", strerror(status));
+    rec->tid = 0;
+    goto end;
+  }
+
+  PDBG("recording capture into '%s': %dx%d %d Hz, %zu bytes buffer", path, cx, cy, sample_rate, rec->ringsize);
+
+  fok = true;
+
+end:
+
+  if ( !fok ) {
+    destroy(rec);
+    rec = NULL;
+  }
+
+  return rec;
+}
+
+int caprec_write(caprec * rec, enum caprec_type type, int64_t time, const void * data, size_t size)
+{
+  const size_t need = FFALIGN(sizeof(struct slot) + size, CAPREC_SLOT_ALIGN);
+  struct slot * slot = NULL;
+  size_t offset, contig, wrap;
+  int status = 0;
+
+  pthread_mutex_lock(&rec->mtx);
+
+  offset = rec->head % rec->ringsize;
+  contig = rec->ringsize - offset;
+
+  /* record does not fit before the end of the ring, it starts at the beginning */
+  wrap = contig < need ? contig : 0;
+
+  if ( rec->wstatus ) {
+    status = rec->wstatus;
+    ++rec->drops;
+  }
+  else if ( rec->head + wrap + need - rec->tail > rec->ringsize ) {
+    /* writer is behind, the record would show the disk, not the capture */
+    if ( !rec->drops++ ) {
+      PERROR("'%s': record buffer overflow, records are dropped", rec->path);
+    }
+    status = AVERROR(ENOBUFS);
+  }
+  else {
+
+    if ( wrap >= sizeof(struct slot) ) {
+      slot = (struct slot *) (rec->ring + offset);
+      slot->wrap = slot->ready = 1;
+    }
+
+    rec->head += wrap;
+
+    slot = (struct slot *) (rec->ring + rec->head % rec->ringsize);
+    slot->rh = (struct caprec_record_header ) {
+          .magic = CAPREC_RECORD_MAGIC,
+          .type = type,
+          .size = size,
+          .time = time,
+        };
+    slot->ready = slot->wrap = 0;
+
+    rec->head += need;
+  }
+
+  pthread_mutex_unlock(&rec->mtx);
+
+  if ( slot ) {
+
+    memcpy(slot + 1, data, size);
+
+    pthread_mutex_lock(&rec->mtx);
+    slot->ready = 1;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->mtx);
+  }
+
+  return status;
+}
+
+int caprec_drops(caprec * rec)
+{
+  int drops;
+
+  pthread_mutex_lock(&rec->mtx);
+  drops = rec->drops;
+  pthread_mutex_unlock(&rec->mtx);
+
+  return drops;
+}
+
+int caprec_close(caprec ** prec)
+{
+  caprec * rec;
+  size_t index_size;
+  int status = 0;
+
+  if ( !prec || !(rec = *prec) ) {
+    return 0;
+  }
+
+  if ( rec->writer && rec->tid ) {
+
+    /* the writer drains the ring and exits */
+    pthread_mutex_lock(&rec->mtx);
+    rec->stop = true;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->mtx);
+    pthread_join(rec->tid, NULL);
+
+    if ( rec->drops ) {
+      PERROR("'%s': %d records were dropped", rec->path, rec->drops);
+    }
+
+    index_size = rec->nrecords * sizeof(struct caprec_entry);
+
+    rec->hdr.index_offset = rec->pos;
+    rec->hdr.nrecords = rec->nrecords;
+
+    if ( pwrite64(rec->fd, rec->index, index_size, rec->pos) != (ssize_t) index_size ||
+        pwrite64(rec->fd, &rec->hdr, sizeof(rec->hdr), 0) != sizeof(rec->hdr) ) {
+      status = AVERROR(errno ? errno : EIO);
+      PERROR("finalizing '%s' fails: %s", rec->path, av_err2str(status));
+    }
+    else {
+      PDBG("'%s': %d records, %"PRId64" bytes", rec->path, rec->nrecords, rec->pos + (int64_t) index_size);
+    }
+  }
+
+  destroy(rec);
+  *prec = NULL;
+
+  return status;
+}
+
+
+/* Index was not written, walk record headers up to the first one whose data is cut by EOF */
+static int scan_records(caprec * rec)
+{
+  struct caprec_record_header rh;
+  struct caprec_entry e;
+  struct stat64 st;
+  int64_t pos = sizeof(rec->hdr);
+  int status;
+
+  if ( fstat64(rec->fd, &st) != 0 ) {
+    status = AVERROR(errno);
+    PERROR("fstat('%s') fails: %s", rec->path, av_err2str(status));
+    return status;
+  }
+
+  while ( pread64(rec->fd, &rh, sizeof(rh), pos) == sizeof(rh) && rh.magic == CAPREC_RECORD_MAGIC ) {
+
+    if ( pos + (int64_t) sizeof(rh) + rh.size > st.st_size ) {
+      /* the recording was killed while this record was written */
+      break;
+    }
+
+    e = (struct caprec_entry ) {
+          .offset = pos + sizeof(rh),
+          .time = rh.time,
+          .size = rh.size,
+          .type = rh.type,
+        };
+
+    if ( (status = add_entry(rec, &e)) ) {
+      return status;
+    }
+
+    pos = e.offset + rh.size;
+  }
+
+  PDBG("'%s' was not finalized, recovered %d records", rec->path, rec->nrecords);
+
+  return 0;
+}
+
+caprec * caprec_open(const char * path)
+{
+  caprec * rec = NULL;
+  size_t index_size;
+  bool fok = false;
+
+  if ( !(rec = av_mallocz(sizeof(*rec))) ) {
+    return NULL;
+  }
+
+  rec->fd = -1;
+
+  if ( !(rec->path = av_strdup(path)) ) {
+    goto end;
+  }
+
+  if ( (rec->fd = open(path, O_RDONLY | O_CLOEXEC | O_LARGEFILE)) < 0 ) {
+    PERROR("open('%s') fails: %s", path, strerror(errno));
+    goto end;
+  }
+
+  if ( pread64(rec->fd, &rec->hdr, sizeof(rec->hdr), 0) != sizeof(rec->hdr) || rec->hdr.magic != CAPREC_MAGIC
+      || rec->hdr.version != CAPREC_VERSION ) {
+    PERROR("'%s' is not a capture record file", path);
+    errno = EINVAL;
+    goto end;
+  }
+
+  if ( !rec->hdr.index_offset ) {
+    if ( scan_records(rec) ) {
+      goto end;
+    }
+  }
+  else {
+
+    index_size = rec->hdr.nrecords * sizeof(struct caprec_entry);
+
+    if ( !(rec->index = av_malloc(FFMAX(index_size, 1))) ) {
+      goto end;
+    }
+
+    if ( pread64(rec->fd, rec->index, index_size, rec->hdr.index_offset) != (ssize_t) index_size ) {
+      PERROR("'%s': index read fails", path);
+      errno = EIO;
+      goto end;
+    }
+
+    rec->nrecords = rec->capacity = rec->hdr.nrecords;
+  }
+
+  fok = true;
+
+end:
+
+  if ( !fok ) {
+    destroy(rec);
+    rec = NULL;
+  }
+
+  return rec;
+}
+
+const struct caprec_header * caprec_get_header(const caprec * rec)
+{
+  return &rec->hdr;
+}
+
+int caprec_count(const caprec * rec)
+{
+  return rec->nrecords;
+}
+
+const struct caprec_entry * caprec_get_entry(const caprec * rec, int index)
+{
+  return index >= 0 && index < rec->nrecords ? &rec->index[index] : NULL;
+}
+
+int caprec_read(caprec * rec, int index, void * data, size_t size)
+{
+  const struct caprec_entry * e;
+  ssize_t n;
+
+  if ( !(e = caprec_get_entry(rec, index)) ) {
+    return AVERROR(EINVAL);
+  }
+
+  if ( size > e->size ) {
+    size = e->size;
+  }
+
+  if ( (n = pread64(rec->fd, data, size, e->offset)) < 0 ) {
+    return AVERROR(errno);
+  }
+
+  return (int) n;
+}
@@ -0,0 +1,93 @@
+/*
+ * caprec.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Capture record file: raw camera frames and audio buffers with their capture times,
+ *  as they entered the stream. Replayed by the 'replay' capture backends (capture-replay.c)
+ *  to reproduce field sessions on host builds.
+ *
+ *  Layout:
+ *    struct caprec_header
+ *    { struct caprec_record_header, data } ...
+ *    struct caprec_entry [nrecords]          index, written by caprec_close()
+ *
+ *  If the index is missing (the writer has crashed), caprec_open() rebuilds it by scanning records.
+ */
+
+#pragma once
+
+#ifndef __caprec_h__
+#define __caprec_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define CAPREC_MAGIC          0x52435046  /* 'FPCR' */
+#define CAPREC_RECORD_MAGIC   0x44524352  /* 'RCRD' */
+#define CAPREC_VERSION        2   /* 2: pixfmt is enum campixfmt_id */
+
+enum caprec_type {
+  caprec_video = 0,     /* cx x cy camera frame of header pixfmt */
+  caprec_audio = 1,     /* mono S16 at sample_rate */
+};
+
+struct caprec_header {
+  uint32_t magic;
+  uint32_t version;
+  int32_t cx, cy, pixfmt;
+  int32_t sample_rate;
+  int64_t index_offset;   /* 0 if not finalized */
+  int32_t nrecords;
+  int32_t reserved;
+};
+
+struct caprec_record_header {
+  uint32_t magic;
+  uint32_t type;
+  uint32_t size;
+  uint32_t reserved;
+  int64_t time;           /* CLOCK_MONOTONIC [us] */
+};
+
+struct caprec_entry {
+  int64_t offset;         /* of record data */
+  int64_t time;
+  uint32_t size;
+  uint32_t type;
+};
+
+
+typedef struct caprec
+  caprec;
+
+
+/**
+ * Writer. caprec_write() is thread safe, camera and audio threads record concurrently.
+ *  It only copies into buffer of buffer_size bytes (0 = default 32 MiB), the file is written by own thread.
+ *  When the buffer is full the record is dropped with AVERROR(ENOBUFS), caprec_drops() counts them.
+ */
+caprec * caprec_create(const char * path, int cx, int cy, int pixfmt, int sample_rate, size_t buffer_size);
+int caprec_write(caprec * rec, enum caprec_type type, int64_t time, const void * data, size_t size);
+int caprec_drops(caprec * rec);
+int caprec_close(caprec ** rec);
+
+
+/** Reader */
+caprec * caprec_open(const char * path);
+const struct caprec_header * caprec_get_header(const caprec * rec);
+int caprec_count(const caprec * rec);
+const struct caprec_entry * caprec_get_entry(const caprec * rec, int index);
+int caprec_read(caprec * rec, int index, void * data, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __caprec_h__ */
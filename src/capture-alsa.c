@@ -0,0 +1,178 @@
+/*
+ * capture-alsa.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  ALSA pcm device as audio capture backend, host builds with HAVE_ALSA
+ */
+
+#ifdef HAVE_ALSA
+
+#include <alsa/asoundlib.h>
+#include "capture.h"
+#include "debug.h"
+
+/* device buffer, covers scheduling hiccups of the reader thread */
+#define ALSA_LATENCY    100000  /* [us] */
+
+
+struct alsasrc {
+  capture_params p;
+  snd_pcm_t * pcm;
+  capture_bufq q;
+  pthread_t pid;
+  bool started;
+};
+
+
+static void * alsasrc_thread(void * arg)
+{
+  struct alsasrc * src = arg;
+  struct capture_buffer b;
+  snd_pcm_sframes_t n;
+  size_t nb_samples, pos;
+
+  PDBG("ENTER");
+
+  while ( capture_bufq_pop(&src->q, &b) ) {
+
+    nb_samples = b.size / sizeof(int16_t);
+
+    for ( pos = 0; pos < nb_samples; ) {
+      if ( (n = snd_pcm_readi(src->pcm, (int16_t*) b.bfr + pos, nb_samples - pos)) >= 0 ) {
+        pos += n;
+      }
+      else if ( (n = snd_pcm_recover(src->pcm, n, 1)) < 0 ) {
+        PERROR("snd_pcm_readi() fails: %s", snd_strerror(n));
+        goto end;
+      }
+      else {
+        PDBG("snd_pcm_readi(): overrun recovered");
+      }
+    }
+
+    src->p.callback(src->p.cookie, b.bfr, b.size, 0);
+  }
+
+end:
+
+  PDBG("LEAVE");
+  return NULL;
+}
+
+static int create(void ** dev, const capture_params * p)
+{
+  struct alsasrc * src = NULL;
+  const char * device = p->device && *p->device ? p->device : "default";
+  int status;
+
+  if ( !(src = av_mallocz(sizeof(*src))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  src->p = *p;
+
+  if ( (status = capture_bufq_init(&src->q, FFMAX(p->nbuffers, 1))) ) {
+    av_free(src);
+    return status;
+  }
+
+  if ( (status = snd_pcm_open(&src->pcm, device, SND_PCM_STREAM_CAPTURE, 0)) < 0 ) {
+    PERROR("snd_pcm_open('%s') fails: %s", device, snd_strerror(status));
+    goto end;
+  }
+
+  status = snd_pcm_set_params(src->pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, 1, p->sample_rate, 1,
+      ALSA_LATENCY);
+  if ( status < 0 ) {
+    PERROR("snd_pcm_set_params('%s', %d Hz) fails: %s", device, p->sample_rate, snd_strerror(status));
+    goto end;
+  }
+
+  status = 0;
+
+end:
+
+  if ( status ) {
+    if ( src->pcm ) {
+      snd_pcm_close(src->pcm);
+    }
+    capture_bufq_cleanup(&src->q);
+    av_free(src);
+    return AVERROR(-status);
+  }
+
+  *dev = src;
+
+  return 0;
+}
+
+static int stop(void * dev)
+{
+  struct alsasrc * src = dev;
+
+  if ( src->started ) {
+    capture_bufq_close(&src->q);
+    snd_pcm_drop(src->pcm); /* unblocks snd_pcm_readi() */
+    pthread_join(src->pid, NULL);
+    src->started = false;
+  }
+
+  return 0;
+}
+
+static void destroy(void * dev)
+{
+  struct alsasrc * src = dev;
+
+  stop(src);
+  snd_pcm_close(src->pcm);
+  capture_bufq_cleanup(&src->q);
+  av_free(src);
+}
+
+static int start(void * dev)
+{
+  struct alsasrc * src = dev;
+  int status;
+
+  if ( src->started ) {
+    return AVERROR(EALREADY);
+  }
+
+  capture_bufq_open(&src->q);
+
+  if ( (status = snd_pcm_prepare(src->pcm)) < 0 || (status = snd_pcm_start(src->pcm)) < 0 ) {
+    PERROR("snd_pcm_start() fails: %s", snd_strerror(status));
+    return AVERROR(-status);
+  }
+
+  if ( (status = pthread_create(&src->pid, NULL, alsasrc_thread, src)) ) {
+    PERROR("pthread_create() fails: %s", strerror(status));
+    snd_pcm_drop(src->pcm);
+    return AVERROR(status);
+  }
+
+  src->started = true;
+
+  return 0;
+}
+
+static int enqueue(void * dev, void * bfr, size_t size)
+{
+  return capture_bufq_push(&((struct alsasrc *) dev)->q, bfr, size);
+}
+
+
+const capture_backend capture_backend_alsa = {
+  .name = "alsa",
+  .media = capture_media_audio,
+  .create = create,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+};
+
+#endif /* HAVE_ALSA */
@@ -0,0 +1,46 @@
+/*
+ * capture-feed.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include "capture-feed.h"
+
+
+/* Capture backend thread: hand the filled frame over to the encoder */
+void capture_feed_callback(void * cookie, void * bfr, size_t size, int64_t capture_time)
+{
+  capture_feed * feed = cookie;
+  struct frm * frm = get_video_frame_by_data(feed->ff, bfr);
+
+  (void) size;
+
+  push_video_frame(feed->ff, frm, capture_time);
+  atomic_fetch_sub(&feed->queued, 1);
+}
+
+void capture_feed_refill(capture_feed * feed)
+{
+  struct frm * frm;
+
+  while ( atomic_load(&feed->queued) < CAPTURE_FEED_BUFFERS ) {
+
+    if ( (frm = feed->pending) ) {
+      feed->pending = NULL;
+    }
+    else if ( !(frm = pop_video_frame(feed->ff)) ) {
+      break;
+    }
+
+    atomic_fetch_add(&feed->queued, 1);
+
+    if ( capture_enqueue(feed->src, frm->data, feed->frame_size) != 0 ) {
+      /* nothing was captured into it. The capture thread is the only producer of the
+       *  encoder's return ring, so the frame is not given back from here but kept for next try */
+      atomic_fetch_sub(&feed->queued, 1);
+      feed->pending = frm;
+      break;
+    }
+  }
+}
@@ -0,0 +1,48 @@
+/*
+ * capture-feed.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Video capture source driven into output stream frame pool, for host tools:
+ *    free pool frames are lent to the capture backend, filled ones are pushed to the encoder.
+ */
+
+#pragma once
+
+#ifndef __capture_feed_h__
+#define __capture_feed_h__
+
+#include <stdatomic.h>
+#include "sendvideo.h"
+#include "capture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* frames lent to capture backend at a time, capture_params.nbuffers */
+#define CAPTURE_FEED_BUFFERS    4
+
+typedef
+struct capture_feed {
+  ff_output_stream * ff;
+  capture_source * src;
+  size_t frame_size;
+  atomic_int queued;          /* frames lent to capture backend */
+  struct frm * pending;       /* frame capture_enqueue() failed on, lent first by next refill */
+} capture_feed;
+
+
+/* capture_params.callback, with capture_params.cookie = feed */
+void capture_feed_callback(void * cookie, void * bfr, size_t size, int64_t capture_time);
+
+/* Lend free pool frames to capture backend, called periodically by the tool main loop */
+void capture_feed_refill(capture_feed * feed);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __capture_feed_h__ */
@@ -0,0 +1,256 @@
+/*
+ * capture-file.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Raw file and synthetic capture backends for host builds, tests and benchmarks:
+ *    pcmfile   S16LE mono samples, 440 Hz tone without file
+ *    nv21file  NV21 frames, moving test pattern without file
+ *  Files are looped at EOF. Buffers are delivered at real time pace unless params.freerun is set.
+ */
+
+#include <math.h>
+#include "capture.h"
+#include "debug.h"
+
+
+struct filesrc {
+  capture_params p;
+  enum capture_media media;
+  FILE * fp;          /* NULL for synthetic source */
+  capture_bufq q;
+
+  pthread_t pid;
+  bool started;
+
+  int64_t t0;         /* start time [us] */
+  int64_t nunits;     /* samples or frames delivered */
+};
+
+
+static void fill_tone(struct filesrc * src, int16_t * samples, int n)
+{
+  for ( int i = 0; i < n; ++i ) {
+    samples[i] = (int16_t) (8000 * sin(2 * M_PI * 440 * (src->nunits + i) / src->p.sample_rate));
+  }
+}
+
+static void fill_pattern(struct filesrc * src, uint8_t * nv21)
+{
+  const int cx = src->p.cx, cy = src->p.cy;
+  const int shift = (int) src->nunits * 4;
+  uint8_t * vu = nv21 + cx * cy;
+
+  /* diagonal luma ramp moving right, chroma bands */
+  for ( int y = 0; y < cy; ++y ) {
+    for ( int x = 0; x < cx; ++x ) {
+      nv21[y * cx + x] = (uint8_t) (x + y + shift);
+    }
+  }
+
+  for ( int y = 0; y < cy / 2; ++y ) {
+    for ( int x = 0; x < cx / 2; ++x ) {
+      vu[y * cx + 2 * x] = (uint8_t) (128 + 64 * ((y / 16) & 1));
+      vu[y * cx + 2 * x + 1] = (uint8_t) (128 + 64 * (((x + shift / 2) / 16) & 1));
+    }
+  }
+}
+
+static int read_looped(struct filesrc * src, void * bfr, size_t size)
+{
+  size_t n = 0, k;
+  bool rewound = false;
+
+  while ( n < size ) {
+    if ( (k = fread((uint8_t*) bfr + n, 1, size - n, src->fp)) > 0 ) {
+      n += k;
+      rewound = false;
+    }
+    else if ( ferror(src->fp) || rewound || fseek(src->fp, 0, SEEK_SET) != 0 ) {
+      /* read error or empty file */
+      PERROR("read fails on '%s'", src->p.device);
+      return AVERROR(EIO);
+    }
+    else {
+      rewound = true;
+    }
+  }
+
+  return 0;
+}
+
+static void * filesrc_thread(void * arg)
+{
+  struct filesrc * src = arg;
+  struct capture_buffer b;
+  struct timespec ts;
+  int64_t t;
+  int n;
+
+  PDBG("ENTER");
+
+  while ( capture_bufq_pop(&src->q, &b) ) {
+
+    if ( src->media == capture_media_audio ) {
+      n = b.size / sizeof(int16_t);
+      if ( !src->fp ) {
+        fill_tone(src, b.bfr, n);
+      }
+      else if ( read_looped(src, b.bfr, n * sizeof(int16_t)) ) {
+        break;
+      }
+      src->nunits += n;
+      t = src->t0 + src->nunits * 1000000 / src->p.sample_rate;
+    }
+    else {
+      if ( !src->fp ) {
+        fill_pattern(src, b.bfr);
+      }
+      else if ( read_looped(src, b.bfr, b.size) ) {
+        break;
+      }
+      ++src->nunits;
+      t = src->t0 + src->nunits * 1000000 / src->p.fps;
+    }
+
+    if ( !src->p.freerun ) {
+      /* the buffer is complete when its last sample has been 'recorded' */
+      ts.tv_sec = t / 1000000;
+      ts.tv_nsec = (t % 1000000) * 1000;
+      while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR ) {
+      }
+    }
+
+    src->p.callback(src->p.cookie, b.bfr, b.size, t);
+  }
+
+  PDBG("LEAVE");
+  return NULL;
+}
+
+static int create(void ** dev, const capture_params * p, enum capture_media media)
+{
+  struct filesrc * src = NULL;
+  int status;
+
+  if ( media == capture_media_audio ? p->sample_rate < 1 : (p->cx < 2 || p->cy < 2 || p->fps < 1) ) {
+    return AVERROR(EINVAL);
+  }
+
+  if ( !(src = av_mallocz(sizeof(*src))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  src->p = *p;
+  src->media = media;
+
+  if ( (status = capture_bufq_init(&src->q, FFMAX(p->nbuffers, 1))) ) {
+    av_free(src);
+    return status;
+  }
+
+  if ( p->device && *p->device && !(src->fp = fopen(p->device, "rb")) ) {
+    status = AVERROR(errno);
+    PERROR("fopen('%s') fails: %s", p->device, strerror(errno));
+    capture_bufq_cleanup(&src->q);
+    av_free(src);
+    return status;
+  }
+
+  *dev = src;
+
+  return 0;
+}
+
+static int create_pcm(void ** dev, const capture_params * p)
+{
+  return create(dev, p, capture_media_audio);
+}
+
+static int create_nv21(void ** dev, const capture_params * p)
+{
+  return create(dev, p, capture_media_video);
+}
+
+static int stop(void * dev)
+{
+  struct filesrc * src = dev;
+
+  if ( src->started ) {
+    capture_bufq_close(&src->q);
+    pthread_join(src->pid, NULL);
+    src->started = false;
+  }
+
+  return 0;
+}
+
+static void destroy(void * dev)
+{
+  struct filesrc * src = dev;
+
+  stop(src);
+
+  if ( src->fp ) {
+    fclose(src->fp);
+  }
+
+  capture_bufq_cleanup(&src->q);
+  av_free(src);
+}
+
+static int start(void * dev)
+{
+  struct filesrc * src = dev;
+  int status;
+
+  if ( src->started ) {
+    return AVERROR(EALREADY);
+  }
+
+  capture_bufq_open(&src->q);
+  src->t0 = ffmpeg_gettime_us();
+  src->nunits = 0;
+
+  if ( (status = pthread_create(&src->pid, NULL, filesrc_thread, src)) ) {
+    PERROR("pthread_create() fails: %s", strerror(status));
+    return AVERROR(status);
+  }
+
+  src->started = true;
+
+  return 0;
+}
+
+static int enqueue(void * dev, void * bfr, size_t size)
+{
+  struct filesrc * src = dev;
+
+  if ( src->media == capture_media_video && size < (size_t) av_image_get_buffer_size(AV_PIX_FMT_NV21, src->p.cx, src->p.cy, 1) ) {
+    return AVERROR(EINVAL);
+  }
+
+  return capture_bufq_push(&src->q, bfr, size);
+}
+
+
+const capture_backend capture_backend_pcmfile = {
+  .name = "pcmfile",
+  .media = capture_media_audio,
+  .create = create_pcm,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+};
+
+const capture_backend capture_backend_nv21file = {
+  .name = "nv21file",
+  .media = capture_media_video,
+  .create = create_nv21,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+};
@@ -0,0 +1,98 @@
+/*
+ * capture-opensles.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Android OpenSL ES recorder as audio capture backend
+ */
+
+#include "capture.h"
+#include "opensless-audio.h"
+#include "debug.h"
+
+
+struct slsrc {
+  opensless_audio_capture * capdev;
+  capture_callback callback;
+  void * cookie;
+};
+
+/* OpenSL buffer queue callback, the buffer has just been completed */
+static void on_buffer(void * context, void * bfr, size_t size)
+{
+  struct slsrc * src = context;
+  src->callback(src->cookie, bfr, size, 0);
+}
+
+static int create(void ** dev, const capture_params * p)
+{
+  struct slsrc * src = NULL;
+  int status;
+
+  if ( !(src = av_mallocz(sizeof(*src))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  src->callback = p->callback;
+  src->cookie = p->cookie;
+
+  if ( (status = opensless_audio_initialize()) != SL_RESULT_SUCCESS ) {
+    PERROR("opensless_audio_initialize() fails: status=0x%0X", status);
+    av_free(src);
+    return AVERROR_EXTERNAL;
+  }
+
+  status = opensless_audio_capture_create(&src->capdev, src, on_buffer, p->nbuffers, p->sample_rate);
+  if ( status != 0 || !src->capdev ) {
+    PERROR("opensless_audio_capture_create() fails: status=0x%0X", status);
+    opensless_audio_shutdown();
+    av_free(src);
+    return AVERROR_EXTERNAL;
+  }
+
+  *dev = src;
+
+  return 0;
+}
+
+static void destroy(void * dev)
+{
+  struct slsrc * src = dev;
+  opensless_audio_capture_destroy(&src->capdev);
+  opensless_audio_shutdown();
+  av_free(src);
+}
+
+static int start(void * dev)
+{
+  int status;
+
+  if ( (status = opensless_audio_capture_start(((struct slsrc *) dev)->capdev)) != 0 ) {
+    PERROR("opensless_audio_capture_start() fails: status=0x%0X", status);
+    return AVERROR_EXTERNAL;
+  }
+
+  return 0;
+}
+
+static int enqueue(void * dev, void * bfr, size_t size)
+{
+  return opensless_audio_capture_enqueue(((struct slsrc *) dev)->capdev, bfr, size) == 0 ? 0 : AVERROR_EXTERNAL;
+}
+
+static int stop(void * dev)
+{
+  return opensless_audio_capture_stop(((struct slsrc *) dev)->capdev) == 0 ? 0 : AVERROR_EXTERNAL;
+}
+
+
+const capture_backend capture_backend_opensles = {
+  .name = "opensles",
+  .media = capture_media_audio,
+  .create = create,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+};
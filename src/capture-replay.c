@@ -0,0 +1,274 @@
+/*
+ * capture-replay.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Replay of capture record file (caprec.h) as audio and video capture backends.
+ *  params.device is the record file path.
+ *
+ *  Both sources of one process share the time origin, so recorded A/V timing is kept:
+ *  a record is delivered at epoch + (record time - first record time).
+ *  With params.freerun records are delivered as fast as the caller enqueues buffers,
+ *  and capture times passed to the callback are still the rebased recorded ones.
+ */
+
+#include <stdatomic.h>
+#include "capture.h"
+#include "caprec.h"
+#include "debug.h"
+
+
+struct replaysrc {
+  capture_params p;
+  enum capture_media media;
+  caprec * rec;
+  int64_t first_time;     /* of the whole record file */
+  int pos;                /* next record */
+  atomic_bool eof;
+
+  capture_bufq q;
+  pthread_t pid;
+  bool started;
+};
+
+
+/* shared by audio and video sources */
+static pthread_mutex_t epoch_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int64_t epoch;
+static int nactive;
+
+
+static int64_t acquire_epoch(void)
+{
+  int64_t t;
+
+  pthread_mutex_lock(&epoch_mtx);
+  if ( nactive++ == 0 ) {
+    epoch = ffmpeg_gettime_us();
+  }
+  t = epoch;
+  pthread_mutex_unlock(&epoch_mtx);
+
+  return t;
+}
+
+static void release_epoch(void)
+{
+  pthread_mutex_lock(&epoch_mtx);
+  --nactive;
+  pthread_mutex_unlock(&epoch_mtx);
+}
+
+
+static int next_record(struct replaysrc * src)
+{
+  const struct caprec_entry * e;
+  const uint32_t type = src->media == capture_media_audio ? caprec_audio : caprec_video;
+
+  while ( (e = caprec_get_entry(src->rec, src->pos)) && e->type != type ) {
+    ++src->pos;
+  }
+
+  return e ? src->pos : -1;
+}
+
+static void * replaysrc_thread(void * arg)
+{
+  struct replaysrc * src = arg;
+  const struct caprec_entry * e;
+  struct capture_buffer b;
+  struct timespec ts;
+  const int64_t t0 = acquire_epoch();
+  int64_t t;
+  int n;
+
+  PDBG("ENTER");
+
+  if ( !src->p.freerun ) {
+    /* joining a running replay, e.g. restarted audio source: skip what is already in the past */
+    while ( next_record(src) >= 0 && t0 + caprec_get_entry(src->rec, src->pos)->time - src->first_time < ffmpeg_gettime_us() ) {
+      ++src->pos;
+    }
+  }
+
+  while ( capture_bufq_pop(&src->q, &b) ) {
+
+    if ( next_record(src) < 0 ) {
+      PDBG("%s: end of record", src->media == capture_media_audio ? "audio" : "video");
+      atomic_store(&src->eof, true);
+      break;
+    }
+
+    e = caprec_get_entry(src->rec, src->pos++);
+
+    if ( e->size > b.size ) {
+      PERROR("record %d: size %u does not fit into buffer of %zu bytes, truncated", src->pos - 1, e->size, b.size);
+    }
+
+    if ( (n = caprec_read(src->rec, src->pos - 1, b.bfr, b.size)) < 0 ) {
+      PERROR("caprec_read() fails: %s", av_err2str(n));
+      atomic_store(&src->eof, true);
+      break;
+    }
+
+    t = t0 + e->time - src->first_time;
+
+    if ( !src->p.freerun ) {
+      ts.tv_sec = t / 1000000;
+      ts.tv_nsec = (t % 1000000) * 1000;
+      while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR ) {
+      }
+    }
+
+    src->p.callback(src->p.cookie, b.bfr, n, t);
+  }
+
+  release_epoch();
+
+  PDBG("LEAVE");
+  return NULL;
+}
+
+static int create(void ** dev, const capture_params * p, enum capture_media media)
+{
+  struct replaysrc * src = NULL;
+  const struct caprec_header * hdr;
+  int status;
+
+  if ( !p->device || !*p->device ) {
+    PERROR("record file is not specified");
+    return AVERROR(EINVAL);
+  }
+
+  if ( !(src = av_mallocz(sizeof(*src))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  src->p = *p;
+  src->media = media;
+
+  if ( !(src->rec = caprec_open(p->device)) ) {
+    status = AVERROR(errno ? errno : EINVAL);
+    av_free(src);
+    return status;
+  }
+
+  hdr = caprec_get_header(src->rec);
+
+  if ( media == capture_media_audio && p->sample_rate != hdr->sample_rate ) {
+    PERROR("'%s' was recorded at %d Hz, not %d Hz. Use -capture_rate %d", p->device, hdr->sample_rate,
+        p->sample_rate, hdr->sample_rate);
+    caprec_close(&src->rec);
+    av_free(src);
+    return AVERROR(EINVAL);
+  }
+
+  if ( media == capture_media_video && (p->cx != hdr->cx || p->cy != hdr->cy) ) {
+    PERROR("'%s' has %dx%d frames, not %dx%d", p->device, hdr->cx, hdr->cy, p->cx, p->cy);
+    caprec_close(&src->rec);
+    av_free(src);
+    return AVERROR(EINVAL);
+  }
+
+  if ( caprec_count(src->rec) > 0 ) {
+    src->first_time = caprec_get_entry(src->rec, 0)->time;
+  }
+
+  if ( (status = capture_bufq_init(&src->q, FFMAX(p->nbuffers, 1))) ) {
+    caprec_close(&src->rec);
+    av_free(src);
+    return status;
+  }
+
+  *dev = src;
+
+  return 0;
+}
+
+static int create_audio(void ** dev, const capture_params * p)
+{
+  return create(dev, p, capture_media_audio);
+}
+
+static int create_video(void ** dev, const capture_params * p)
+{
+  return create(dev, p, capture_media_video);
+}
+
+static int stop(void * dev)
+{
+  struct replaysrc * src = dev;
+
+  if ( src->started ) {
+    capture_bufq_close(&src->q);
+    pthread_join(src->pid, NULL);
+    src->started = false;
+  }
+
+  return 0;
+}
+
+static void destroy(void * dev)
+{
+  struct replaysrc * src = dev;
+
+  stop(src);
+  caprec_close(&src->rec);
+  capture_bufq_cleanup(&src->q);
+  av_free(src);
+}
+
+static int start(void * dev)
+{
+  struct replaysrc * src = dev;
+  int status;
+
+  if ( src->started ) {
+    return AVERROR(EALREADY);
+  }
+
+  capture_bufq_open(&src->q);
+
+  if ( (status = pthread_create(&src->pid, NULL, replaysrc_thread, src)) ) {
+    PERROR("pthread_create() fails: %s", strerror(status));
+    return AVERROR(status);
+  }
+
+  src->started = true;
+
+  return 0;
+}
+
+static int enqueue(void * dev, void * bfr, size_t size)
+{
+  return capture_bufq_push(&((struct replaysrc *) dev)->q, bfr, size);
+}
+
+static bool is_eof(void * dev)
+{
+  return atomic_load(&((struct replaysrc *) dev)->eof);
+}
+
+
+const capture_backend capture_backend_replay_audio = {
+  .name = "replay",
+  .media = capture_media_audio,
+  .create = create_audio,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+  .eof = is_eof,
+};
+
+const capture_backend capture_backend_replay_video = {
+  .name = "replay",
+  .media = capture_media_video,
+  .create = create_video,
+  .destroy = destroy,
+  .start = start,
+  .enqueue = enqueue,
+  .stop = stop,
+  .eof = is_eof,
+};
@@ -0,0 +1,185 @@
+/*
+ * capture.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include "capture.h"
+#include "debug.h"
+
+
+struct capture_source {
+  const capture_backend * backend;
+  void * dev;
+};
+
+
+/* the first one for each media is default */
+static const capture_backend * const backends[] = {
+#ifdef __ANDROID__
+  &capture_backend_opensles,
+#endif
+#ifdef HAVE_ALSA
+  &capture_backend_alsa,
+#endif
+  &capture_backend_pcmfile,
+  &capture_backend_nv21file,
+  &capture_backend_replay_audio,
+  &capture_backend_replay_video,
+  NULL,
+};
+
+
+const capture_backend * const * capture_get_backend_list(void)
+{
+  return backends;
+}
+
+const capture_backend * capture_find_backend(enum capture_media media, const char * name)
+{
+  for ( int i = 0; backends[i]; ++i ) {
+    if ( backends[i]->media == media && (!name || !*name || strcmp(backends[i]->name, name) == 0) ) {
+      return backends[i];
+    }
+  }
+  return NULL;
+}
+
+
+int capture_create(capture_source ** src, enum capture_media media, const char * backend_name, const capture_params * params)
+{
+  const capture_backend * backend;
+  int status;
+
+  *src = NULL;
+
+  if ( !(backend = capture_find_backend(media, backend_name)) ) {
+    PERROR("no %s capture backend '%s'", media == capture_media_audio ? "audio" : "video",
+        backend_name ? backend_name : "");
+    return AVERROR(ENODEV);
+  }
+
+  if ( !(*src = av_mallocz(sizeof(**src))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  (*src)->backend = backend;
+
+  if ( (status = backend->create(&(*src)->dev, params)) ) {
+    PERROR("%s: create fails: %s", backend->name, av_err2str(status));
+    av_freep(src);
+  }
+
+  return status;
+}
+
+void capture_destroy(capture_source ** src)
+{
+  if ( src && *src ) {
+    if ( (*src)->dev ) {
+      (*src)->backend->destroy((*src)->dev);
+    }
+    av_freep(src);
+  }
+}
+
+int capture_start(capture_source * src)
+{
+  return src->backend->start(src->dev);
+}
+
+int capture_enqueue(capture_source * src, void * bfr, size_t size)
+{
+  return src->backend->enqueue(src->dev, bfr, size);
+}
+
+int capture_stop(capture_source * src)
+{
+  return src->backend->stop(src->dev);
+}
+
+const char * capture_name(const capture_source * src)
+{
+  return src->backend->name;
+}
+
+bool capture_is_eof(const capture_source * src)
+{
+  return src->backend->eof && src->backend->eof(src->dev);
+}
+
+
+
+int capture_bufq_init(capture_bufq * q, int capacity)
+{
+  int status;
+
+  if ( !ccfifo_init(&q->q, capacity, sizeof(struct capture_buffer)) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  if ( (status = pthread_wait_init(&q->lock)) ) {
+    ccfifo_cleanup(&q->q);
+    return AVERROR(status);
+  }
+
+  q->closed = false;
+
+  return 0;
+}
+
+void capture_bufq_cleanup(capture_bufq * q)
+{
+  pthread_wait_destroy(&q->lock);
+  ccfifo_cleanup(&q->q);
+}
+
+int capture_bufq_push(capture_bufq * q, void * bfr, size_t size)
+{
+  const struct capture_buffer b = {
+    .bfr = bfr,
+    .size = size
+  };
+
+  int status = 0;
+
+  pthread_wait_lock(&q->lock);
+  if ( !ccfifo_push(&q->q, &b) ) {
+    status = AVERROR(ENOBUFS);
+  }
+  pthread_wait_broadcast(&q->lock);
+  pthread_wait_unlock(&q->lock);
+
+  return status;
+}
+
+bool capture_bufq_pop(capture_bufq * q, struct capture_buffer * b)
+{
+  bool fok = false;
+
+  pthread_wait_lock(&q->lock);
+
+  while ( !q->closed && !(fok = ccfifo_pop(&q->q, b)) ) {
+    pthread_wait(&q->lock, -1);
+  }
+
+  pthread_wait_unlock(&q->lock);
+
+  return fok;
+}
+
+void capture_bufq_open(capture_bufq * q)
+{
+  pthread_wait_lock(&q->lock);
+  q->closed = false;
+  pthread_wait_unlock(&q->lock);
+}
+
+void capture_bufq_close(capture_bufq * q)
+{
+  pthread_wait_lock(&q->lock);
+  q->closed = true;
+  pthread_wait_broadcast(&q->lock);
+  pthread_wait_unlock(&q->lock);
+}
@@ -0,0 +1,133 @@
+/*
+ * capture.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Capture backends behind one buffer-queue interface, modeled after OpenSL ES:
+ *    the caller enqueues empty buffers, the backend fills them and returns each one
+ *    through the callback, the caller enqueues it (or another one) again.
+ *
+ *  Audio is always mono S16 at params.sample_rate. Video frames are params.cx x params.cy
+ *  in the campixfmt of the stream (campixfmt.h) and fill the stream's video frame size.
+ *  The backend must deliver that format: nv21file is the NV21-only source, replay delivers
+ *  frames in the pixfmt of the record, which sets the stream format.
+ *
+ *  Backends:
+ *    opensles  audio   Android OpenSL ES recorder
+ *    alsa      audio   ALSA pcm device, params.device defaults to "default" (HAVE_ALSA builds)
+ *    pcmfile   audio   raw S16LE mono file looped, or 440 Hz tone if params.device is NULL
+ *    nv21file  video   NV21 only: raw NV21 frames file looped, or moving test pattern if params.device is NULL
+ *    replay    both    capture record file (caprec.h), original timing or as fast as possible,
+ *                      video in the record's pixfmt
+ */
+
+#pragma once
+
+#ifndef __capture_h__
+#define __capture_h__
+
+#include "ffmpeg.h"
+#include "pthread_wait.h"
+#include "cclist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Called on backend thread every time a buffer has been filled.
+ *  capture_time: CLOCK_MONOTONIC [us] when the buffer was completed, 0 means now
+ */
+typedef void (*capture_callback)(void * cookie, void * bfr, size_t size, int64_t capture_time);
+
+enum capture_media {
+  capture_media_audio,
+  capture_media_video
+};
+
+typedef
+struct capture_params {
+  const char * device;      /* backend specific, NULL means default */
+  int sample_rate;          /* audio [Hz] */
+  int cx, cy, fps;          /* video */
+  int nbuffers;             /* max buffers enqueued at a time */
+  bool freerun;             /* file backends: deliver as fast as the caller enqueues, no real time pacing,
+                               capture times are virtual then */
+  capture_callback callback;
+  void * cookie;
+} capture_params;
+
+typedef
+struct capture_backend {
+  const char * name;
+  enum capture_media media;
+  int (*create)(void ** dev, const capture_params * params);
+  void (*destroy)(void * dev);
+  int (*start)(void * dev);
+  int (*enqueue)(void * dev, void * bfr, size_t size);
+  int (*stop)(void * dev);
+  bool (*eof)(void * dev);  /* optional, finite sources only */
+} capture_backend;
+
+typedef struct capture_source
+  capture_source;
+
+
+/** All backends compiled in, NULL terminated */
+const capture_backend * const * capture_get_backend_list(void);
+
+/** name = NULL or "" selects the first backend for this media */
+const capture_backend * capture_find_backend(enum capture_media media, const char * name);
+
+/* Functions return 0 on success or negative AVERROR code */
+int capture_create(capture_source ** src, enum capture_media media, const char * backend_name, const capture_params * params);
+void capture_destroy(capture_source ** src);
+int capture_start(capture_source * src);
+int capture_enqueue(capture_source * src, void * bfr, size_t size);
+int capture_stop(capture_source * src);
+const char * capture_name(const capture_source * src);
+
+/* true when finite source has delivered everything */
+bool capture_is_eof(const capture_source * src);
+
+
+/*
+ * For thread driven backends: queue of enqueued buffers.
+ *  capture_bufq_pop() blocks until a buffer is available or capture_bufq_close() is called
+ */
+typedef
+struct capture_bufq {
+  ccfifo q;     /* struct capture_buffer */
+  pthread_wait_t lock;
+  bool closed;
+} capture_bufq;
+
+struct capture_buffer {
+  void * bfr;
+  size_t size;
+};
+
+int capture_bufq_init(capture_bufq * q, int capacity);
+void capture_bufq_cleanup(capture_bufq * q);
+int capture_bufq_push(capture_bufq * q, void * bfr, size_t size);
+bool capture_bufq_pop(capture_bufq * q, struct capture_buffer * b);
+void capture_bufq_open(capture_bufq * q);
+void capture_bufq_close(capture_bufq * q);
+
+
+/* backends, defined in capture-*.c */
+extern const capture_backend capture_backend_opensles;
+extern const capture_backend capture_backend_alsa;
+extern const capture_backend capture_backend_pcmfile;
+extern const capture_backend capture_backend_nv21file;
+extern const capture_backend capture_backend_replay_audio;
+extern const capture_backend capture_backend_replay_video;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __capture_h__ */
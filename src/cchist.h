@@ -0,0 +1,116 @@
+/*
+ * cchist.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Log-linear histogram of non-negative values (latencies, durations).
+ *  Single writer, any number of readers, no locks.
+ *  Each power of two range is split into 8 buckets, so percentiles are exact within 1/16.
+ */
+
+#pragma once
+
+#ifndef __cchist_h__
+#define __cchist_h__
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CCHIST_SUB_BITS   3
+#define CCHIST_SUB        (1 << CCHIST_SUB_BITS)
+#define CCHIST_BUCKETS    ((32 - CCHIST_SUB_BITS + 1) * CCHIST_SUB)
+
+typedef
+struct cchist {
+  _Atomic uint32_t n[CCHIST_BUCKETS];
+} cchist;
+
+
+static inline int cchist_bucket(uint32_t v)
+{
+  int e;
+
+  if ( v < CCHIST_SUB ) {
+    return v;
+  }
+
+  e = 31 - __builtin_clz(v);
+  return (e - CCHIST_SUB_BITS + 1) * CCHIST_SUB + ((v >> (e - CCHIST_SUB_BITS)) & (CCHIST_SUB - 1));
+}
+
+/* middle of bucket range */
+static inline uint32_t cchist_bucket_value(int b)
+{
+  int e;
+
+  if ( b < CCHIST_SUB ) {
+    return b;
+  }
+
+  e = b / CCHIST_SUB + CCHIST_SUB_BITS - 1;
+  return ((uint32_t) (CCHIST_SUB + b % CCHIST_SUB) << (e - CCHIST_SUB_BITS)) + ((1u << (e - CCHIST_SUB_BITS)) >> 1);
+}
+
+static inline void cchist_reset(cchist * h)
+{
+  for ( int i = 0; i < CCHIST_BUCKETS; ++i ) {
+    atomic_store_explicit(&h->n[i], 0, memory_order_relaxed);
+  }
+}
+
+/* writer */
+static inline void cchist_add(cchist * h, int64_t v)
+{
+  const int b = cchist_bucket(v < 0 ? 0 : v > UINT32_MAX ? UINT32_MAX : (uint32_t) v);
+  atomic_store_explicit(&h->n[b], atomic_load_explicit(&h->n[b], memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/* readers */
+static inline int64_t cchist_count(cchist * h)
+{
+  int64_t count = 0;
+  for ( int i = 0; i < CCHIST_BUCKETS; ++i ) {
+    count += atomic_load_explicit(&h->n[i], memory_order_relaxed);
+  }
+  return count;
+}
+
+/* q in [0..1], 0 if empty */
+static inline uint32_t cchist_percentile(cchist * h, double q)
+{
+  uint32_t n[CCHIST_BUCKETS];
+  int64_t count = 0, target, sum = 0;
+
+  for ( int i = 0; i < CCHIST_BUCKETS; ++i ) {
+    count += (n[i] = atomic_load_explicit(&h->n[i], memory_order_relaxed));
+  }
+
+  if ( !count ) {
+    return 0;
+  }
+
+  if ( (target = (int64_t) (q * count + 0.5)) < 1 ) {
+    target = 1;
+  }
+
+  for ( int i = 0; i < CCHIST_BUCKETS; ++i ) {
+    if ( (sum += n[i]) >= target ) {
+      return cchist_bucket_value(i);
+    }
+  }
+
+  return cchist_bucket_value(CCHIST_BUCKETS - 1);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cchist_h__ */
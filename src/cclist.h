@@ -223,6 +223,154 @@ static inline void ccheap_free(ccheap * h, void * pb)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Bounded priority queue (binary min-heap) of fixed size items keyed by int64_t.
+ *  Items with equal keys are popped in push order.
+ */
+
+typedef
+struct ccprioq {
+  void * slots;       /* capacity + 1 slots, the last one is the swap space */
+  size_t capacity;
+  size_t size;
+  size_t item_size;
+  size_t slot_size;
+  uint64_t seq;
+} ccprioq;
+
+struct ccprioq_slot_header {
+  int64_t key;
+  uint64_t seq;
+};
+
+#define ccprioq_slot(q,pos)  ((struct ccprioq_slot_header *)(((uint8_t *)(q)->slots) + (pos) * (q)->slot_size))
+#define ccprioq_item(q,pos)  ((void *)(ccprioq_slot(q,pos) + 1))
+
+
+static inline bool ccprioq_init(ccprioq * q, size_t capacity, size_t item_size)
+{
+  memset(q, 0, sizeof(*q));
+
+  q->slot_size = (sizeof(struct ccprioq_slot_header) + item_size + 7) & ~(size_t) 7;
+
+  if ( (q->slots = malloc((capacity + 1) * q->slot_size)) ) {
+    q->capacity = capacity;
+    q->item_size = item_size;
+  }
+
+  return q->slots != NULL;
+}
+
+static inline void ccprioq_cleanup(ccprioq * q)
+{
+  free(q->slots);
+  memset(q, 0, sizeof(*q));
+}
+
+static inline bool ccprioq_less(const ccprioq * q, size_t a, size_t b)
+{
+  const struct ccprioq_slot_header * sa = ccprioq_slot(q, a);
+  const struct ccprioq_slot_header * sb = ccprioq_slot(q, b);
+  return sa->key < sb->key || (sa->key == sb->key && sa->seq < sb->seq);
+}
+
+static inline void ccprioq_swap(ccprioq * q, size_t a, size_t b)
+{
+  void * tmp = ccprioq_slot(q, q->capacity);
+  memcpy(tmp, ccprioq_slot(q, a), q->slot_size);
+  memcpy(ccprioq_slot(q, a), ccprioq_slot(q, b), q->slot_size);
+  memcpy(ccprioq_slot(q, b), tmp, q->slot_size);
+}
+
+/* returns pointer to the stored item or NULL if the queue is full */
+static inline void * ccprioq_push(ccprioq * q, int64_t key, const void * pitem)
+{
+  size_t pos, parent;
+
+  if ( q->size >= q->capacity ) {
+    return NULL;
+  }
+
+  pos = q->size++;
+
+  ccprioq_slot(q, pos)->key = key;
+  ccprioq_slot(q, pos)->seq = q->seq++;
+  if ( pitem ) {
+    memcpy(ccprioq_item(q, pos), pitem, q->item_size);
+  }
+
+  while ( pos > 0 && ccprioq_less(q, pos, parent = (pos - 1) / 2) ) {
+    ccprioq_swap(q, pos, parent);
+    pos = parent;
+  }
+
+  return ccprioq_item(q, pos);
+}
+
+/* item with the smallest key, or NULL if empty */
+static inline void * ccprioq_peek(const ccprioq * q)
+{
+  return q->size ? ccprioq_item(q, 0) : NULL;
+}
+
+static inline int64_t ccprioq_peek_key(const ccprioq * q)
+{
+  return q->size ? ccprioq_slot(q, 0)->key : INT64_MAX;
+}
+
+static inline bool ccprioq_pop(ccprioq * q, void * pitem)
+{
+  size_t pos, child;
+
+  if ( !q->size ) {
+    return false;
+  }
+
+  if ( pitem ) {
+    memcpy(pitem, ccprioq_item(q, 0), q->item_size);
+  }
+
+  if ( --q->size ) {
+
+    memcpy(ccprioq_slot(q, 0), ccprioq_slot(q, q->size), q->slot_size);
+
+    for ( pos = 0; (child = 2 * pos + 1) < q->size; pos = child ) {
+      if ( child + 1 < q->size && ccprioq_less(q, child + 1, child) ) {
+        ++child;
+      }
+      if ( !ccprioq_less(q, child, pos) ) {
+        break;
+      }
+      ccprioq_swap(q, pos, child);
+    }
+  }
+
+  return true;
+}
+
+static inline size_t ccprioq_size(const ccprioq * q)
+{
+  return q->size;
+}
+
+static inline size_t ccprioq_capacity(const ccprioq * q)
+{
+  return q->capacity;
+}
+
+static inline bool ccprioq_is_full(const ccprioq * q)
+{
+  return q->size >= q->capacity;
+}
+
+static inline bool ccprioq_is_empty(const ccprioq * q)
+{
+  return q->size == 0;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -0,0 +1,201 @@
+/*
+ * ccring.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Lock-free single-producer / single-consumer ring of pointers
+ *  and a wakeup which costs nothing while the consumer is not parked.
+ */
+#pragma once
+
+#ifndef __ccring_h__
+#define __ccring_h__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <errno.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CCRING_CACHELINE  64
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef
+struct ccring {
+
+  /* consumer side */
+  _Alignas(CCRING_CACHELINE) atomic_size_t head;
+  size_t tail_cache;
+
+  /* producer side */
+  _Alignas(CCRING_CACHELINE) atomic_size_t tail;
+  size_t head_cache;
+
+  /* read only after init */
+  _Alignas(CCRING_CACHELINE) void ** items;
+  size_t mask;
+
+} ccring;
+
+
+/* Capacity is rounded up to power of two */
+static inline bool ccring_init(ccring * r, size_t capacity)
+{
+  size_t n = 1;
+
+  while ( n < capacity ) {
+    n <<= 1;
+  }
+
+  if ( (r->items = calloc(n, sizeof(void*))) ) {
+    r->mask = n - 1;
+    r->tail_cache = r->head_cache = 0;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+  }
+
+  return r->items != NULL;
+}
+
+static inline void ccring_cleanup(ccring * r)
+{
+  free(r->items);
+  r->items = NULL;
+  r->mask = 0;
+  r->tail_cache = r->head_cache = 0;
+  atomic_store(&r->head, 0);
+  atomic_store(&r->tail, 0);
+}
+
+static inline size_t ccring_capacity(const ccring * r)
+{
+  return r->items ? r->mask + 1 : 0;
+}
+
+/* Approximate when called concurrently with push or pop */
+static inline size_t ccring_size(ccring * r)
+{
+  return atomic_load_explicit(&r->tail, memory_order_acquire) - atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+/* Producer only. Returns false if ring is full */
+static inline bool ccring_push(ccring * r, void * item)
+{
+  const size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  if ( tail - r->head_cache > r->mask ) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if ( tail - r->head_cache > r->mask ) {
+      return false;
+    }
+  }
+
+  r->items[tail & r->mask] = item;
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+  return true;
+}
+
+/* Consumer only. Returns NULL if ring is empty */
+static inline void * ccring_peek(ccring * r)
+{
+  const size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  if ( head == r->tail_cache ) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if ( head == r->tail_cache ) {
+      return NULL;
+    }
+  }
+
+  return r->items[head & r->mask];
+}
+
+/* Consumer only. Returns NULL if ring is empty */
+static inline void * ccring_pop(ccring * r)
+{
+  void * item;
+
+  if ( (item = ccring_peek(r)) ) {
+    atomic_store_explicit(&r->head, atomic_load_explicit(&r->head, memory_order_relaxed) + 1, memory_order_release);
+  }
+
+  return item;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Consumer:
+ *   ccwake_prepare(); if ( nothing to do ) ccwake_wait(); else ccwake_cancel();
+ * Producer:
+ *   ccring_push(); ccwake_signal();
+ */
+typedef
+struct ccwake {
+  _Alignas(CCRING_CACHELINE) atomic_int parked;
+  sem_t sem;
+} ccwake;
+
+
+static inline int ccwake_init(ccwake * w)
+{
+  atomic_init(&w->parked, 0);
+  return sem_init(&w->sem, 0, 0) == 0 ? 0 : errno;
+}
+
+static inline void ccwake_destroy(ccwake * w)
+{
+  sem_destroy(&w->sem);
+}
+
+/* Consumer announces it is going to sleep, must re-check its rings after this */
+static inline void ccwake_prepare(ccwake * w)
+{
+  atomic_store(&w->parked, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+/* Consumer found work after ccwake_prepare() */
+static inline void ccwake_cancel(ccwake * w)
+{
+  if ( !atomic_exchange(&w->parked, 0) ) {
+    /* a producer already took the parked flag and posts the semaphore: consume it */
+    while ( sem_wait(&w->sem) != 0 && errno == EINTR ) {
+    }
+  }
+}
+
+static inline void ccwake_wait(ccwake * w)
+{
+  while ( sem_wait(&w->sem) != 0 && errno == EINTR ) {
+  }
+}
+
+/* Producer side, syscall only if the consumer is parked */
+static inline void ccwake_signal(ccwake * w)
+{
+  /* pairs with the fence in ccwake_prepare(): either we see parked or the consumer sees our push */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if ( atomic_load_explicit(&w->parked, memory_order_relaxed) && atomic_exchange(&w->parked, 0) ) {
+    sem_post(&w->sem);
+  }
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ccring_h__ */
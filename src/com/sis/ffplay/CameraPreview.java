@@ -11,6 +11,7 @@ import android.view.SurfaceHolder;
 import android.view.SurfaceView;
 import android.view.WindowManager;
 import android.hardware.Camera;
+import android.media.AudioManager;
 import android.os.Handler;
 import android.os.Message;
 import android.graphics.Color;
@@ -58,6 +59,7 @@ public class CameraPreview extends SurfaceView
   private Camera camera;
   private Camera.Parameters parameters;
   private int r, w, h, scx, scy;
+  private int pfmt = ImageFormat.NV21;
   boolean have_surface;
   private int state_;
   private EventListener eventListener;
@@ -81,6 +83,23 @@ public class CameraPreview extends SurfaceView
     public long bytesRead, bytesSent;
     public int inputBitrate, outputBitrate;
     public double inputFps, outputFps;
+    public int encodeQueueSize, encodeQueueCapacity, encodeQueueMax;
+    public int sendQueueSize, sendQueueCapacity, sendQueueMax;
+    public int rateBitrate, rateQp, rateDecision;
+    public int rateDecreases, rateIncreases;
+    public int writeLatency, interleaveDelay;
+    public int outputsCount, outputsConnected, sendDrops;
+    public int recoverTime, firstPacketTime;
+    public int clockDrift, clockCorrection;
+    public long spoolBytes;
+    public int spoolPackets, spoolDrops;
+    public int videoDropsNoBuffer, videoDropsLate, videoDropsSuperseded;
+    public int audioDropsNoBuffer;
+    public int encoderWakeups, encoderSwitches;
+    public int latencyP50, latencyP99;
+    public int sendCalls;
+    public int stalls, stallTimeouts, stallP99, stallMax;
+    public int motionScore, staticRepeats, videoDropsStatic;
   }
   
   
@@ -134,6 +153,11 @@ public class CameraPreview extends SurfaceView
   }
   
   public int startPreview(int cameraId, int cx, int cy) {
+    return startPreview(cameraId, cx, cy, ImageFormat.NV21);
+  }
+
+  /** previewFormat: ImageFormat.NV21, YV12 or YUY2, NV21 is used if the camera does not support it */
+  public int startPreview(int cameraId, int cx, int cy, int previewFormat) {
     
     int status = KERR_NONE;
     
@@ -175,6 +199,10 @@ public class CameraPreview extends SurfaceView
       //parameters.setPictureSize(cx, cy);
       parameters.setPreviewSize(cx, cy);
 
+      /* some devices deliver YV12 much faster than NV21 */
+      List<Integer> supportedFormats = parameters.getSupportedPreviewFormats();
+      pfmt = supportedFormats != null && supportedFormats.contains(previewFormat) ? previewFormat : ImageFormat.NV21;
+
       if ( !have_surface || (status = startCameraPreview()) == KERR_NONE ) {
         state_ = STATE_PREVIEW;
         emitPreviewStarted();
@@ -204,6 +232,11 @@ public class CameraPreview extends SurfaceView
   }
   
 
+  // StreamOptions.vDropPolicy values
+  public static final int DROP_DEADLINE = 0;
+  public static final int DROP_LATEST = 1;
+  public static final int DROP_NONE = 2;
+
   public static class StreamOptions {
     public String server;
     public String format;
@@ -214,11 +247,17 @@ public class CameraPreview extends SurfaceView
     public int vGopSize;
     public int vBitRate;
     public int vBufferSize;
+    public int vWidth;      // 0 = camera frame size
+    public int vHeight;
+    public int vThreads;    // frame conversion threads, 0 = all cores
+    public int vDropPolicy; // DROP_DEADLINE, DROP_LATEST, DROP_NONE
+    public int vDropDeadline; // ms, 0 = default
     
     public String aCodecName;
     public int aQuality;
     public int aBitRate;
     public int aBufferSize;
+    public int aSampleRate; // capture rate, 0 = device native rate
   }
   
   public int startStream(StreamOptions opts) {
@@ -234,6 +273,10 @@ public class CameraPreview extends SurfaceView
       return KERR_IN_USE;
     }
     
+    if (opts.aSampleRate == 0) {
+      opts.aSampleRate = getNativeSampleRate();
+    }
+
     if ((status = startNativeStream(opts)) == KERR_NONE) {
       state_ = STATE_STREAMING;  // fixme: race condition
       emitStreamStarted();
@@ -369,6 +412,16 @@ public class CameraPreview extends SurfaceView
   }
 
  
+  /** YV12 rows are 16 bytes aligned, see ImageFormat.YV12 */
+  private static int getFrameBufferSize(int format, int cx, int cy) {
+    if (format == ImageFormat.YV12) {
+      int ystride = (cx + 15) & ~15;
+      int cstride = (ystride / 2 + 15) & ~15;
+      return ystride * cy + cstride * cy;
+    }
+    return cx * cy * ImageFormat.getBitsPerPixel(format) / 8;
+  }
+
   /** allocate frame buffers and start camera preview */
   private int startCameraPreview() {
 
@@ -384,13 +437,13 @@ public class CameraPreview extends SurfaceView
       try {
         
         //parameters.setPreviewSize(w, h);
-        parameters.setPreviewFormat(ImageFormat.NV21);
+        parameters.setPreviewFormat(pfmt);
         camera.setParameters(parameters);
         camera.setDisplayOrientation(r);
         camera.setPreviewCallbackWithBuffer(this);        
 
         frameSize = parameters.getPreviewSize();
-        bufferSize = frameSize.width * frameSize.height * ImageFormat.getBitsPerPixel(parameters.getPreviewFormat()) / 8;
+        bufferSize = getFrameBufferSize(parameters.getPreviewFormat(), frameSize.width, frameSize.height);
 
         for (int i = 0; i < 2; i++) {
           camera.addCallbackBuffer(new byte[bufferSize]);
@@ -509,7 +562,9 @@ public class CameraPreview extends SurfaceView
   @Override
   public void onPreviewFrame(byte[] frame, Camera camera) {
     
-    if (state_ == STATE_STREAMING && !sendNativeVideoFrame(frame)) {
+    final long timestamp = System.nanoTime();
+    
+    if (state_ == STATE_STREAMING && !sendNativeVideoFrame(frame, timestamp)) {
       log.e(TAG, "sendNativeVideoFrame() fails");
       h_.sendMessageDelayed(h_.obtainMessage(AEVT_STOP_STREAM), 0);
     }
@@ -522,6 +577,18 @@ public class CameraPreview extends SurfaceView
  
   //////////////////////////////////////////////////////////////////////
 
+  // Capture at this rate bypasses android resampler, 0 if unknown
+  private int getNativeSampleRate() {
+    try {
+      AudioManager am = (AudioManager) getContext().getSystemService(Context.AUDIO_SERVICE);
+      String rate = am.getProperty(AudioManager.PROPERTY_OUTPUT_SAMPLE_RATE);
+      return rate != null ? Integer.parseInt(rate) : 0;
+    }
+    catch (Exception e) {
+      return 0;
+    }
+  }
+
   private native long start_stream(int cx, int cy, int pixfmt, StreamOptions opts);
   private int startNativeStream(StreamOptions opts) {
     Camera.Size s = parameters.getPreviewSize();
@@ -537,9 +604,9 @@ public class CameraPreview extends SurfaceView
     }
   }
 
-  private native boolean send_video_frame(long handle, byte[] buffer);
-  private boolean sendNativeVideoFrame(byte[] buffer) {
-    return send_video_frame(nativeStream_, buffer);
+  private native boolean send_video_frame(long handle, byte[] buffer, long timestamp);
+  private boolean sendNativeVideoFrame(byte[] buffer, long timestamp) {
+    return send_video_frame(nativeStream_, buffer, timestamp);
   }  
   
   private static native boolean get_stream_status(long handle, StreamStatus stats);
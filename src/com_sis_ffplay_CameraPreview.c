@@ -6,6 +6,7 @@
  */
 #include "ffplay-java-api.h"
 #include "sendvideo.h"
+#include "campixfmt.h"
 #include "ffmpeg.h"
 #include "debug.h"
 
@@ -58,6 +59,22 @@ static struct {
   jfieldID inputBitrate, outputBitrate;
   jfieldID framesRead, framesSent;
   jfieldID bytesRead, bytesSent;
+  jfieldID encodeQueueSize, encodeQueueCapacity, encodeQueueMax;
+  jfieldID sendQueueSize, sendQueueCapacity, sendQueueMax;
+  jfieldID rateBitrate, rateQp, rateDecision;
+  jfieldID rateDecreases, rateIncreases;
+  jfieldID writeLatency, interleaveDelay;
+  jfieldID outputsCount, outputsConnected, sendDrops;
+  jfieldID recoverTime, firstPacketTime;
+  jfieldID clockDrift, clockCorrection;
+  jfieldID spoolBytes, spoolPackets, spoolDrops;
+  jfieldID videoDropsNoBuffer, videoDropsLate, videoDropsSuperseded;
+  jfieldID audioDropsNoBuffer;
+  jfieldID encoderWakeups, encoderSwitches;
+  jfieldID latencyP50, latencyP99;
+  jfieldID sendCalls;
+  jfieldID stalls, stallTimeouts, stallP99, stallMax;
+  jfieldID motionScore, staticRepeats, videoDropsStatic;
 } StreamStatus;
 
 
@@ -77,6 +94,45 @@ static bool StreamStatusClass_init(JNIEnv * env) {
     { "framesSent",  "J", &StreamStatus.framesSent},
     { "bytesRead",  "J", &StreamStatus.bytesRead},
     { "bytesSent",  "J", &StreamStatus.bytesSent},
+    { "encodeQueueSize",  "I", &StreamStatus.encodeQueueSize},
+    { "encodeQueueCapacity",  "I", &StreamStatus.encodeQueueCapacity},
+    { "encodeQueueMax",  "I", &StreamStatus.encodeQueueMax},
+    { "sendQueueSize",  "I", &StreamStatus.sendQueueSize},
+    { "sendQueueCapacity",  "I", &StreamStatus.sendQueueCapacity},
+    { "sendQueueMax",  "I", &StreamStatus.sendQueueMax},
+    { "rateBitrate",  "I", &StreamStatus.rateBitrate},
+    { "rateQp",  "I", &StreamStatus.rateQp},
+    { "rateDecision",  "I", &StreamStatus.rateDecision},
+    { "rateDecreases",  "I", &StreamStatus.rateDecreases},
+    { "rateIncreases",  "I", &StreamStatus.rateIncreases},
+    { "writeLatency",  "I", &StreamStatus.writeLatency},
+    { "interleaveDelay",  "I", &StreamStatus.interleaveDelay},
+    { "outputsCount",  "I", &StreamStatus.outputsCount},
+    { "outputsConnected",  "I", &StreamStatus.outputsConnected},
+    { "sendDrops",  "I", &StreamStatus.sendDrops},
+    { "recoverTime",  "I", &StreamStatus.recoverTime},
+    { "firstPacketTime",  "I", &StreamStatus.firstPacketTime},
+    { "clockDrift",  "I", &StreamStatus.clockDrift},
+    { "clockCorrection",  "I", &StreamStatus.clockCorrection},
+    { "spoolBytes",  "J", &StreamStatus.spoolBytes},
+    { "spoolPackets",  "I", &StreamStatus.spoolPackets},
+    { "spoolDrops",  "I", &StreamStatus.spoolDrops},
+    { "videoDropsNoBuffer",  "I", &StreamStatus.videoDropsNoBuffer},
+    { "videoDropsLate",  "I", &StreamStatus.videoDropsLate},
+    { "videoDropsSuperseded",  "I", &StreamStatus.videoDropsSuperseded},
+    { "audioDropsNoBuffer",  "I", &StreamStatus.audioDropsNoBuffer},
+    { "encoderWakeups",  "I", &StreamStatus.encoderWakeups},
+    { "encoderSwitches",  "I", &StreamStatus.encoderSwitches},
+    { "latencyP50",  "I", &StreamStatus.latencyP50},
+    { "latencyP99",  "I", &StreamStatus.latencyP99},
+    { "sendCalls",  "I", &StreamStatus.sendCalls},
+    { "stalls",  "I", &StreamStatus.stalls},
+    { "stallTimeouts",  "I", &StreamStatus.stallTimeouts},
+    { "stallP99",  "I", &StreamStatus.stallP99},
+    { "stallMax",  "I", &StreamStatus.stallMax},
+    { "motionScore",  "I", &StreamStatus.motionScore},
+    { "staticRepeats",  "I", &StreamStatus.staticRepeats},
+    { "videoDropsStatic",  "I", &StreamStatus.videoDropsStatic},
   };
 
 
@@ -118,6 +174,45 @@ static void StreamStatus_set(JNIEnv * env, jobject obj, ff_output_stream_state s
 
   SET_STREAM_STATUS_INT_FIELD(inputBitrate);
   SET_STREAM_STATUS_INT_FIELD(outputBitrate);
+  SET_STREAM_STATUS_INT_FIELD(encodeQueueSize);
+  SET_STREAM_STATUS_INT_FIELD(encodeQueueCapacity);
+  SET_STREAM_STATUS_INT_FIELD(encodeQueueMax);
+  SET_STREAM_STATUS_INT_FIELD(sendQueueSize);
+  SET_STREAM_STATUS_INT_FIELD(sendQueueCapacity);
+  SET_STREAM_STATUS_INT_FIELD(sendQueueMax);
+  SET_STREAM_STATUS_INT_FIELD(rateBitrate);
+  SET_STREAM_STATUS_INT_FIELD(rateQp);
+  SET_STREAM_STATUS_INT_FIELD(rateDecision);
+  SET_STREAM_STATUS_INT_FIELD(rateDecreases);
+  SET_STREAM_STATUS_INT_FIELD(rateIncreases);
+  SET_STREAM_STATUS_INT_FIELD(writeLatency);
+  SET_STREAM_STATUS_INT_FIELD(interleaveDelay);
+  SET_STREAM_STATUS_INT_FIELD(outputsCount);
+  SET_STREAM_STATUS_INT_FIELD(outputsConnected);
+  SET_STREAM_STATUS_INT_FIELD(sendDrops);
+  SET_STREAM_STATUS_INT_FIELD(recoverTime);
+  SET_STREAM_STATUS_INT_FIELD(firstPacketTime);
+  SET_STREAM_STATUS_INT_FIELD(clockDrift);
+  SET_STREAM_STATUS_INT_FIELD(clockCorrection);
+  SET_STREAM_STATUS_LONG_FIELD(spoolBytes);
+  SET_STREAM_STATUS_INT_FIELD(spoolPackets);
+  SET_STREAM_STATUS_INT_FIELD(spoolDrops);
+  SET_STREAM_STATUS_INT_FIELD(videoDropsNoBuffer);
+  SET_STREAM_STATUS_INT_FIELD(videoDropsLate);
+  SET_STREAM_STATUS_INT_FIELD(videoDropsSuperseded);
+  SET_STREAM_STATUS_INT_FIELD(audioDropsNoBuffer);
+  SET_STREAM_STATUS_INT_FIELD(encoderWakeups);
+  SET_STREAM_STATUS_INT_FIELD(encoderSwitches);
+  SET_STREAM_STATUS_INT_FIELD(latencyP50);
+  SET_STREAM_STATUS_INT_FIELD(latencyP99);
+  SET_STREAM_STATUS_INT_FIELD(sendCalls);
+  SET_STREAM_STATUS_INT_FIELD(stalls);
+  SET_STREAM_STATUS_INT_FIELD(stallTimeouts);
+  SET_STREAM_STATUS_INT_FIELD(stallP99);
+  SET_STREAM_STATUS_INT_FIELD(stallMax);
+  SET_STREAM_STATUS_INT_FIELD(motionScore);
+  SET_STREAM_STATUS_INT_FIELD(staticRepeats);
+  SET_STREAM_STATUS_INT_FIELD(videoDropsStatic);
 
   SET_STREAM_STATUS_LONG_FIELD(framesRead);
   SET_STREAM_STATUS_LONG_FIELD(framesSent);
@@ -203,11 +298,17 @@ static struct {
   jfieldID vGopSize;
   jfieldID vBitRate;
   jfieldID vBufferSize;
+  jfieldID vWidth;
+  jfieldID vHeight;
+  jfieldID vThreads;
+  jfieldID vDropPolicy;
+  jfieldID vDropDeadline;
 
   jfieldID aCodecName;
   jfieldID aQuality;
   jfieldID aBitRate;
   jfieldID aBufferSize;
+  jfieldID aSampleRate;
 
 } StreamOpts;
 
@@ -227,11 +328,17 @@ static bool StreamOptsClass_init(JNIEnv * env)
     { "vGopSize", "I",  &StreamOpts.vGopSize},
     { "vBitRate", "I",  &StreamOpts.vBitRate},
     { "vBufferSize", "I",  &StreamOpts.vBufferSize},
+    { "vWidth", "I",  &StreamOpts.vWidth},
+    { "vHeight", "I",  &StreamOpts.vHeight},
+    { "vThreads", "I",  &StreamOpts.vThreads},
+    { "vDropPolicy", "I",  &StreamOpts.vDropPolicy},
+    { "vDropDeadline", "I",  &StreamOpts.vDropDeadline},
 
     { "aCodecName", "Ljava/lang/String;",  &StreamOpts.aCodecName},
     { "aQuality", "I",  &StreamOpts.aQuality},
     { "aBitRate", "I",  &StreamOpts.aBitRate},
     { "aBufferSize", "I",  &StreamOpts.aBufferSize},
+    { "aSampleRate", "I",  &StreamOpts.aSampleRate},
   };
 
   if ( !StreamOpts.class_ ) {
@@ -275,6 +382,7 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
 {
   ff_output_stream * ctx = NULL;
   struct CameraPreview * cookie = NULL;
+  const campixfmt * camfmt = NULL;
 
   jstring server = NULL;
   const char * cserver = NULL;
@@ -295,9 +403,15 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
   int vGopSize = -1;
   int vBitRate = 0;
   int vBufferSize = 0;
+  int vWidth = 0;
+  int vHeight = 0;
+  int vThreads = 0;
+  int vDropPolicy = 0;
+  int vDropDeadline = 0;
   int aQuality = -1;
   int aBitRate = 0;
   int aBufferSize = 0;
+  int aSampleRate = 0;
 
   static const ff_output_stream_event_callback events_callback = {
     .stream_state_changed = on_stream_state_changed,
@@ -321,6 +435,11 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
 
   PDBG("cx=%d cy=%d pixfmt=%d server='%s' opts='%s'", cx, cy, pixfmt, cserver, cffopts);
 
+  if ( !(camfmt = campixfmt_from_android(pixfmt)) ) {
+    PDBG("Unsupported camera pixel format 0x%X", pixfmt);
+    goto end;
+  }
+
 
   vQuality = GetIntField(env, opts, StreamOpts.vQuality);
   vBitRate = GetIntField(env, opts, StreamOpts.vBitRate);
@@ -328,7 +447,13 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
   aQuality = GetIntField(env, opts, StreamOpts.aQuality);
   aBitRate = GetIntField(env, opts, StreamOpts.aBitRate);
   aBufferSize = GetIntField(env, opts, StreamOpts.aBufferSize);
+  aSampleRate = GetIntField(env, opts, StreamOpts.aSampleRate);
   vGopSize = GetIntField(env, opts, StreamOpts.vGopSize);
+  vWidth = GetIntField(env, opts, StreamOpts.vWidth);
+  vHeight = GetIntField(env, opts, StreamOpts.vHeight);
+  vThreads = GetIntField(env, opts, StreamOpts.vThreads);
+  vDropPolicy = GetIntField(env, opts, StreamOpts.vDropPolicy);
+  vDropDeadline = GetIntField(env, opts, StreamOpts.vDropDeadline);
 
   cookie = CameraPreview_init(env, obj);
 
@@ -347,7 +472,7 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
 
         .cx = cx,
         .cy = cy,
-        .pxfmt = AV_PIX_FMT_NV21,    // fixme: map actual camera format to ffmpeg!
+        .pxfmt = camfmt->id,
 
         .cvquality = vQuality,
         .caquality = aQuality,
@@ -357,8 +482,16 @@ JNIEXPORT jlong JNICALL Java_com_sis_ffplay_CameraPreview_start_1stream(JNIEnv *
 
         .cvbufs = vBufferSize,
         .cabufs = aBufferSize,
+        .casamplerate = aSampleRate,
 
         .gopsize = vGopSize,
+
+        .ocx = vWidth,
+        .ocy = vHeight,
+        .threads = vThreads,
+
+        .drop_policy = vDropPolicy,
+        .drop_deadline = vDropDeadline,
       });
 
 
@@ -401,10 +534,10 @@ JNIEXPORT void JNICALL Java_com_sis_ffplay_CameraPreview_stop_1stream(JNIEnv * e
 /*
  * Class:     com_sis_ffplay_CameraPreview
  * Method:    send_video_frame
- * Signature: (J[B)Z
+ * Signature: (J[BJ)Z
  */
 JNIEXPORT jboolean JNICALL Java_com_sis_ffplay_CameraPreview_send_1video_1frame(JNIEnv * env, jobject obj, jlong handle,
-    jbyteArray frame)
+    jbyteArray frame, jlong timestamp)
 {
   (void)(obj);
 
@@ -417,7 +550,15 @@ JNIEXPORT jboolean JNICALL Java_com_sis_ffplay_CameraPreview_send_1video_1frame(
   }
   else if ( (frm = pop_video_frame(ctx)) ) {
     (*env)->GetByteArrayRegion(env, frame, 0, get_video_frame_data_size(ctx), (jbyte*)frm->data);
-    push_video_frame(ctx, frm);
+    if ( (*env)->ExceptionCheck(env) ) {
+      /* array is shorter than the frame, ArrayIndexOutOfBoundsException is pending */
+      release_video_frame(ctx, frm);
+      status = JNI_FALSE;
+    }
+    else {
+      /* System.nanoTime() is CLOCK_MONOTONIC */
+      push_video_frame(ctx, frm, timestamp / 1000);
+    }
   }
 
   return status;
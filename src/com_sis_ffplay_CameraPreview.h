@@ -148,10 +148,10 @@ JNIEXPORT void JNICALL Java_com_sis_ffplay_CameraPreview_stop_1stream
 /*
  * Class:     com_sis_ffplay_CameraPreview
  * Method:    send_video_frame
- * Signature: (J[B)Z
+ * Signature: (J[BJ)Z
  */
 JNIEXPORT jboolean JNICALL Java_com_sis_ffplay_CameraPreview_send_1video_1frame
-  (JNIEnv *, jobject, jlong, jbyteArray);
+  (JNIEnv *, jobject, jlong, jbyteArray, jlong);
 
 /*
  * Class:     com_sis_ffplay_CameraPreview
@@ -13,7 +13,9 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/syscall.h>   /* For SYS_xxx definitions */
+#ifdef __ANDROID__
 # include <android/log.h>
+#endif
 
 #define UNUSED(x)  (void)(x)
 
@@ -44,13 +46,17 @@ static void do_log(int pri, const char * file, const char * function, int line,
   char msg[8 * 1024];
   int n;
 
-  n = snprintf(msg, sizeof(msg) - 1, "[%6d] %.2d:%.2d:%.2d.%.3d %-24s %4d : ", gettid(), hour, min, sec, msec, function, line);
+  n = snprintf(msg, sizeof(msg) - 1, "[%6d] %.2d:%.2d:%.2d.%.3d %-24s %4d : ", (int) syscall(SYS_gettid), hour, min, sec, msec, function, line);
   if ( n > 0 && n < (int) (sizeof(msg) - 1) ) {
     n += vsnprintf(msg + n, sizeof(msg) - n - 1, format, arglist);
   }
   msg[n > 0 ? n : 0] = 0;
 
+#ifdef __ANDROID__
   __android_log_write(ANDROID_LOG_DEBUG, TAG, msg);
+#else
+  fprintf(stderr, "%s: %s\n", TAG, msg);
+#endif
 }
 
 
@@ -0,0 +1,448 @@
+/*
+ * ffio.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ffio.h"
+#include "debug.h"
+
+#define FFIO_TCP_BUFFER_SIZE    (64 * 1024)
+#define FFIO_UDP_PACKET_SIZE    1316    /* 7 TS packets, as ffmpeg udp default */
+#define FFIO_UDP_BATCH          32
+#define FFIO_POLL_TIMEOUT       100     /* [ms] interrupt callback check period */
+
+
+/* android-15 headers have no sendmmsg(), the kernel has it since 3.0 */
+struct ffio_mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+
+typedef
+struct ffio {
+  int fd;
+  bool udp;
+  ffio_params p;
+  AVIOInterruptCB icb;
+  int64_t tpending;             /* [us] when data to flush has been seen first, 0 if none */
+
+  /* udp: datagrams waiting for sendmmsg() */
+  uint8_t * dgrams;
+  int dgram_size;
+  struct iovec * iov;
+  struct ffio_mmsghdr * msgs;
+  int ndgrams;
+
+  struct ffio_stats stats;
+} ffio;
+
+
+static bool is_interrupted(ffio * io)
+{
+  return io->icb.callback && io->icb.callback(io->icb.opaque);
+}
+
+/* wait until the socket is ready for events or interrupted */
+static int wait_fd(ffio * io, int events)
+{
+  struct pollfd pfd = { .fd = io->fd, .events = events };
+  int n;
+
+  while ( 42 ) {
+
+    if ( is_interrupted(io) ) {
+      return AVERROR_EXIT;
+    }
+
+    ++io->stats.syscalls;
+
+    if ( (n = poll(&pfd, 1, FFIO_POLL_TIMEOUT)) > 0 ) {
+      return 0;
+    }
+
+    if ( n < 0 && errno != EINTR ) {
+      return AVERROR(errno);
+    }
+  }
+}
+
+
+static int tcp_write(void * opaque, uint8_t * buf, int size)
+{
+  ffio * io = opaque;
+  ssize_t k;
+  int n, status;
+
+  for ( n = 0; n < size; ) {
+
+    ++io->stats.syscalls;
+
+    if ( (k = send(io->fd, buf + n, size - n, MSG_NOSIGNAL | MSG_DONTWAIT)) > 0 ) {
+      n += k;
+    }
+    else if ( k < 0 && errno == EINTR ) {
+      continue;
+    }
+    else if ( k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+      /* socket buffer is full, only now it's worth to poll */
+      if ( (status = wait_fd(io, POLLOUT)) ) {
+        return status;
+      }
+    }
+    else {
+      return k < 0 ? AVERROR(errno) : AVERROR(EIO);
+    }
+  }
+
+  io->stats.bytes += size;
+
+  return size;
+}
+
+
+static int udp_send_batch(ffio * io)
+{
+  int i = 0, k, status = 0;
+
+  while ( i < io->ndgrams ) {
+
+    ++io->stats.syscalls;
+
+#ifdef __NR_sendmmsg
+    k = syscall(__NR_sendmmsg, io->fd, io->msgs + i, io->ndgrams - i, MSG_DONTWAIT);
+#else
+    k = sendmsg(io->fd, &io->msgs[i].msg_hdr, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+
+    if ( k > 0 ) {
+      i += k;
+    }
+    else if ( k == 0 || errno == EINTR || errno == ECONNREFUSED ) {
+      /* ECONNREFUSED: icmp from earlier datagram, no receiver there yet. The error is cleared, retry */
+      continue;
+    }
+    else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+      if ( (status = wait_fd(io, POLLOUT)) ) {
+        break;
+      }
+    }
+    else {
+      status = AVERROR(errno);
+      break;
+    }
+  }
+
+  io->ndgrams = 0;
+
+  return status;
+}
+
+/* avio buffer is not larger than datagram, each call is one datagram */
+static int udp_write(void * opaque, uint8_t * buf, int size)
+{
+  ffio * io = opaque;
+  int status;
+
+  if ( size > io->dgram_size ) {
+    return AVERROR(EMSGSIZE);
+  }
+
+  memcpy(io->iov[io->ndgrams].iov_base, buf, size);
+  io->iov[io->ndgrams++].iov_len = size;
+
+  if ( io->ndgrams == io->p.udp_batch && (status = udp_send_batch(io)) ) {
+    return status;
+  }
+
+  io->stats.bytes += size;
+
+  return size;
+}
+
+
+/* Url options are handled by ffmpeg protocols, here only udp pkt_size is known */
+static bool check_url_options(const char * query, bool udp)
+{
+  char * opts, * opt, * saveptr = NULL;
+  bool fok = true;
+
+  if ( !query || !*query ) {
+    return true;
+  }
+
+  if ( !(opts = av_strdup(query)) ) {
+    return false;
+  }
+
+  for ( opt = av_strtok(opts, "&", &saveptr); opt && fok; opt = av_strtok(NULL, "&", &saveptr) ) {
+    fok = udp && strncmp(opt, "pkt_size=", 9) == 0;
+  }
+
+  av_free(opts);
+
+  return fok;
+}
+
+
+static int connect_socket(ffio * io, const struct addrinfo * ai)
+{
+  int one = 1, err = 0;
+  socklen_t errlen = sizeof(err);
+  int status;
+
+  if ( (io->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0 ) {
+    return AVERROR(errno);
+  }
+
+  fcntl(io->fd, F_SETFD, FD_CLOEXEC);
+  fcntl(io->fd, F_SETFL, fcntl(io->fd, F_GETFL) | O_NONBLOCK);
+
+  if ( io->p.sndbuf > 0 && setsockopt(io->fd, SOL_SOCKET, SO_SNDBUF, &io->p.sndbuf, sizeof(io->p.sndbuf)) ) {
+    PERROR("setsockopt(SO_SNDBUF=%d) fails: %s", io->p.sndbuf, strerror(errno));
+  }
+
+  if ( !io->udp && io->p.nodelay && setsockopt(io->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ) {
+    PERROR("setsockopt(TCP_NODELAY) fails: %s", strerror(errno));
+  }
+
+  if ( connect(io->fd, ai->ai_addr, ai->ai_addrlen) == 0 ) {
+    return 0;
+  }
+
+  if ( errno != EINPROGRESS ) {
+    return AVERROR(errno);
+  }
+
+  if ( (status = wait_fd(io, POLLOUT)) ) {
+    return status;
+  }
+
+  if ( getsockopt(io->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) ) {
+    return AVERROR(errno);
+  }
+
+  return err ? AVERROR(err) : 0;
+}
+
+
+int ffio_open(AVIOContext ** pb, const char * url, const ffio_params * params, const AVIOInterruptCB * icb)
+{
+  char proto[16], host[256], path[1024], port[16], opt[32];
+  struct addrinfo hints, * ai = NULL, * cur;
+  const char * query;
+  uint8_t * buffer = NULL;
+  ffio * io = NULL;
+  int portno, buffer_size;
+  bool udp;
+
+  int status;
+
+  *pb = NULL;
+
+  av_url_split(proto, sizeof(proto), NULL, 0, host, sizeof(host), &portno, path, sizeof(path), url);
+
+  if ( (!(udp = strcmp(proto, "udp") == 0) && strcmp(proto, "tcp") != 0) || !*host || portno <= 0 ) {
+    return AVERROR(ENOPROTOOPT);
+  }
+
+  if ( !check_url_options((query = strchr(path, '?')) ? query + 1 : NULL, udp) ) {
+    return AVERROR(ENOPROTOOPT);
+  }
+
+  if ( !(io = av_mallocz(sizeof(*io))) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  io->fd = -1;
+  io->udp = udp;
+  io->icb = *icb;
+
+  if ( params ) {
+    io->p = *params;
+  }
+
+  if ( io->p.buffer_size <= 0 ) {
+    io->p.buffer_size = FFIO_TCP_BUFFER_SIZE;
+  }
+  if ( io->p.nodelay < 0 ) {
+    io->p.nodelay = 1;
+  }
+  if ( io->p.udp_batch <= 0 ) {
+    io->p.udp_batch = FFIO_UDP_BATCH;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+  snprintf(port, sizeof(port), "%d", portno);
+
+  if ( (status = getaddrinfo(host, port, &hints, &ai)) ) {
+    PERROR("getaddrinfo('%s') fails: %s", host, gai_strerror(status));
+    status = AVERROR(EIO);
+    goto end;
+  }
+
+  for ( cur = ai, status = AVERROR(EIO); cur; cur = cur->ai_next ) {
+    if ( (status = connect_socket(io, cur)) == 0 || status == AVERROR_EXIT ) {
+      break;
+    }
+    close(io->fd), io->fd = -1;
+  }
+
+  if ( status ) {
+    PERROR("connect('%s') fails: %s", url, av_err2str(status));
+    goto end;
+  }
+
+  if ( !udp ) {
+    buffer_size = io->p.buffer_size;
+  }
+  else {
+
+    io->dgram_size = FFIO_UDP_PACKET_SIZE;
+    if ( query && av_find_info_tag(opt, sizeof(opt), "pkt_size", query + 1) && atoi(opt) > 0 ) {
+      io->dgram_size = atoi(opt);
+    }
+
+    io->dgrams = av_malloc_array(io->p.udp_batch, io->dgram_size);
+    io->iov = av_mallocz_array(io->p.udp_batch, sizeof(*io->iov));
+    io->msgs = av_mallocz_array(io->p.udp_batch, sizeof(*io->msgs));
+
+    if ( !io->dgrams || !io->iov || !io->msgs ) {
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+
+    for ( int i = 0; i < io->p.udp_batch; ++i ) {
+      io->iov[i].iov_base = io->dgrams + i * io->dgram_size;
+      io->msgs[i].msg_hdr.msg_iov = &io->iov[i];
+      io->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    buffer_size = io->dgram_size;
+  }
+
+  if ( !(buffer = av_malloc(buffer_size)) ) {
+    status = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  if ( !(*pb = avio_alloc_context(buffer, buffer_size, 1, io, NULL, udp ? udp_write : tcp_write, NULL)) ) {
+    status = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  (*pb)->seekable = 0;
+  if ( udp ) {
+    (*pb)->max_packet_size = io->dgram_size;
+  }
+
+  PDBG("'%s': buffer=%d flush_interval=%d ms sndbuf=%d nodelay=%d", url, buffer_size, io->p.flush_interval,
+      io->p.sndbuf, io->p.nodelay);
+
+end:
+
+  if ( ai ) {
+    freeaddrinfo(ai);
+  }
+
+  if ( status ) {
+    if ( io->fd >= 0 ) {
+      close(io->fd);
+    }
+    av_free(io->dgrams);
+    av_free(io->iov);
+    av_free(io->msgs);
+    av_free(io);
+    av_free(buffer);
+  }
+
+  return status;
+}
+
+void ffio_close(AVIOContext ** pb)
+{
+  ffio * io;
+
+  if ( pb && *pb ) {
+
+    io = (*pb)->opaque;
+
+    if ( io->udp && io->ndgrams && !(*pb)->error && !is_interrupted(io) ) {
+      udp_send_batch(io);
+    }
+
+    close(io->fd);
+    av_free(io->dgrams);
+    av_free(io->iov);
+    av_free(io->msgs);
+    av_free(io);
+
+    av_freep(&(*pb)->buffer);
+    av_freep(pb);
+  }
+}
+
+int ffio_flush(AVIOContext * pb)
+{
+  ffio * io = pb->opaque;
+  int status = 0;
+
+  avio_flush(pb);
+
+  if ( pb->error < 0 ) {
+    status = pb->error;
+  }
+  else if ( io->udp && io->ndgrams ) {
+    status = udp_send_batch(io);
+  }
+
+  io->tpending = 0;
+
+  return status;
+}
+
+int ffio_poll_flush(AVIOContext * pb, int * tmo)
+{
+  ffio * io = pb->opaque;
+  int64_t t, due;
+
+  *tmo = -1;
+
+  if ( pb->buf_ptr == pb->buffer && !io->ndgrams ) {
+    io->tpending = 0;
+    return 0;
+  }
+
+  if ( io->p.flush_interval <= 0 ) {
+    return ffio_flush(pb);
+  }
+
+  t = ffmpeg_gettime_us();
+
+  if ( !io->tpending ) {
+    io->tpending = t;
+  }
+
+  if ( (due = io->tpending + io->p.flush_interval * 1000LL) <= t ) {
+    return ffio_flush(pb);
+  }
+
+  *tmo = (int) ((due - t + 999) / 1000);
+
+  return 0;
+}
+
+void ffio_get_stats(AVIOContext * pb, struct ffio_stats * stats)
+{
+  *stats = ((ffio *) pb->opaque)->stats;
+}
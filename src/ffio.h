@@ -0,0 +1,68 @@
+/*
+ * ffio.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Own socket writer for tcp:// and udp:// outputs as custom AVIOContext.
+ *
+ *  The muxer writes into large avio buffer which is not flushed per packet:
+ *  data goes to the socket when the buffer is full or has waited flush_interval.
+ *  TCP writes are non-blocking send() without poll() in front of each one,
+ *  UDP datagrams are collected and sent by sendmmsg() in batches.
+ */
+
+#pragma once
+
+#ifndef __ffio_h__
+#define __ffio_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct ffio_params {
+  int buffer_size;        /* [bytes] tcp avio buffer, 0 = 64 KiB */
+  int flush_interval;     /* [ms] max time written data may wait in buffers, 0 = flush every packet */
+  int sndbuf;             /* SO_SNDBUF [bytes], 0 = system default */
+  int nodelay;            /* TCP_NODELAY: 1 on, 0 off, -1 default (on) */
+  int udp_batch;          /* datagrams per sendmmsg(), 0 = 32 */
+} ffio_params;
+
+
+struct ffio_stats {
+  int64_t bytes;
+  int64_t syscalls;       /* send(), sendmmsg() and poll() calls */
+};
+
+
+/**
+ * Connect tcp:// or udp:// url, returns AVERROR(ENOPROTOOPT) for other protocols
+ *  and for url options which only ffmpeg handles, open such ones by avio_open2().
+ *  icb is checked while waiting for the socket.
+ */
+int ffio_open(AVIOContext ** pb, const char * url, const ffio_params * params, const AVIOInterruptCB * icb);
+
+void ffio_close(AVIOContext ** pb);
+
+/**
+ * Call after each muxer write: flushes buffered data which has waited flush_interval.
+ *  *tmo is set to time until the next flush is due [ms], -1 if nothing is buffered.
+ */
+int ffio_poll_flush(AVIOContext * pb, int * tmo);
+
+/* write out everything buffered */
+int ffio_flush(AVIOContext * pb);
+
+void ffio_get_stats(AVIOContext * pb, struct ffio_stats * stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ffio_h__ */
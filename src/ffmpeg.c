@@ -434,6 +434,112 @@ int ffmpeg_create_video_frame(AVFrame ** out, enum AVPixelFormat fmt, int cx, in
 }
 
 
+int ffmpeg_video_frame_pool_init(ffmpeg_video_frame_pool * pool, enum AVPixelFormat fmt, int cx, int cy, int align)
+{
+  const AVPixFmtDescriptor * desc;
+  int h, status;
+
+  memset(pool, 0, sizeof(*pool));
+
+  if ( !(desc = av_pix_fmt_desc_get(fmt)) || cx < 1 || cy < 1 || align < 1 ) {
+    status = AVERROR(EINVAL);
+    goto end;
+  }
+
+  if ( (status = av_image_fill_linesizes(pool->linesize, fmt, FFALIGN(cx, align))) < 0 ) {
+    goto end;
+  }
+
+  for ( int i = 0; i < 4 && pool->linesize[i]; ++i ) {
+
+    pool->linesize[i] = FFALIGN(pool->linesize[i], align);
+    h = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(cy, desc->log2_chroma_h) : cy;
+
+    /* extra align bytes let planes start aligned whatever av_malloc() alignment is */
+    if ( !(pool->pools[i] = av_buffer_pool_init(pool->linesize[i] * h + align, av_buffer_alloc)) ) {
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+  }
+
+  pool->fmt = fmt;
+  pool->cx = cx;
+  pool->cy = cy;
+  pool->align = align;
+  status = 0;
+
+end:
+
+  if ( status ) {
+    ffmpeg_video_frame_pool_cleanup(pool);
+  }
+
+  return status;
+}
+
+
+void ffmpeg_video_frame_pool_cleanup(ffmpeg_video_frame_pool * pool)
+{
+  /* buffers still referenced by frames are freed when released */
+  for ( int i = 0; i < 4; ++i ) {
+    av_buffer_pool_uninit(&pool->pools[i]);
+  }
+}
+
+
+int ffmpeg_video_frame_pool_get(ffmpeg_video_frame_pool * pool, AVFrame * frame)
+{
+  AVBufferRef * bufs[4] = { NULL };
+  int i;
+
+  for ( i = 0; i < 4 && pool->pools[i]; ++i ) {
+    if ( !(bufs[i] = av_buffer_pool_get(pool->pools[i])) ) {
+      while ( i > 0 ) {
+        av_buffer_unref(&bufs[--i]);
+      }
+      return AVERROR(ENOMEM);
+    }
+  }
+
+  for ( i = 0; i < AV_NUM_DATA_POINTERS; ++i ) {
+    av_buffer_unref(&frame->buf[i]);
+    frame->data[i] = NULL;
+    frame->linesize[i] = 0;
+  }
+
+  for ( i = 0; i < 4 && bufs[i]; ++i ) {
+    frame->buf[i] = bufs[i];
+    frame->data[i] = (uint8_t *) FFALIGN((uintptr_t) bufs[i]->data, pool->align);
+    frame->linesize[i] = pool->linesize[i];
+  }
+
+  frame->extended_data = frame->data;
+  frame->format = pool->fmt;
+  frame->width = pool->cx;
+  frame->height = pool->cy;
+
+  return 0;
+}
+
+
+int ffmpeg_create_pooled_video_frame(AVFrame ** out, ffmpeg_video_frame_pool * pool)
+{
+  AVFrame * frame;
+  int status;
+
+  if ( !(frame = av_frame_alloc()) ) {
+    status = AVERROR(ENOMEM);
+  }
+  else if ( (status = ffmpeg_video_frame_pool_get(pool, frame)) ) {
+    av_frame_free(&frame);
+  }
+
+  *out = frame;
+
+  return status;
+}
+
+
 int ffmpeg_create_audio_frame(AVFrame ** out, enum AVSampleFormat fmt, int sample_rate, int nb_samples, int channels,
     uint64_t channel_layout)
 {
@@ -508,6 +614,45 @@ int ffmpeg_select_best_format(const int fmts[], int default_fmt)
 }
 
 
+bool ffmpeg_is_ioerror(int status)
+{
+  switch ( status ) {
+    case AVERROR(EIO) :
+      case AVERROR_STALLED :
+      case AVERROR(EREMOTEIO) :
+      case AVERROR(ETIMEDOUT) :
+      case AVERROR(EPIPE) :
+      case AVERROR(ENETDOWN) :
+      case AVERROR(ENETUNREACH) :
+      case AVERROR(ENETRESET) :
+      case AVERROR(ECONNREFUSED) :
+      case AVERROR(ECONNRESET) :
+      case AVERROR(ECONNABORTED) :
+      // case AVERROR(EHOSTUNREACH):
+      return true;
+  }
+  return false;
+}
+
+
+int ffmpeg_backoff_delay(int attempt, int base_ms, int max_ms)
+{
+  int64_t delay;
+
+  if ( attempt < 1 ) {
+    return 0;
+  }
+
+  delay = (int64_t) base_ms << FFMIN(attempt - 1, 20);
+  if ( delay > max_ms ) {
+    delay = max_ms;
+  }
+
+  /* jitter keeps many clients from hammering the server in sync */
+  return (int) (delay / 2 + av_get_random_seed() % (delay / 2 + 1));
+}
+
+
 bool ffmpeg_is_format_supported(const int fmts[], int fmt)
 {
   if ( !fmts ) {
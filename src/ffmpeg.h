@@ -31,6 +31,9 @@
 #include <libavdevice/avdevice.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/eval.h>
+#include <libavutil/parseutils.h>
+#include <libavutil/avstring.h>
+#include <libavutil/random_seed.h>
 
 
 #ifdef __cplusplus
@@ -114,6 +117,34 @@ int ffmpeg_create_video_frame(AVFrame ** out,
     int cx, int cy,
     int aling);
 
+/**
+ * Plane buffers of fixed size video frames from AVBufferPool.
+ *  Encoders may keep references to input frames, a frame still referenced
+ *  gets fresh pool planes instead of being overwritten or reallocated.
+ */
+typedef
+struct ffmpeg_video_frame_pool {
+  AVBufferPool * pools[4];
+  int linesize[4];
+  enum AVPixelFormat fmt;
+  int cx, cy;
+  int align;
+} ffmpeg_video_frame_pool;
+
+int ffmpeg_video_frame_pool_init(ffmpeg_video_frame_pool * pool,
+    enum AVPixelFormat fmt,
+    int cx, int cy,
+    int align);
+
+void ffmpeg_video_frame_pool_cleanup(ffmpeg_video_frame_pool * pool);
+
+/* Replace frame planes with pool buffers, picture content is undefined */
+int ffmpeg_video_frame_pool_get(ffmpeg_video_frame_pool * pool,
+    AVFrame * frame);
+
+int ffmpeg_create_pooled_video_frame(AVFrame ** out,
+    ffmpeg_video_frame_pool * pool);
+
 int ffmpeg_create_audio_frame(AVFrame ** out,
     enum AVSampleFormat fmt,
     int sample_rate,
@@ -126,6 +157,19 @@ int ffmpeg_copy_frame(AVFrame * dst,
 
 
 
+/** Output operation aborted on exceeded time budget, the link is considered dead */
+#define AVERROR_STALLED   FFERRTAG('S','T','L','D')
+
+/** Network errors after which reconnect makes sense */
+bool ffmpeg_is_ioerror(int status);
+
+/**
+ * Reconnect delay for given attempt: 0 for the first one,
+ *  then base_ms * 2^(attempt-1) capped by max_ms, with random jitter in [50%, 100%]
+ */
+int ffmpeg_backoff_delay(int attempt, int base_ms, int max_ms);
+
+
 bool ffmpeg_is_format_supported(const int fmts[],
     int fmt );
 
@@ -0,0 +1,101 @@
+/*
+ * frmarena.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include "frmarena.h"
+#include "ffmpeg.h"
+#include "debug.h"
+
+#define FRMARENA_HUGEPAGE   (2 * 1024 * 1024)
+
+
+int frmarena_create(frmarena * arena, size_t count, size_t datasize, int flags)
+{
+  const size_t pagesize = sysconf(_SC_PAGESIZE) > 0 ? sysconf(_SC_PAGESIZE) : 4096;
+  void * base;
+  int status = 0;
+
+  memset(arena, 0, sizeof(*arena));
+
+  if ( !count || !datasize ) {
+    return AVERROR(EINVAL);
+  }
+
+  arena->count = count;
+  arena->datasize = datasize;
+  arena->slotsize = FFALIGN(datasize, FRMARENA_ALIGN);
+  arena->mapsize = FFALIGN(count * arena->slotsize, pagesize);
+
+  if ( flags & frmarena_hugepages ) {
+    arena->mapsize = FFALIGN(arena->mapsize, FRMARENA_HUGEPAGE);
+  }
+
+  if ( !(arena->frames = av_mallocz_array(count, sizeof(*arena->frames))) ) {
+    PERROR("av_mallocz_array(%zu frame headers) fails", count);
+    status = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  if ( (base = mmap(NULL, arena->mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED ) {
+    status = AVERROR(errno);
+    PERROR("mmap(%zu bytes) fails: %s", arena->mapsize, av_err2str(status));
+    goto end;
+  }
+
+  arena->base = base;
+
+  /* advice must come before the pages are touched */
+  if ( flags & frmarena_hugepages ) {
+#ifdef MADV_HUGEPAGE
+    if ( madvise(base, arena->mapsize, MADV_HUGEPAGE) != 0 ) {
+      PDBG("madvise(MADV_HUGEPAGE) fails: %s", strerror(errno));
+    }
+#else
+    PDBG("MADV_HUGEPAGE is not supported, frame arena uses small pages");
+#endif
+  }
+
+  /* mlock() faults everything in itself */
+  if ( (flags & frmarena_mlock) && !(arena->locked = mlock(base, arena->mapsize) == 0) ) {
+    PDBG("mlock(%zu bytes) fails: %s, frame arena is pageable", arena->mapsize, strerror(errno));
+  }
+
+  /* take page faults now instead of on first frames of the stream */
+  if ( !arena->locked ) {
+    for ( size_t offset = 0; offset < arena->mapsize; offset += pagesize ) {
+      arena->base[offset] = 0;
+    }
+  }
+
+  for ( size_t i = 0; i < count; ++i ) {
+    arena->frames[i].data = arena->base + i * arena->slotsize;
+  }
+
+end:
+
+  if ( status ) {
+    frmarena_destroy(arena);
+  }
+
+  return status;
+}
+
+
+void frmarena_destroy(frmarena * arena)
+{
+  if ( arena->base ) {
+    if ( arena->locked ) {
+      munlock(arena->base, arena->mapsize);
+    }
+    munmap(arena->base, arena->mapsize);
+  }
+
+  av_free(arena->frames);
+
+  memset(arena, 0, sizeof(*arena));
+}
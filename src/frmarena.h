@@ -0,0 +1,71 @@
+/*
+ * frmarena.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Memory of one frame pool: payloads are FRMARENA_ALIGN aligned slots of single
+ *  anonymous mapping, frame headers are separate array, so headers traffic
+ *  does not share cache lines with pixel data and SIMD kernels can use aligned loads.
+ */
+
+#pragma once
+
+#ifndef __frmarena_h__
+#define __frmarena_h__
+
+#include <stdint.h>
+#include "sendvideo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRMARENA_ALIGN    64
+
+/* frmarena_create() flags */
+enum {
+  frmarena_hugepages = 0x1,   /* madvise(MADV_HUGEPAGE), payloads are rounded up to 2 MiB */
+  frmarena_mlock = 0x2,       /* keep payloads resident, falls back to pageable memory if not permitted */
+};
+
+typedef
+struct frmarena {
+  struct frm * frames;        /* headers */
+  uint8_t * base;             /* payloads */
+  size_t count;
+  size_t datasize;            /* requested payload size */
+  size_t slotsize;            /* datasize rounded up to FRMARENA_ALIGN */
+  size_t mapsize;
+  bool locked;
+} frmarena;
+
+
+/* All payloads are mapped and prefaulted here, no allocations after this call */
+int frmarena_create(frmarena * arena, size_t count, size_t datasize, int flags);
+
+void frmarena_destroy(frmarena * arena);
+
+/* Frame header of payload pointer, NULL if data is not a slot of this arena */
+static inline struct frm * frmarena_frame(const frmarena * arena, const void * data)
+{
+  size_t offset;
+
+  if ( !arena->base || (const uint8_t *) data < arena->base ) {
+    return NULL;
+  }
+
+  offset = (const uint8_t *) data - arena->base;
+  if ( offset % arena->slotsize || offset / arena->slotsize >= arena->count ) {
+    return NULL;
+  }
+
+  return &arena->frames[offset / arena->slotsize];
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __frmarena_h__ */
@@ -0,0 +1,111 @@
+/*
+ * mediaclock.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <math.h>
+#include "mediaclock.h"
+#include "ffmpeg.h"
+
+/* audio buffers averaged before switching to the slow low-pass filter */
+#define MEDIACLOCK_WARMUP   32
+
+/* low-pass filter coefficient, OpenSL callbacks jitter by few ms */
+#define MEDIACLOCK_ALPHA    0.01
+
+
+void mediaclock_init(mediaclock * c, int sample_rate, int max_slew_ppm)
+{
+  memset(c, 0, sizeof(*c));
+  c->sample_rate = sample_rate > 0 ? sample_rate : 1;
+  c->slew_ppm = max_slew_ppm > 0 ? max_slew_ppm : 2000;
+  c->alpha = MEDIACLOCK_ALPHA;
+}
+
+static int64_t get_origin(mediaclock * c, int64_t t)
+{
+  int64_t origin = 0;
+
+  if ( atomic_compare_exchange_strong(&c->origin, &origin, t) ) {
+    origin = t;
+  }
+
+  return origin;
+}
+
+int64_t mediaclock_elapsed_us(mediaclock * c)
+{
+  const int64_t origin = atomic_load(&c->origin);
+  return origin ? ffmpeg_gettime_us() - origin : 0;
+}
+
+int64_t mediaclock_video_pts(mediaclock * c, int64_t capture_us)
+{
+  int64_t pts;
+
+  if ( capture_us <= 0 ) {
+    capture_us = ffmpeg_gettime_us();
+  }
+
+  if ( (pts = capture_us - get_origin(c, capture_us)) < 0 ) {
+    /* captured before the first audio buffer which has set the origin */
+    pts = 0;
+  }
+
+  if ( c->nupdates_v++ && pts < c->last_vpts + 1000 ) {
+    pts = c->last_vpts + 1000;
+  }
+
+  return c->last_vpts = pts;
+}
+
+int64_t mediaclock_audio_pts(mediaclock * c, int64_t capture_us, int nb_samples)
+{
+  const int rate = c->sample_rate;
+  int64_t start_us, pts, target, slew;
+  double d;
+
+  /* capture time of the first sample in the buffer */
+  start_us = capture_us - (int64_t) nb_samples * 1000000 / rate;
+
+  /* position on monotonic clock minus position on device clock */
+  d = (double) (start_us - get_origin(c, start_us)) - (double) c->samples * 1000000 / rate;
+
+  if ( c->nupdates++ == 0 ) {
+    /* audio may start later than video: align at once */
+    c->drift = d;
+    c->offset = llrint(d * rate / 1000000);
+  }
+  else {
+
+    c->drift += (d - c->drift) * (c->nupdates < MEDIACLOCK_WARMUP ? 1.0 / c->nupdates : c->alpha);
+
+    /* follow the filtered drift slowly, ignore sub-millisecond wander */
+    target = llrint(c->drift * rate / 1000000);
+    slew = FFMAX(1, (int64_t) nb_samples * c->slew_ppm / 1000000);
+
+    if ( llabs(target - c->offset) > rate / 1000 ) {
+      c->offset += av_clip64(target - c->offset, -slew, slew);
+    }
+  }
+
+  pts = c->samples + c->offset;
+  c->samples += nb_samples;
+
+  atomic_store(&c->drift_us, (int64_t) c->drift);
+  atomic_store(&c->offset_us, c->offset * 1000000 / rate);
+
+  return pts;
+}
+
+int64_t mediaclock_drift_us(mediaclock * c)
+{
+  return atomic_load(&c->drift_us);
+}
+
+int64_t mediaclock_offset_us(mediaclock * c)
+{
+  return atomic_load(&c->offset_us);
+}
@@ -0,0 +1,84 @@
+/*
+ * mediaclock.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Common media clock for camera and audio producers.
+ *
+ *  All capture times are CLOCK_MONOTONIC microseconds (ffmpeg_gettime_us(),
+ *  System.nanoTime() / 1000 on java side). The clock origin is the capture time of
+ *  the first frame or sample, whichever comes first.
+ *
+ *  Video pts are taken from capture times directly.
+ *  Audio pts are taken from the sample counter, which runs on the audio device clock.
+ *  The difference between the two clocks is low-pass filtered and audio pts are slowly
+ *  nudged towards the monotonic clock, so A/V stay aligned over multi-hour sessions.
+ */
+
+#pragma once
+
+#ifndef __mediaclock_h__
+#define __mediaclock_h__
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct mediaclock {
+
+  _Atomic int64_t origin;     /* [us], 0 until the first capture */
+
+  /* video producer only */
+  int64_t last_vpts;          /* [us] since origin */
+  int nupdates_v;
+
+  /* audio producer only */
+  int sample_rate;
+  int slew_ppm;               /* max speed of pts corrections */
+  int64_t samples;            /* samples captured */
+  int64_t offset;             /* correction applied to sample counter [samples] */
+  double drift;               /* low-passed (capture time - sample clock) [us] */
+  double alpha;
+  int nupdates;
+
+  /* for stats pollers */
+  _Atomic int64_t drift_us;
+  _Atomic int64_t offset_us;
+
+} mediaclock;
+
+
+/* max_slew_ppm limits the speed of audio pts corrections, 0 means default 2000 ppm */
+void mediaclock_init(mediaclock * c, int sample_rate, int max_slew_ppm);
+
+/* current time relative to origin [us], 0 before the first capture */
+int64_t mediaclock_elapsed_us(mediaclock * c);
+
+/**
+ * Timestamp of video frame captured at capture_us (<= 0 means now),
+ *  returns [us] since origin, increasing by at least 1 ms.
+ */
+int64_t mediaclock_video_pts(mediaclock * c, int64_t capture_us);
+
+/**
+ * Timestamp of audio buffer of nb_samples, which has been completed at capture_us.
+ *  returns pts of the first sample in 1/sample_rate units.
+ */
+int64_t mediaclock_audio_pts(mediaclock * c, int64_t capture_us, int nb_samples);
+
+/* filtered drift of audio device clock against monotonic clock, applied correction [us] */
+int64_t mediaclock_drift_us(mediaclock * c);
+int64_t mediaclock_offset_us(mediaclock * c);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __mediaclock_h__ */
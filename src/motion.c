@@ -0,0 +1,301 @@
+/*
+ * motion.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Block means and tile SAD kernels: scalar reference, NEON, SSE2.
+ *  Both kernels are sums of absolute values of 8-byte groups, which is
+ *  exactly what PSADBW computes, so SIMD and scalar results are bit-exact.
+ */
+
+#include "motion.h"
+#include "ffmpeg.h"
+#include "debug.h"
+#include <pthread.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+# define HAVE_MOTION_NEON  1
+# include <arm_neon.h>
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+# define HAVE_MOTION_X86   1
+# include <immintrin.h>
+#endif
+
+#define MOTION_DEFAULT_THRESHOLD  3
+
+typedef
+struct motion_kernels {
+  const char * name;
+  /* n means of 8x8 blocks of the rows src .. src + 7 * linesize, even rows are sampled */
+  void (*block_means)(const uint8_t * src, int linesize, uint8_t * dst, int n);
+  /* sads[t] += SAD of 8 byte groups t of a and b, n is multiple of 16 */
+  void (*tile_sads)(const uint8_t * a, const uint8_t * b, uint32_t * sads, int n);
+} motion_kernels;
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// scalar reference
+
+static void block_means_c(const uint8_t * src, int linesize, uint8_t * dst, int n)
+{
+  for ( int i = 0; i < n; ++i, src += MOTION_BLOCK ) {
+    unsigned sum = 0;
+    for ( int y = 0; y < MOTION_BLOCK; y += 2 ) {
+      for ( int x = 0; x < MOTION_BLOCK; ++x ) {
+        sum += src[y * linesize + x];
+      }
+    }
+    dst[i] = (sum + 16) >> 5;
+  }
+}
+
+static void tile_sads_c(const uint8_t * a, const uint8_t * b, uint32_t * sads, int n)
+{
+  for ( int i = 0; i < n; ++i ) {
+    sads[i / MOTION_TILE] += FFABS(a[i] - b[i]);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARM NEON
+
+#if HAVE_MOTION_NEON
+
+static void block_means_neon(const uint8_t * src, int linesize, uint8_t * dst, int n)
+{
+  int i = 0;
+
+  for ( ; i + 2 <= n; i += 2, src += 2 * MOTION_BLOCK ) {
+    uint16x8_t s = vpaddlq_u8(vld1q_u8(src));
+    s = vpadalq_u8(s, vld1q_u8(src + 2 * linesize));
+    s = vpadalq_u8(s, vld1q_u8(src + 4 * linesize));
+    s = vpadalq_u8(s, vld1q_u8(src + 6 * linesize));
+    const uint64x2_t t = vpaddlq_u32(vpaddlq_u16(s));
+    dst[i] = (vgetq_lane_u64(t, 0) + 16) >> 5;
+    dst[i + 1] = (vgetq_lane_u64(t, 1) + 16) >> 5;
+  }
+
+  block_means_c(src, linesize, dst + i, n - i);
+}
+
+static void tile_sads_neon(const uint8_t * a, const uint8_t * b, uint32_t * sads, int n)
+{
+  for ( int i = 0; i < n; i += 16, sads += 2 ) {
+    const uint64x2_t t = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)))));
+    sads[0] += vgetq_lane_u64(t, 0);
+    sads[1] += vgetq_lane_u64(t, 1);
+  }
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// x86 SSE2
+
+#if HAVE_MOTION_X86
+
+__attribute__((target("sse2")))
+static void block_means_sse2(const uint8_t * src, int linesize, uint8_t * dst, int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+
+  for ( ; i + 2 <= n; i += 2, src += 2 * MOTION_BLOCK ) {
+    __m128i s = _mm_sad_epu8(_mm_loadu_si128((const __m128i *) src), zero);
+    s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (src + 2 * linesize)), zero));
+    s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (src + 4 * linesize)), zero));
+    s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (src + 6 * linesize)), zero));
+    dst[i] = (_mm_extract_epi16(s, 0) + 16) >> 5;
+    dst[i + 1] = (_mm_extract_epi16(s, 4) + 16) >> 5;
+  }
+
+  block_means_c(src, linesize, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void tile_sads_sse2(const uint8_t * a, const uint8_t * b, uint32_t * sads, int n)
+{
+  for ( int i = 0; i < n; i += 16, sads += 2 ) {
+    const __m128i s = _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (a + i)), _mm_loadu_si128((const __m128i *) (b + i)));
+    sads[0] += _mm_extract_epi16(s, 0);
+    sads[1] += _mm_extract_epi16(s, 4);
+  }
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// dispatch
+
+static motion_kernels kernel_list[4];
+static const motion_kernels * best_kernels;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+
+static bool selfcheck(const motion_kernels * k)
+{
+  enum {
+    cx = 16 * MOTION_BLOCK + 3 * MOTION_BLOCK, // odd number of blocks to hit the tail
+    cy = MOTION_BLOCK,
+    n = 48
+  };
+
+  uint8_t src[cy][cx], m0[cx / MOTION_BLOCK], m1[cx / MOTION_BLOCK];
+  uint8_t a[n], b[n];
+  uint32_t s0[n / MOTION_TILE] = { 0 }, s1[n / MOTION_TILE] = { 0 };
+  unsigned seed = 12345;
+
+  for ( int y = 0; y < cy; ++y ) {
+    for ( int x = 0; x < cx; ++x ) {
+      src[y][x] = (seed = seed * 1103515245 + 12345) >> 16;
+    }
+  }
+  for ( int i = 0; i < n; ++i ) {
+    a[i] = (seed = seed * 1103515245 + 12345) >> 16;
+    b[i] = (seed = seed * 1103515245 + 12345) >> 16;
+  }
+
+  block_means_c(&src[0][0], cx, m0, cx / MOTION_BLOCK);
+  k->block_means(&src[0][0], cx, m1, cx / MOTION_BLOCK);
+  tile_sads_c(a, b, s0, n);
+  k->tile_sads(a, b, s1, n);
+
+  return memcmp(m0, m1, sizeof(m0)) == 0 && memcmp(s0, s1, sizeof(s0)) == 0;
+}
+
+
+static void init_kernel_list(void)
+{
+  int n = 0;
+
+#if HAVE_MOTION_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("sse2") ) {
+    kernel_list[n++] = (motion_kernels ) { "sse2", block_means_sse2, tile_sads_sse2 };
+  }
+#endif
+
+#if HAVE_MOTION_NEON
+  kernel_list[n++] = (motion_kernels ) { "neon", block_means_neon, tile_sads_neon };
+#endif
+
+  kernel_list[n++] = (motion_kernels ) { "c", block_means_c, tile_sads_c };
+
+  for ( int i = 0; i < n; ++i ) {
+    if ( selfcheck(&kernel_list[i]) ) {
+      best_kernels = &kernel_list[i];
+      break;
+    }
+    PERROR("motion selfcheck('%s') fails, kernels disabled", kernel_list[i].name);
+  }
+
+  if ( !best_kernels ) {
+    best_kernels = &kernel_list[n - 1];
+  }
+
+  PDBG("motion kernels: '%s'", best_kernels->name);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int motion_init(motion_detector * md, int width, int height, int threshold)
+{
+  size_t size;
+  int status = 0;
+
+  pthread_once(&init_once, init_kernel_list);
+
+  memset(md, 0, sizeof(*md));
+
+  if ( width < MOTION_BLOCK || height < MOTION_BLOCK ) {
+    return AVERROR(EINVAL);
+  }
+
+  md->tw = width / MOTION_BLOCK;
+  md->th = height / MOTION_BLOCK;
+  md->stride = FFALIGN(md->tw, 16);
+  md->tiles_x = (md->tw + MOTION_TILE - 1) / MOTION_TILE;
+  md->tiles_y = (md->th + MOTION_TILE - 1) / MOTION_TILE;
+  md->threshold = (threshold > 0 ? threshold : MOTION_DEFAULT_THRESHOLD) * MOTION_TILE * MOTION_TILE;
+  md->kernels = best_kernels->name;
+
+  size = (size_t) md->stride * md->tiles_y * MOTION_TILE;
+
+  if ( !(md->cur = av_mallocz(size)) || !(md->ref = av_mallocz(size)) ) {
+    status = AVERROR(ENOMEM);
+    goto end;
+  }
+
+  /* tile_sads() writes whole 16-byte groups */
+  if ( !(md->sads = av_mallocz_array(md->stride / MOTION_TILE, sizeof(*md->sads))) ) {
+    status = AVERROR(ENOMEM);
+    goto end;
+  }
+
+end:
+
+  if ( status ) {
+    motion_cleanup(md);
+  }
+
+  return status;
+}
+
+
+void motion_cleanup(motion_detector * md)
+{
+  av_free(md->cur);
+  av_free(md->ref);
+  av_free(md->sads);
+  memset(md, 0, sizeof(*md));
+}
+
+
+int motion_measure(motion_detector * md, const uint8_t * plane, int linesize)
+{
+  const motion_kernels * k = best_kernels;
+  int changed = 0;
+
+  for ( int y = 0; y < md->th; ++y ) {
+    k->block_means(plane + (size_t) y * MOTION_BLOCK * linesize, linesize, md->cur + y * md->stride, md->tw);
+  }
+
+  if ( !md->have_ref ) {
+    return 1000;
+  }
+
+  for ( int ty = 0; ty < md->tiles_y; ++ty ) {
+
+    const int offset = ty * MOTION_TILE * md->stride;
+
+    memset(md->sads, 0, md->stride / MOTION_TILE * sizeof(*md->sads));
+
+    for ( int y = 0; y < MOTION_TILE; ++y ) {
+      k->tile_sads(md->cur + offset + y * md->stride, md->ref + offset + y * md->stride, md->sads, md->stride);
+    }
+
+    for ( int tx = 0; tx < md->tiles_x; ++tx ) {
+      if ( md->sads[tx] > (uint32_t) md->threshold ) {
+        ++changed;
+      }
+    }
+  }
+
+  return changed * 1000 / (md->tiles_x * md->tiles_y);
+}
+
+
+void motion_set_reference(motion_detector * md)
+{
+  uint8_t * tmp = md->ref;
+  md->ref = md->cur;
+  md->cur = tmp;
+  md->have_ref = true;
+}
@@ -0,0 +1,66 @@
+/*
+ * motion.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Cheap static scene detector for fixed cameras.
+ *  The first plane of camera frame is reduced to means of 8x8 blocks (every other row is sampled),
+ *  then compared by SAD against reference thumbnail in tiles of 8x8 blocks (64x64 pixels).
+ *  Block means suppress sensor noise, a tile counts as changed if its mean block difference
+ *  is above the threshold. Works on any first plane: luma for NV21 and YV12, packed bytes
+ *  for YUY2 and RGBA which change as well when the scene does.
+ */
+
+#pragma once
+
+#ifndef __motion_h__
+#define __motion_h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTION_BLOCK      8     /* plane bytes x rows per thumbnail pixel */
+#define MOTION_TILE       8     /* thumbnail pixels per tile side */
+
+
+typedef
+struct motion_detector {
+  uint8_t * cur, * ref;         /* thumbnails, rows are padded with zeros to whole tiles */
+  uint32_t * sads;              /* per tile of one tile row */
+  int tw, th;                   /* thumbnail size */
+  int stride;                   /* thumbnail row, multiple of 16 */
+  int tiles_x, tiles_y;
+  int threshold;                /* tile SAD */
+  bool have_ref;
+  const char * kernels;         /* name of SIMD kernels in use */
+} motion_detector;
+
+
+/**
+ * width: first plane row bytes to look at, height: rows
+ *  threshold: mean absolute difference of block means [levels] to count tile as changed, 0 = default 3
+ */
+int motion_init(motion_detector * md, int width, int height, int threshold);
+
+void motion_cleanup(motion_detector * md);
+
+/**
+ * Build thumbnail of the plane and compare against reference.
+ *  Returns changed tiles per mille [0..1000], 1000 if there is no reference yet.
+ */
+int motion_measure(motion_detector * md, const uint8_t * plane, int linesize);
+
+/* Last measured thumbnail becomes reference, call when the frame was encoded from fresh picture */
+void motion_set_reference(motion_detector * md);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __motion_h__ */
@@ -0,0 +1,1115 @@
+/*
+ * output-sink.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <stdatomic.h>
+#include "output-sink.h"
+#include "spool.h"
+#include "pthread_wait.h"
+#include "cclist.h"
+#include "cchist.h"
+#include "debug.h"
+
+#define OUTPUT_SINK_MAX_STREAMS   4
+
+
+struct iqitem {
+  AVPacket pkt;
+  int64_t t;                /* enqueue time [us] */
+};
+
+struct output_sink {
+
+  char * url;
+  AVOutputFormat * oformat;
+  int index;
+
+  AVCodecParameters * codecpar[OUTPUT_SINK_MAX_STREAMS];
+  AVRational time_base[OUTPUT_SINK_MAX_STREAMS];
+  int nb_streams;
+  int vstidx;               /* video stream index or -1 */
+
+  int reconnect_delay;
+  int reconnect_max;
+
+  output_sink_callback callback;
+  void * cookie;
+
+  pthread_t pid;
+  pthread_wait_t lock;
+  struct ccfifo pq;         /* AVPacket */
+  ccprioq iq;               /* struct iqitem, sink thread only */
+  int iqcount[OUTPUT_SINK_MAX_STREAMS];
+  int64_t iqmaxkey;         /* newest dts in interleaver [us] */
+  int64_t max_interleave_delay; /* [us] */
+  char * spool_dir;         /* spool configuration, NULL if not enabled */
+  int64_t spool_size;
+  int spool_segments;
+  bool spool_failed;        /* spool_create() failed, the sink works without spool */
+  spool * sp;               /* on-disk backlog while disconnected, created by spooler thread */
+  pthread_mutex_t splock;   /* serializes spool I/O of spooler and sink threads, sink lock is never taken under it */
+  pthread_t spid;           /* spooler thread: moves the live queue to the spool while spooling */
+  bool spooling;            /* packets go through the spool, cleared by sink thread when it is drained */
+  int spilling;             /* packets taken from pq by spooler and not yet in the spool */
+  int spool_rate;           /* [kbit/s] */
+  int64_t spool_next_us;    /* catch-up rate limiter: earliest time to read next spooled packet */
+  ffio_params io;
+  bool ffmpeg_io;
+  bool ownio;               /* current output context is written by ffio */
+  int iotmo;                /* [ms] until buffered output data must be flushed, -1 if nothing buffered */
+  int64_t io_calls_base;    /* ioCalls of closed connections */
+
+  /* budget of current blocking output operation, checked by interrupt callback. Sink thread only */
+  int connect_timeout, header_timeout, write_timeout;
+  int64_t io_start;         /* [us] */
+  int64_t io_deadline;      /* [us], INT64_MAX if none */
+  bool io_timedout;
+  bool stop_aborts_io;      /* stop interrupts the current operation: connect and header only */
+  int64_t drain_deadline;   /* [us] end of the final drain after stop, 0 until stop is seen */
+  cchist stall_hist;        /* [us] */
+  int64_t stall_max;        /* [us] */
+  bool waitkey;             /* drop video packets until next key frame, under sink lock */
+  atomic_bool stop;         /* set under sink lock, read without it by interrupt callback and loops */
+
+  struct output_sink_stats stats;
+};
+
+
+static void sink_lock(output_sink * sink) {
+  pthread_wait_lock(&sink->lock);
+}
+
+static void sink_unlock(output_sink * sink) {
+  pthread_wait_unlock(&sink->lock);
+}
+
+static int sink_wait(output_sink * sink, int tmo) {
+  return pthread_wait(&sink->lock, tmo);
+}
+
+static void sink_signal(output_sink * sink) {
+  pthread_wait_broadcast(&sink->lock);
+}
+
+static int sink_interrupt_callback(void * arg) {
+  output_sink * sink = arg;
+
+  /* established outputs are drained and get the trailer after stop, within time budgets */
+  if ( sink->stop_aborts_io && atomic_load(&sink->stop) ) {
+    return 1;
+  }
+
+  if ( sink->io_deadline != INT64_MAX && ffmpeg_gettime_us() > sink->io_deadline ) {
+    sink->io_timedout = true;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Start blocking output operation with time budget [ms], <= 0 means no limit */
+static void begin_io(output_sink * sink, int budget)
+{
+  sink->io_start = ffmpeg_gettime_us();
+  sink->io_deadline = budget > 0 ? sink->io_start + budget * 1000LL : INT64_MAX;
+  sink->io_timedout = false;
+}
+
+/*
+ * Finish blocking output operation: count stall, convert abort on exceeded budget into AVERROR_STALLED.
+ *  After abort the deadline stays expired, so closing the dead connection does not block again.
+ */
+static int end_io(output_sink * sink, int status, const char * what)
+{
+  const int64_t t = ffmpeg_gettime_us() - sink->io_start;
+
+  if ( t >= OUTPUT_SINK_STALL_THRESHOLD * 1000LL || sink->io_timedout ) {
+
+    cchist_add(&sink->stall_hist, t);
+
+    sink_lock(sink);
+    ++sink->stats.stalls;
+    if ( sink->io_timedout ) {
+      ++sink->stats.timeouts;
+    }
+    if ( t > sink->stall_max ) {
+      sink->stall_max = t;
+    }
+    sink_unlock(sink);
+  }
+
+  if ( sink->io_timedout && status < 0 ) {
+    PERROR("[%d] %s stalled for %d ms, aborted", sink->index, what, (int) (t / 1000));
+    status = AVERROR_STALLED;
+  }
+  else {
+    sink->io_deadline = INT64_MAX;
+  }
+
+  return status;
+}
+
+/*
+ * Budget [ms] of the next packet write. After stop the rest of the queue gets one write_timeout
+ *  in total, 0 when it is spent
+ */
+static int drain_budget(output_sink * sink)
+{
+  int64_t t;
+
+  if ( !atomic_load(&sink->stop) || sink->write_timeout <= 0 ) {
+    return sink->write_timeout;
+  }
+
+  t = ffmpeg_gettime_us();
+
+  if ( !sink->drain_deadline ) {
+    sink->drain_deadline = t + sink->write_timeout * 1000LL;
+  }
+
+  return (int) FFMAX(0, (sink->drain_deadline - t) / 1000);
+}
+
+/* the smaller of two wait times, -1 means infinite */
+static int min_tmo(int a, int b) {
+  return a < 0 ? b : b < 0 ? a : FFMIN(a, b);
+}
+
+static void close_io(output_sink * sink, AVIOContext ** pb)
+{
+  struct ffio_stats st;
+
+  if ( sink->ownio ) {
+    if ( *pb ) {
+      ffio_get_stats(*pb, &st);
+      sink_lock(sink);
+      sink->io_calls_base += st.syscalls;
+      sink->stats.ioCalls = sink->io_calls_base;
+      sink_unlock(sink);
+    }
+    ffio_close(pb);
+    sink->ownio = false;
+  }
+  else {
+    avio_closep(pb);
+  }
+}
+
+
+static void set_sink_state(output_sink * sink, output_sink_state state, int status)
+{
+  sink_lock(sink);
+  sink->stats.state = state;
+  if ( sink->spool_dir && !sink->spool_failed && state != output_sink_established ) {
+    sink->spooling = true;
+    sink_signal(sink);
+  }
+  sink_unlock(sink);
+
+  if ( sink->callback.state_changed ) {
+    sink->callback.state_changed(sink->cookie, sink, state, status);
+  }
+}
+
+/* must be called under sink_lock() */
+static void flush_packets(output_sink * sink)
+{
+  AVPacket * pkt;
+
+  while ( (pkt = ccfifo_peek_front(&sink->pq)) ) {
+    av_packet_unref(pkt);
+    ccfifo_pop(&sink->pq, NULL);
+    ++sink->stats.drops;
+  }
+
+  sink->stats.queueSize = 0;
+}
+
+
+/* must be called under sink_lock() with values sampled under splock */
+static void update_spool_stats(output_sink * sink, int64_t nbytes, int npkts)
+{
+  sink->stats.spoolBytes = nbytes;
+  sink->stats.spoolPackets = npkts;
+}
+
+/*
+ * Spooler thread: while spooling, live packets are moved from pq to the spool tail.
+ *  Disk writes are made without sink lock, so neither output_sink_push() nor the sink thread
+ *  waits for flash. The segment files are opened and allocated here too, not on the stream thread.
+ */
+static void * spooler_thread(void * arg)
+{
+  output_sink * sink = arg;
+  spool * sp;
+  char prefix[32];
+  AVPacket pkt;
+  int64_t nbytes;
+  int npkts, status;
+
+  av_init_packet(&pkt);
+  pkt.data = NULL, pkt.size = 0;
+
+  snprintf(prefix, sizeof(prefix), "out%d", sink->index);
+
+  if ( !(sp = spool_create(sink->spool_dir, prefix, sink->spool_size, sink->spool_segments)) ) {
+    PERROR("[%d] spool_create('%s') fails: %s", sink->index, sink->spool_dir, strerror(errno));
+  }
+
+  pthread_mutex_lock(&sink->splock);
+  sink->sp = sp;
+  pthread_mutex_unlock(&sink->splock);
+
+  sink_lock(sink);
+
+  if ( !sp ) {
+    sink->spool_failed = true;
+    sink->spooling = false;
+    sink_signal(sink);
+  }
+
+  while ( sp && !atomic_load(&sink->stop) ) {
+
+    if ( !sink->spooling || ccfifo_is_empty(&sink->pq) ) {
+      sink_wait(sink, -1);
+      continue;
+    }
+
+    av_packet_move_ref(&pkt, ccfifo_peek_front(&sink->pq));
+    ccfifo_pop(&sink->pq, NULL);
+    sink->stats.queueSize = ccfifo_size(&sink->pq);
+    ++sink->spilling;
+
+    sink_unlock(sink);
+
+    pthread_mutex_lock(&sink->splock);
+    status = spool_write(sink->sp, &pkt);
+    nbytes = spool_bytes(sink->sp);
+    npkts = spool_packets(sink->sp);
+    pthread_mutex_unlock(&sink->splock);
+
+    av_packet_unref(&pkt);
+
+    sink_lock(sink);
+
+    if ( status < 0 ) {
+      ++sink->stats.drops;
+    }
+    else if ( status > 0 ) {
+      /* oldest segment evicted, the spool head may start in the middle of GOP */
+      sink->stats.spoolDrops += status;
+      sink->waitkey = sink->vstidx >= 0;
+    }
+
+    update_spool_stats(sink, nbytes, npkts);
+    --sink->spilling;
+    sink_signal(sink);
+  }
+
+  sink_unlock(sink);
+
+  return NULL;
+}
+
+/*
+ * Pick next packet to write, must be called under sink_lock(), which is released for spool reads.
+ *  While spooling the spool is read first: the spooler appends live packets to its tail,
+ *  so it is always older than the live queue. Spooling ends when the spool is drained
+ *  and no packet is on the way to it, after that the live queue is read directly.
+ *  Returns 0 on success, AVERROR(EAGAIN) if nothing to write now, with *tmo set to wait time in ms
+ */
+static int next_packet(output_sink * sink, AVPacket * pkt, int * tmo)
+{
+  int64_t t, nbytes;
+  int npkts, status;
+  bool resync = false;
+
+  *tmo = -1;
+
+  if ( sink->spooling ) {
+
+  again:
+
+    if ( sink->spool_rate > 0 && (t = ffmpeg_gettime_us()) < sink->spool_next_us ) {
+      *tmo = (int) ((sink->spool_next_us - t + 999) / 1000);
+      return AVERROR(EAGAIN);
+    }
+
+    sink_unlock(sink);
+
+    pthread_mutex_lock(&sink->splock);
+    if ( !sink->sp ) {
+      /* not created yet, nothing spooled */
+      status = AVERROR_EOF, nbytes = 0, npkts = 0;
+    }
+    else {
+      while ( (status = spool_read(sink->sp, pkt)) == AVERROR_INVALIDDATA ) {
+        /* damaged segment was dropped */
+        resync = true;
+      }
+      nbytes = spool_bytes(sink->sp);
+      npkts = spool_packets(sink->sp);
+    }
+    pthread_mutex_unlock(&sink->splock);
+
+    sink_lock(sink);
+
+    if ( resync ) {
+      sink->waitkey = sink->vstidx >= 0;
+    }
+
+    update_spool_stats(sink, nbytes, npkts);
+
+    if ( status != AVERROR_EOF ) {
+      if ( status == 0 && sink->spool_rate > 0 ) {
+        t = FFMAX(sink->spool_next_us, ffmpeg_gettime_us() - 100000);
+        sink->spool_next_us = t + pkt->size * 8000LL / sink->spool_rate;
+      }
+      return status;
+    }
+
+    if ( sink->spilling ) {
+      /* the spooler signals when the packet is in the spool */
+      return AVERROR(EAGAIN);
+    }
+
+    /* spooler may have written since the read above, recheck under both locks */
+    pthread_mutex_lock(&sink->splock);
+    if ( (!sink->sp || spool_is_empty(sink->sp)) && sink->stats.state == output_sink_established ) {
+      sink->spooling = false;
+    }
+    pthread_mutex_unlock(&sink->splock);
+
+    if ( sink->spooling ) {
+      goto again;
+    }
+  }
+
+  if ( ccfifo_is_empty(&sink->pq) ) {
+    return AVERROR(EAGAIN);
+  }
+
+  av_packet_move_ref(pkt, ccfifo_peek_front(&sink->pq));
+  ccfifo_pop(&sink->pq, NULL);
+  sink->stats.queueSize = ccfifo_size(&sink->pq);
+
+  return 0;
+}
+
+
+/* Block until output_sink_set_streams() is called */
+static int wait_streams(output_sink * sink)
+{
+  int status;
+
+  sink_lock(sink);
+
+  while ( !atomic_load(&sink->stop) && !sink->nb_streams ) {
+    sink_wait(sink, -1);
+  }
+
+  status = atomic_load(&sink->stop) ? AVERROR_EXIT : 0;
+
+  sink_unlock(sink);
+
+  return status;
+}
+
+
+static int open_sink(output_sink * sink, AVFormatContext ** poc)
+{
+  AVFormatContext * oc = NULL;
+  AVStream * os;
+  int status;
+
+  if ( (status = avformat_alloc_output_context2(&oc, sink->oformat, NULL, sink->url)) < 0 ) {
+    PERROR("[%d] avformat_alloc_output_context2('%s') fails: %s", sink->index, sink->url, av_err2str(status));
+    goto end;
+  }
+
+  oc->interrupt_callback.callback = sink_interrupt_callback;
+  oc->interrupt_callback.opaque = sink;
+
+  PDBG("[%d] C avio_open2('%s')", sink->index, sink->url);
+
+  /* DNS, TCP and TLS handshakes go here, in parallel with the owner opening the encoders */
+  if ( !(oc->oformat->flags & AVFMT_NOFILE) ) {
+
+    const char * func = "ffio_open";
+
+    begin_io(sink, sink->connect_timeout);
+
+    status = sink->ffmpeg_io ? AVERROR(ENOPROTOOPT) : ffio_open(&oc->pb, sink->url, &sink->io, &oc->interrupt_callback);
+
+    if ( (sink->ownio = status == 0) ) {
+      /* flushes are made by write_packets() on ffio flush interval */
+      oc->flush_packets = 0;
+      sink->iotmo = -1;
+    }
+    else if ( status == AVERROR(ENOPROTOOPT) ) {
+      func = "avio_open2";
+      status = avio_open2(&oc->pb, sink->url, AVIO_FLAG_WRITE, &oc->interrupt_callback, NULL);
+    }
+
+    status = end_io(sink, status, func);
+
+    if ( status < 0 ) {
+      PCRITICAL("[%d] %s(%s) fails: %s", sink->index, func, sink->url, av_err2str(status));
+      goto end;
+    }
+  }
+
+  if ( (status = wait_streams(sink)) < 0 ) {
+    goto end;
+  }
+
+  for ( int i = 0; i < sink->nb_streams; ++i ) {
+
+    if ( !(os = avformat_new_stream(oc, NULL)) ) {
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+
+    if ( (status = avcodec_parameters_copy(os->codecpar, sink->codecpar[i])) < 0 ) {
+      PERROR("[%d] avcodec_parameters_copy(st=%d) fails: %s", sink->index, i, av_err2str(status));
+      goto end;
+    }
+
+    os->time_base = sink->time_base[i];
+  }
+
+  begin_io(sink, sink->header_timeout);
+
+  if ( (status = end_io(sink, avformat_write_header(oc, NULL), "avformat_write_header")) < 0 ) {
+    PERROR("[%d] avformat_write_header('%s') fails: %s", sink->index, sink->url, av_err2str(status));
+    goto end;
+  }
+
+  PDBG("[%d] R avformat_write_header('%s')", sink->index, sink->url);
+
+end:
+
+  if ( status < 0 && oc ) {
+    close_io(sink, &oc->pb);
+    avformat_free_context(oc);
+    oc = NULL;
+  }
+
+  *poc = oc;
+
+  return status < 0 ? status : 0;
+}
+
+static void close_sink(output_sink * sink, AVFormatContext ** oc, int status)
+{
+  int status2;
+
+  if ( *oc ) {
+
+    if ( status == AVERROR_STALLED ) {
+      /* the deadline is still expired, nothing blocks on the dead link */
+      close_io(sink, &(*oc)->pb);
+    }
+    else {
+
+      begin_io(sink, sink->write_timeout);
+
+      if ( !ffmpeg_is_ioerror(status) && (status2 = av_write_trailer(*oc)) ) {
+        PERROR("[%d] av_write_trailer() fails: %s", sink->index, av_err2str(status2));
+      }
+
+      close_io(sink, &(*oc)->pb);
+      end_io(sink, 0, "av_write_trailer");
+    }
+
+    avformat_free_context(*oc);
+    *oc = NULL;
+  }
+}
+
+
+/*
+ * Interleaver: packets ordered by dts. Sink thread only.
+ *  The head is released when every stream has a packet queued (so nothing earlier can come),
+ *  or when it waits longer than max_interleave_delay in stream time or in wall time.
+ */
+
+static int interleaver_push(output_sink * sink, AVPacket * pkt)
+{
+  struct iqitem * item;
+  int64_t key;
+
+  key = av_rescale_q(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts, sink->time_base[pkt->stream_index], AV_TIME_BASE_Q);
+
+  if ( !(item = ccprioq_push(&sink->iq, key, NULL)) ) {
+    return AVERROR(ENOBUFS);
+  }
+
+  av_packet_move_ref(&item->pkt, pkt);
+  item->t = ffmpeg_gettime_us();
+
+  ++sink->iqcount[item->pkt.stream_index];
+
+  if ( key > sink->iqmaxkey ) {
+    sink->iqmaxkey = key;
+  }
+
+  return 0;
+}
+
+/* returns 0 if the head may go out now, otherwise time to wait in ms (-1 for infinite) */
+static int interleaver_wait_time(output_sink * sink, bool flush)
+{
+  const struct iqitem * head;
+  int64_t t;
+
+  if ( !(head = ccprioq_peek(&sink->iq)) ) {
+    return -1;
+  }
+
+  if ( flush || ccprioq_is_full(&sink->iq) ) {
+    return 0;
+  }
+
+  for ( int i = 0; i < sink->nb_streams; ++i ) {
+    if ( !sink->iqcount[i] ) {
+      goto notall;
+    }
+  }
+
+  return 0;
+
+notall:
+
+  if ( sink->iqmaxkey - ccprioq_peek_key(&sink->iq) >= sink->max_interleave_delay ) {
+    return 0;
+  }
+
+  if ( (t = head->t + sink->max_interleave_delay - ffmpeg_gettime_us()) <= 0 ) {
+    return 0;
+  }
+
+  return (int) ((t + 999) / 1000);
+}
+
+static void interleaver_pop(output_sink * sink, AVPacket * pkt)
+{
+  struct iqitem item;
+  double delay;
+
+  delay = (double) (sink->iqmaxkey - ccprioq_peek_key(&sink->iq)) / 1000;
+
+  ccprioq_pop(&sink->iq, &item);
+  av_packet_move_ref(pkt, &item.pkt);
+
+  --sink->iqcount[pkt->stream_index];
+
+  if ( ccprioq_is_empty(&sink->iq) ) {
+    sink->iqmaxkey = INT64_MIN;
+  }
+
+  sink->stats.interleave_ms = 0.9 * sink->stats.interleave_ms + 0.1 * delay;
+}
+
+static void interleaver_flush(output_sink * sink)
+{
+  struct iqitem item;
+
+  while ( ccprioq_pop(&sink->iq, &item) ) {
+    av_packet_unref(&item.pkt);
+  }
+
+  memset(sink->iqcount, 0, sizeof(sink->iqcount));
+  sink->iqmaxkey = INT64_MIN;
+}
+
+
+/*
+ * Drain the packet queue into the output context through the interleaver until error or stop
+ */
+static int write_packets(output_sink * sink, AVFormatContext * oc)
+{
+  AVPacket pkt;
+  struct ffio_stats iost;
+  int pkt_size, stidx, tmo, itmo, budget;
+  int64_t t0, pts;
+  bool isvideo;
+
+  int status = 0;
+
+  av_init_packet(&pkt);
+  pkt.data = NULL, pkt.size = 0;
+
+  /* the first video packet after (re)connect must be a key frame */
+  sink_lock(sink);
+  sink->waitkey = sink->vstidx >= 0;
+
+  while ( status >= 0 ) {
+
+    /* move everything available into the interleaver */
+    while ( (itmo = interleaver_wait_time(sink, false)) != 0 && (status = next_packet(sink, &pkt, &tmo)) == 0 ) {
+      if ( (status = interleaver_push(sink, &pkt)) < 0 ) {
+        av_packet_unref(&pkt);
+        break;
+      }
+    }
+
+    if ( status < 0 && status != AVERROR(EAGAIN) ) {
+      PERROR("[%d] next_packet() fails: %s", sink->index, av_err2str(status));
+      break;
+    }
+
+    status = 0;
+
+    if ( itmo != 0 ) {
+
+      if ( atomic_load(&sink->stop) ) {
+        if ( ccprioq_is_empty(&sink->iq) ) {
+          break; /* stopped and drained */
+        }
+      }
+      else {
+
+        if ( sink->iotmo >= 0 ) {
+          /* idle, buffered output data may be due */
+          sink_unlock(sink);
+          begin_io(sink, sink->write_timeout);
+          status = end_io(sink, ffio_poll_flush(oc->pb, &sink->iotmo), "ffio_poll_flush");
+          sink_lock(sink);
+          if ( status < 0 ) {
+            PERROR("[%d] ffio_poll_flush() fails: %s", sink->index, av_err2str(status));
+            break;
+          }
+        }
+
+        sink_wait(sink, min_tmo(min_tmo(tmo, itmo), sink->iotmo));
+        continue;
+      }
+    }
+
+    interleaver_pop(sink, &pkt);
+
+    stidx = pkt.stream_index;
+    isvideo = stidx == sink->vstidx;
+
+    if ( isvideo && sink->waitkey ) {
+      if ( !(pkt.flags & AV_PKT_FLAG_KEY) ) {
+        ++sink->stats.drops;
+        av_packet_unref(&pkt);
+        continue;
+      }
+      sink->waitkey = false;
+    }
+
+    if ( !(budget = drain_budget(sink)) ) {
+      PERROR("[%d] drain after stop is out of time, %zu packets left", sink->index, ccprioq_size(&sink->iq) + 1);
+      av_packet_unref(&pkt);
+      break;
+    }
+
+    sink_unlock(sink);
+
+    pkt_size = pkt.size;
+    pts = pkt.pts;
+    av_packet_rescale_ts(&pkt, sink->time_base[stidx], oc->streams[stidx]->time_base);
+
+    t0 = ffmpeg_gettime_us();
+    begin_io(sink, budget);
+
+    /* already in dts order, no muxer side buffering */
+    if ( (status = av_write_frame(oc, &pkt)) >= 0 && sink->ownio ) {
+      status = ffio_poll_flush(oc->pb, &sink->iotmo);
+    }
+
+    if ( (status = end_io(sink, status, "av_write_frame")) < 0 ) {
+      PERROR("[%d] av_write_frame(st=%d) fails: status=%d %s", sink->index, stidx, status, av_err2str(status));
+    }
+
+    t0 = ffmpeg_gettime_us() - t0;
+
+    av_packet_unref(&pkt);
+
+    if ( status >= 0 && sink->callback.packet_sent ) {
+      sink->callback.packet_sent(sink->cookie, sink, stidx, pts);
+    }
+
+    sink_lock(sink);
+
+    sink->stats.write_ms = 0.8 * sink->stats.write_ms + 0.2 * t0 / 1000.0;
+
+    if ( sink->ownio ) {
+      ffio_get_stats(oc->pb, &iost);
+      sink->stats.ioCalls = sink->io_calls_base + iost.syscalls;
+    }
+
+    if ( status >= 0 ) {
+      if ( isvideo ) {
+        ++sink->stats.framesSent;
+      }
+      if ( !sink->stats.bytesSent ) {
+        sink->stats.first_packet_time = ffmpeg_gettime_ms();
+      }
+      sink->stats.bytesSent += pkt_size;
+    }
+  }
+
+  sink_unlock(sink);
+
+  return status;
+}
+
+
+static void * output_sink_thread(void * arg)
+{
+  output_sink * sink = arg;
+  AVFormatContext * oc = NULL;
+  int64_t t, tmo, tlost = -1, tconnected;
+  int attempt = 0;
+
+  int status = 0;
+
+  PDBG("[%d] ENTER '%s'", sink->index, sink->url);
+
+  while ( !atomic_load(&sink->stop) ) {
+
+    set_sink_state(sink, output_sink_connecting, 0);
+
+    /* nothing written yet, stop may abort the connect */
+    sink->stop_aborts_io = true;
+    status = open_sink(sink, &oc);
+    sink->stop_aborts_io = false;
+
+    if ( status == 0 ) {
+
+      tconnected = ffmpeg_gettime_ms();
+
+      if ( tlost >= 0 ) {
+        sink_lock(sink);
+        sink->stats.recover_ms = (int) (tconnected - tlost);
+        sink_unlock(sink);
+        PDBG("[%d] recovered in %d ms after %d attempts", sink->index, (int) (tconnected - tlost), attempt + 1);
+      }
+
+      /* the owner forces key frame on this, see write_packets() for resync */
+      set_sink_state(sink, output_sink_established, 0);
+
+      status = write_packets(sink, oc);
+
+      tlost = ffmpeg_gettime_ms();
+
+      /* the link was stable, start backoff from scratch */
+      if ( tlost - tconnected >= sink->reconnect_max ) {
+        attempt = 0;
+      }
+
+      /* announce the loss before the trailer, so the owner can start the spool on a key frame */
+      if ( !atomic_load(&sink->stop) && ffmpeg_is_ioerror(status) ) {
+        set_sink_state(sink, output_sink_paused, status);
+      }
+    }
+    else if ( tlost < 0 ) {
+      tlost = ffmpeg_gettime_ms();
+    }
+
+    close_sink(sink, &oc, status);
+
+    if ( atomic_load(&sink->stop) ) {
+      break;
+    }
+
+    if ( !ffmpeg_is_ioerror(status) ) {
+      PERROR("[%d] '%s' fails: %s", sink->index, sink->url, av_err2str(status));
+      set_sink_state(sink, output_sink_failed, status);
+      break;
+    }
+
+    if ( sink->stats.state != output_sink_paused ) {
+      set_sink_state(sink, output_sink_paused, status);
+    }
+
+    sink_lock(sink);
+
+    ++sink->stats.reconnects;
+
+    tmo = ffmpeg_gettime_ms() + ffmpeg_backoff_delay(attempt++, sink->reconnect_delay, sink->reconnect_max);
+    while ( !atomic_load(&sink->stop) && (t = ffmpeg_gettime_ms()) < tmo ) {
+      sink_wait(sink, (int) (tmo - t));
+    }
+
+    sink_unlock(sink);
+  }
+
+  PDBG("[%d] LEAVE: status=%d", sink->index, status);
+
+  return NULL;
+}
+
+
+output_sink * create_output_sink(const create_output_sink_args * args)
+{
+  output_sink * sink = NULL;
+  int status;
+
+  bool fok = false;
+
+  if ( !args || !args->url || !*args->url || !args->oformat || args->nb_streams < 0 || args->nb_streams > OUTPUT_SINK_MAX_STREAMS ) {
+    errno = EINVAL;
+    goto end;
+  }
+
+  if ( !(sink = av_mallocz(sizeof(*sink))) ) {
+    goto end;
+  }
+
+  if ( pthread_wait_init(&sink->lock) ) {
+    av_freep(&sink);
+    goto end;
+  }
+
+  sink->url = av_strdup(args->url);
+  sink->oformat = args->oformat;
+  sink->index = args->index;
+  sink->reconnect_delay = args->reconnect_delay > 0 ? args->reconnect_delay : 250;
+  sink->reconnect_max = args->reconnect_max > 0 ? args->reconnect_max : 10000;
+  sink->callback = args->callback;
+  sink->cookie = args->cookie;
+  sink->vstidx = -1;
+  sink->io = args->io;
+  sink->ffmpeg_io = args->ffmpeg_io;
+  sink->iotmo = -1;
+  sink->io_deadline = INT64_MAX;
+  sink->connect_timeout = args->connect_timeout ? args->connect_timeout : 5000;
+  sink->header_timeout = args->header_timeout ? args->header_timeout : 5000;
+  sink->write_timeout = args->write_timeout ? args->write_timeout : 2000;
+
+  if ( args->nb_streams > 0 && output_sink_set_streams(sink, args->codecpar, args->time_base, args->nb_streams) < 0 ) {
+    goto end;
+  }
+
+  if ( !ccfifo_init(&sink->pq, args->backlog > 0 ? args->backlog : 256, sizeof(AVPacket)) ) {
+    goto end;
+  }
+
+  sink->stats.queueCapacity = ccfifo_capacity(&sink->pq);
+
+  if ( !ccprioq_init(&sink->iq, ccfifo_capacity(&sink->pq), sizeof(struct iqitem)) ) {
+    goto end;
+  }
+
+  sink->iqmaxkey = INT64_MIN;
+  sink->max_interleave_delay = (args->max_interleave_delay > 0 ? args->max_interleave_delay : 100) * 1000LL;
+
+  if ( args->spool_dir && *args->spool_dir ) {
+
+    if ( (status = pthread_mutex_init(&sink->splock, NULL)) ) {
+      PERROR("[%d] pthread_mutex_init(splock) fails: %s", sink->index, strerror(status));
+      errno = status;
+      goto end;
+    }
+
+    if ( !(sink->spool_dir = av_strdup(args->spool_dir)) ) {
+      PERROR("[%d] av_strdup(spool_dir) fails", sink->index);
+      pthread_mutex_destroy(&sink->splock);
+      errno = ENOMEM;
+      goto end;
+    }
+
+    sink->spool_size = args->spool_size > 0 ? args->spool_size : 64 * 1024 * 1024;
+    sink->spool_segments = args->spool_segments > 1 ? args->spool_segments : 16;
+    sink->spool_rate = args->spool_rate;
+    sink->spooling = true;  /* until the first connect */
+
+    if ( (status = pthread_create(&sink->spid, NULL, spooler_thread, sink)) ) {
+      PERROR("pthread_create(spooler_thread) fails: %s", strerror(status));
+      sink->spid = 0;
+      errno = status;
+      goto end;
+    }
+  }
+
+  if ( (status = pthread_create(&sink->pid, NULL, output_sink_thread, sink)) ) {
+    PERROR("pthread_create(output_sink_thread) fails: %s", strerror(status));
+    sink->pid = 0;
+    errno = status;
+    goto end;
+  }
+
+  fok = true;
+
+end:
+
+  if ( !fok && sink ) {
+    destroy_output_sink(&sink);
+  }
+
+  return sink;
+}
+
+void destroy_output_sink(output_sink ** psink)
+{
+  output_sink * sink;
+
+  if ( psink && (sink = *psink) ) {
+
+    if ( sink->pid || sink->spid ) {
+      sink_lock(sink);
+      atomic_store(&sink->stop, true);
+      sink_signal(sink);
+      sink_unlock(sink);
+    }
+
+    if ( sink->pid ) {
+      pthread_join(sink->pid, NULL);
+    }
+
+    if ( sink->spid ) {
+      pthread_join(sink->spid, NULL);
+    }
+
+    if ( sink->pq.items ) {
+      flush_packets(sink);
+      ccfifo_cleanup(&sink->pq);
+    }
+
+    if ( sink->iq.slots ) {
+      interleaver_flush(sink);
+      ccprioq_cleanup(&sink->iq);
+    }
+
+    if ( sink->spool_dir ) {
+      spool_destroy(&sink->sp);
+      pthread_mutex_destroy(&sink->splock);
+      av_free(sink->spool_dir);
+    }
+
+    for ( int i = 0; i < OUTPUT_SINK_MAX_STREAMS; ++i ) {
+      avcodec_parameters_free(&sink->codecpar[i]);
+    }
+
+    pthread_wait_destroy(&sink->lock);
+    av_free(sink->url);
+    av_freep(psink);
+  }
+}
+
+int output_sink_push(output_sink * sink, const AVPacket * pkt)
+{
+  AVPacket ref, * qpkt;
+  int status = 0;
+
+  sink_lock(sink);
+
+  if ( sink->stats.state == output_sink_failed ) {
+    status = AVERROR_EXIT;
+  }
+  else {
+
+    if ( ccfifo_is_full(&sink->pq) ) {
+      /* queued packets reference each other, drop the whole backlog and restart on key frame */
+      PDBG("[%d] backlog overflow: drop %zu packets", sink->index, ccfifo_size(&sink->pq));
+      flush_packets(sink);
+      sink->waitkey = sink->vstidx >= 0;
+    }
+
+    av_init_packet(&ref);
+    ref.data = NULL, ref.size = 0;
+
+    /* shares the encoder output buffer, no copy for refcounted packets */
+    if ( (status = av_packet_ref(&ref, pkt)) == 0 ) {
+
+      qpkt = ccfifo_push(&sink->pq, NULL);
+      av_packet_move_ref(qpkt, &ref);
+
+      if ( (sink->stats.queueSize = ccfifo_size(&sink->pq)) > sink->stats.queueMax ) {
+        sink->stats.queueMax = sink->stats.queueSize;
+      }
+
+      sink_signal(sink);
+    }
+  }
+
+  sink_unlock(sink);
+
+  return status;
+}
+
+int output_sink_set_streams(output_sink * sink, const AVCodecParameters * const * codecpar, const AVRational * time_base, int nb_streams)
+{
+  int status = 0;
+
+  if ( nb_streams < 1 || nb_streams > OUTPUT_SINK_MAX_STREAMS ) {
+    return AVERROR(EINVAL);
+  }
+
+  sink_lock(sink);
+
+  if ( sink->nb_streams ) {
+    status = AVERROR(EALREADY);
+    goto end;
+  }
+
+  for ( int i = 0; i < nb_streams; ++i ) {
+
+    if ( !(sink->codecpar[i] = avcodec_parameters_alloc()) ) {
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+
+    if ( (status = avcodec_parameters_copy(sink->codecpar[i], codecpar[i])) < 0 ) {
+      goto end;
+    }
+
+    sink->time_base[i] = time_base[i];
+  }
+
+  for ( int i = 0; i < nb_streams; ++i ) {
+    if ( sink->codecpar[i]->codec_type == AVMEDIA_TYPE_VIDEO ) {
+      sink->vstidx = i;
+      break;
+    }
+  }
+
+  sink->nb_streams = nb_streams;
+  sink_signal(sink);
+
+end:
+
+  if ( status < 0 ) {
+    for ( int i = 0; i < nb_streams; ++i ) {
+      avcodec_parameters_free(&sink->codecpar[i]);
+    }
+  }
+
+  sink_unlock(sink);
+
+  return status < 0 ? status : 0;
+}
+
+void output_sink_get_stats(output_sink * sink, struct output_sink_stats * stats)
+{
+  sink_lock(sink);
+  *stats = sink->stats;
+  stats->stall_max_ms = (int) (sink->stall_max / 1000);
+  sink_unlock(sink);
+
+  stats->stall_p50_ms = (int) (cchist_percentile(&sink->stall_hist, 0.50) / 1000);
+  stats->stall_p99_ms = (int) (cchist_percentile(&sink->stall_hist, 0.99) / 1000);
+}
+
+const char * output_sink_url(const output_sink * sink)
+{
+  return sink->url;
+}
+
+int output_sink_index(const output_sink * sink)
+{
+  return sink->index;
+}
+
+bool output_sink_has_spool(const output_sink * sink)
+{
+  return sink->spool_dir != NULL;
+}
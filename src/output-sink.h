@@ -0,0 +1,138 @@
+/*
+ * output-sink.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Single destination of encoded stream: own writer thread, own packet backlog, own reconnect.
+ */
+
+#pragma once
+
+#ifndef __output_sink_h__
+#define __output_sink_h__
+
+#include "ffmpeg.h"
+#include "ffio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct output_sink
+  output_sink;
+
+/* [ms] blocking output operation which takes longer is counted as stall */
+#define OUTPUT_SINK_STALL_THRESHOLD   50
+
+typedef
+enum output_sink_state {
+  output_sink_idle = 0,
+  output_sink_connecting = 1,
+  output_sink_established = 2,
+  output_sink_paused = 3,       /* waiting to reconnect */
+  output_sink_failed = 4,       /* not recoverable, the sink thread has finished */
+} output_sink_state;
+
+
+typedef
+struct output_sink_callback {
+  /* called from sink thread, sink lock is not held */
+  void (*state_changed)(void * cookie, output_sink * sink, output_sink_state state, int status);
+  /* called from sink thread after the packet has been written to the output, pts in time base of
+   * output_sink_set_streams(), optional */
+  void (*packet_sent)(void * cookie, output_sink * sink, int stream_index, int64_t pts);
+} output_sink_callback;
+
+
+typedef
+struct create_output_sink_args {
+  const char * url;
+  AVOutputFormat * oformat;
+  int index;
+
+  /* encoded streams: codec parameters and the time base of packets passed to output_sink_push(),
+   *  nb_streams = 0 if not known yet, see output_sink_set_streams() */
+  const AVCodecParameters * const * codecpar;
+  const AVRational * time_base;
+  int nb_streams;
+
+  int backlog;                  /* max packets queued, on overflow the backlog is flushed */
+  int max_interleave_delay;     /* [ms] max time a packet may wait for packets of other streams, 0 = default 100 */
+  /* reconnect with exponential backoff: first retry is immediate, then reconnect_delay * 2^n up to reconnect_max */
+  int reconnect_delay;          /* [ms] */
+  int reconnect_max;            /* [ms] */
+
+  /* store-and-forward: while not connected packets go to on-disk ring in spool_dir */
+  const char * spool_dir;       /* NULL disables spooling */
+  int64_t spool_size;           /* [bytes] */
+  int spool_segments;
+  int spool_rate;               /* [kbit/s] cap of catch-up rate when draining the spool, 0 = unlimited */
+
+  /* tcp:// and udp:// outputs are written by own socket writer, see ffio.h */
+  ffio_params io;
+  bool ffmpeg_io;               /* open all outputs by avio_open2() */
+
+  /* time budgets of blocking output operations [ms], 0 = default, -1 = no limit.
+   *  Exceeded budget aborts the operation with AVERROR_STALLED and the sink reconnects */
+  int connect_timeout;          /* dns, connect, handshakes, default 5000 */
+  int header_timeout;           /* muxer header, default 5000 */
+  int write_timeout;            /* one packet including flush, default 2000 */
+
+  output_sink_callback callback;
+  void * cookie;
+} create_output_sink_args;
+
+
+struct output_sink_stats {
+  int64_t framesSent, bytesSent;
+  int queueSize, queueCapacity, queueMax;
+  double write_ms;              /* smoothed write duration */
+  double interleave_ms;         /* smoothed time packets spend in interleaver (stream time) */
+  int drops;                    /* packets dropped on backlog overflow or while waiting for key frame */
+  int reconnects;
+  int recover_ms;               /* time from link loss to established connection, last reconnect */
+  int64_t first_packet_time;    /* ffmpeg_gettime_ms() of the first packet written */
+  int64_t spoolBytes;           /* on-disk backlog */
+  int spoolPackets;
+  int spoolDrops;               /* packets evicted from full spool */
+  int64_t ioCalls;              /* socket syscalls of own socket writer */
+  /* output operations blocked longer than OUTPUT_SINK_STALL_THRESHOLD, aborted on exceeded budget,
+   *  stall durations [ms] */
+  int stalls, timeouts;
+  int stall_p50_ms, stall_p99_ms, stall_max_ms;
+  output_sink_state state;
+};
+
+
+output_sink * create_output_sink(const create_output_sink_args * args);
+
+/**
+ * Describe encoded streams if they were not known at create_output_sink().
+ *  The sink connects to the server immediately and waits for this call to write the header.
+ */
+int output_sink_set_streams(output_sink * sink, const AVCodecParameters * const * codecpar,
+    const AVRational * time_base, int nb_streams);
+
+/* stops writer thread: if connected, queued packets are written and the trailer is written,
+ *  each of the two within write_timeout; a connect in progress is aborted */
+void destroy_output_sink(output_sink ** sink);
+
+/* Queue packet for writing, never blocks on network or disk: spooled packets are written
+ *  by the sink's spooler thread. The sink takes own reference to pkt data */
+int output_sink_push(output_sink * sink, const AVPacket * pkt);
+
+void output_sink_get_stats(output_sink * sink, struct output_sink_stats * stats);
+
+const char * output_sink_url(const output_sink * sink);
+int output_sink_index(const output_sink * sink);
+/* packets are spooled while the sink is not established */
+bool output_sink_has_spool(const output_sink * sink);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __output_sink_h__ */
@@ -0,0 +1,96 @@
+/*
+ * pktpool.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include "pktpool.h"
+#include "debug.h"
+
+
+static int pktpool_class(int64_t size)
+{
+  int c = 0;
+
+  while ( c < PKTPOOL_CLASSES - 1 && PKTPOOL_SIZE(c) < size ) {
+    ++c;
+  }
+
+  return c;
+}
+
+
+void pktpool_init(pktpool * pp, int max_packet_size, int window)
+{
+  memset(pp, 0, sizeof(*pp));
+
+  pp->maxclass = pktpool_class(max_packet_size);
+  pp->window = FFMAX(window, 1);
+}
+
+
+void pktpool_cleanup(pktpool * pp)
+{
+  for ( int c = 0; c < PKTPOOL_CLASSES; ++c ) {
+    av_buffer_pool_uninit(&pp->pools[c]);
+  }
+}
+
+
+int pktpool_get(pktpool * pp, AVPacket * pkt, bool worst_case)
+{
+  const int peak = FFMAX(pp->peak[0], pp->peak[1]);
+  AVBufferRef * buf;
+  int c;
+
+  /* nothing seen yet: the first packet is a key frame */
+  c = worst_case || !peak ? pp->maxclass : FFMIN(pktpool_class(2 * (int64_t) peak), pp->maxclass);
+
+  if ( !pp->pools[c] && !(pp->pools[c] = av_buffer_pool_init(PKTPOOL_SIZE(c) + AV_INPUT_BUFFER_PADDING_SIZE,
+      av_buffer_allocz)) ) {
+    PERROR("av_buffer_pool_init(%d) fails", PKTPOOL_SIZE(c));
+    return AVERROR(ENOMEM);
+  }
+
+  if ( !(buf = av_buffer_pool_get(pp->pools[c])) ) {
+    PERROR("av_buffer_pool_get(%d) fails", PKTPOOL_SIZE(c));
+    return AVERROR(ENOMEM);
+  }
+
+  av_init_packet(pkt);
+  pkt->buf = buf;
+  pkt->data = buf->data;
+  pkt->size = PKTPOOL_SIZE(c);
+
+  pp->lastclass = c;
+
+  return 0;
+}
+
+
+void pktpool_update(pktpool * pp, int size)
+{
+  if ( size > pp->peak[0] ) {
+    pp->peak[0] = size;
+  }
+
+  if ( ++pp->npkts >= pp->window ) {
+    pp->peak[1] = pp->peak[0];
+    pp->peak[0] = 0;
+    pp->npkts = 0;
+  }
+}
+
+
+bool pktpool_miss(pktpool * pp)
+{
+  if ( pp->lastclass >= pp->maxclass ) {
+    return false;
+  }
+
+  pp->peak[0] = PKTPOOL_SIZE(pp->maxclass);
+  pp->npkts = 0;
+
+  return true;
+}
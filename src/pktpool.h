@@ -0,0 +1,68 @@
+/*
+ * pktpool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Encoder output buffers from AVBufferPool in power of two size classes.
+ *  Encoder writes packet straight into the buffer given by pktpool_get(), sinks share it
+ *  by reference and the last av_packet_unref() returns it to the pool, so steady state
+ *  encoding makes no malloc() and free() per packet.
+ *  The class is chosen from the largest packet of last two windows with 2x headroom.
+ *  Not thread safe except buffer release, one pool per encoder.
+ */
+
+#pragma once
+
+#ifndef __pktpool_h__
+#define __pktpool_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PKTPOOL_MIN_BITS    12    /* 4 KiB */
+#define PKTPOOL_CLASSES     14    /* up to 32 MiB */
+#define PKTPOOL_SIZE(c)     (1 << (PKTPOOL_MIN_BITS + (c)))
+
+typedef
+struct pktpool {
+  AVBufferPool * pools[PKTPOOL_CLASSES];
+  int maxclass;         /* fits worst case packet */
+  int window;           /* [packets] */
+  int npkts;            /* in current window */
+  int peak[2];          /* largest packet of current and previous window */
+  int lastclass;        /* of buffer given by last pktpool_get() */
+} pktpool;
+
+
+/* max_packet_size: worst case packet, window: packets to remember peak size for, a GOP or more */
+void pktpool_init(pktpool * pp, int max_packet_size, int window);
+
+/* buffers still referenced by sinks are freed when released */
+void pktpool_cleanup(pktpool * pp);
+
+/**
+ * Attach pool buffer to blank pkt before encode call.
+ *  worst_case is for packets expected to be far above recent sizes, like forced key frames.
+ */
+int pktpool_get(pktpool * pp, AVPacket * pkt, bool worst_case);
+
+/* account size of encoded packet */
+void pktpool_update(pktpool * pp, int size);
+
+/**
+ * Encoder has failed with buffer from last pktpool_get().
+ *  Returns true if the buffer was below worst case, then next window gets worst case
+ *  buffers and the caller should drop the frame instead of failing the stream.
+ */
+bool pktpool_miss(pktpool * pp);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __pktpool_h__ */
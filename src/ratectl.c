@@ -0,0 +1,141 @@
+/*
+ * ratectl.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Decrease target on congestion (queue grows or writes stall) down to measured throughput,
+ *  probe upwards slowly after congestion-free period. Hold times give the hysteresis
+ *  so the encoder is not reconfigured on every noisy sample.
+ */
+
+#include "ratectl.h"
+#include "debug.h"
+#include <string.h>
+
+
+void ratectl_init(ratectl * rc, const ratectl_params * p)
+{
+  memset(rc, 0, sizeof(*rc));
+
+  rc->p = *p;
+
+  if ( rc->p.max_bitrate <= 0 ) {
+    rc->p.max_bitrate = rc->p.start_bitrate;
+  }
+  if ( rc->p.min_bitrate <= 0 ) {
+    rc->p.min_bitrate = rc->p.max_bitrate / 4;
+  }
+  if ( rc->p.min_bitrate > rc->p.max_bitrate ) {
+    rc->p.min_bitrate = rc->p.max_bitrate;
+  }
+  if ( rc->p.sample_ms <= 0 ) {
+    rc->p.sample_ms = 250;
+  }
+  if ( rc->p.down_hold_ms <= 0 ) {
+    rc->p.down_hold_ms = 1000;
+  }
+  if ( rc->p.up_hold_ms <= 0 ) {
+    rc->p.up_hold_ms = 5000;
+  }
+  if ( rc->p.max_write_ms <= 0 ) {
+    rc->p.max_write_ms = 200;
+  }
+  if ( rc->p.qhigh <= 0 ) {
+    rc->p.qhigh = 0.1;
+  }
+  if ( rc->p.qlow <= 0 || rc->p.qlow >= rc->p.qhigh ) {
+    rc->p.qlow = rc->p.qhigh / 4;
+  }
+  if ( rc->p.down_factor <= 0 || rc->p.down_factor >= 1 ) {
+    rc->p.down_factor = 0.7;
+  }
+  if ( rc->p.up_factor <= 1 ) {
+    rc->p.up_factor = 1.1;
+  }
+
+  rc->bitrate = rc->p.start_bitrate;
+  if ( rc->bitrate > rc->p.max_bitrate ) {
+    rc->bitrate = rc->p.max_bitrate;
+  }
+  if ( rc->bitrate < rc->p.min_bitrate ) {
+    rc->bitrate = rc->p.min_bitrate;
+  }
+}
+
+bool ratectl_update(ratectl * rc, int64_t now_ms, double qfill, double write_ms, int64_t bytes_sent)
+{
+  int64_t dt;
+  double rate;
+  int bitrate;
+  bool congested, clear;
+
+  if ( !rc->last_sample ) {
+    rc->last_sample = rc->last_change = rc->clear_since = now_ms;
+    rc->last_bytes = bytes_sent;
+    return false;
+  }
+
+  if ( (dt = now_ms - rc->last_sample) < rc->p.sample_ms ) {
+    return false;
+  }
+
+  rate = (bytes_sent - rc->last_bytes) * 8000.0 / dt;
+  rc->throughput = rc->throughput > 0 ? 0.7 * rc->throughput + 0.3 * rate : rate;
+  rc->last_bytes = bytes_sent;
+  rc->last_sample = now_ms;
+
+  congested = qfill >= rc->p.qhigh || write_ms >= rc->p.max_write_ms;
+  clear = qfill <= rc->p.qlow && write_ms < rc->p.max_write_ms / 2;
+
+  bitrate = rc->bitrate;
+  rc->decision = ratectl_steady;
+
+  if ( congested ) {
+
+    rc->clear_since = 0;
+
+    if ( now_ms - rc->last_change >= rc->p.down_hold_ms ) {
+      bitrate = (int) (rc->bitrate * rc->p.down_factor);
+      /* don't stay above what the link actually delivers */
+      if ( rc->throughput > 0 && bitrate > 0.9 * rc->throughput ) {
+        bitrate = (int) (0.9 * rc->throughput);
+      }
+      if ( bitrate < rc->p.min_bitrate ) {
+        bitrate = rc->p.min_bitrate;
+      }
+    }
+  }
+  else if ( !clear ) {
+    rc->clear_since = 0;
+  }
+  else if ( !rc->clear_since ) {
+    rc->clear_since = now_ms;
+  }
+  else if ( now_ms - rc->clear_since >= rc->p.up_hold_ms && now_ms - rc->last_change >= rc->p.up_hold_ms ) {
+    if ( (bitrate = (int) (rc->bitrate * rc->p.up_factor)) > rc->p.max_bitrate ) {
+      bitrate = rc->p.max_bitrate;
+    }
+    rc->clear_since = now_ms;
+  }
+
+  if ( bitrate == rc->bitrate ) {
+    return false;
+  }
+
+  if ( bitrate < rc->bitrate ) {
+    rc->decision = ratectl_decrease;
+    ++rc->decreases;
+  }
+  else {
+    rc->decision = ratectl_increase;
+    ++rc->increases;
+  }
+
+  PDBG("ratectl: %d -> %d bps: qfill=%g write_ms=%g throughput=%g", rc->bitrate, bitrate, qfill, write_ms, rc->throughput);
+
+  rc->bitrate = bitrate;
+  rc->last_change = now_ms;
+
+  return true;
+}
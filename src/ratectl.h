@@ -0,0 +1,73 @@
+/*
+ * ratectl.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Closed-loop video bitrate controller driven by the network writer backlog
+ */
+
+#pragma once
+
+#ifndef __ratectl_h__
+#define __ratectl_h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+enum ratectl_decision {
+  ratectl_steady = 0,
+  ratectl_decrease = 1,
+  ratectl_increase = 2,
+} ratectl_decision;
+
+
+typedef
+struct ratectl_params {
+  int min_bitrate, max_bitrate; /* [bps] */
+  int start_bitrate;            /* [bps] */
+  int sample_ms;                /* decision interval */
+  int down_hold_ms;             /* min interval between change and next decrease */
+  int up_hold_ms;               /* time without congestion required before increase */
+  int max_write_ms;             /* smoothed write latency treated as congestion */
+  double qhigh, qlow;           /* send queue fill thresholds, 0..1 */
+  double down_factor;           /* multiplicative decrease */
+  double up_factor;             /* multiplicative increase */
+} ratectl_params;
+
+
+typedef
+struct ratectl {
+  ratectl_params p;
+
+  int bitrate;                  /* current target [bps] */
+  double throughput;            /* smoothed measured output rate [bps] */
+  ratectl_decision decision;    /* last decision */
+  int decreases, increases;
+
+  int64_t last_sample, last_change, clear_since;
+  int64_t last_bytes;
+} ratectl;
+
+
+/** Fill missing params with defaults relative to start_bitrate */
+void ratectl_init(ratectl * rc, const ratectl_params * p);
+
+/**
+ * Feed one sample, returns true when target bitrate was changed.
+ *  qfill: send queue fill 0..1, write_ms: smoothed write latency, bytes_sent: total bytes written so far
+ */
+bool ratectl_update(ratectl * rc, int64_t now_ms, double qfill, double write_ms, int64_t bytes_sent);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ratectl_h__ */
@@ -8,16 +8,38 @@
 #include "ffmpeg.h"
 #include "pthread_wait.h"
 #include "cclist.h"
-#include "opensless-audio.h"
-#include "ffplay-java-api.h"
+#include "ccring.h"
+#include "frmarena.h"
+#include "campixfmt.h"
+#include "pktpool.h"
+#include "motion.h"
+#include "cchist.h"
+#include "capture.h"
+#include "caprec.h"
+#ifdef __ANDROID__
+# include "ffplay-java-api.h"
+#endif
+#include "yuvconv.h"
+#include "slicepool.h"
+#include "ratectl.h"
+#include "output-sink.h"
+#include "mediaclock.h"
+#include "audioconv.h"
 #include "debug.h"
 #include <endian.h>
+#include <sys/resource.h>
+
+#ifndef RUSAGE_THREAD
+# define RUSAGE_THREAD            1       /* linux, glibc hides it without _GNU_SOURCE */
+#endif
 
 #define AUDIO_CAPTURE_BUFFERS     4
 #define AUDIO_SAMPLE_SIZE         2
 
-//#define AUDIO_SAMPLE_RATE         16000    /* [Hz] */
-//#define AUDIO_SAMPLE_RATE         8000    /* [Hz] */
+/* Capture runs at device native rate, the encoder rate is selected by codec, see audioconv */
+#define AUDIO_CAPTURE_RATE        48000   /* [Hz], -capture_rate */
+#define AUDIO_CAPTURE_BUFFER      20      /* [ms], -capture_buffer */
+#define AUDIO_WAKEUP_MAX          500     /* [ms], max -audio_wakeup */
 #define AUDIO_SAMPLE_FMT          AV_SAMPLE_FMT_S16P
 
 //#define VIDEO_POLL_SIZE           3
@@ -26,6 +48,15 @@
 
 #define VIDEO_CODEC_TIME_BASE     (AVRational){1,1000}
 
+/* Default age of queued video frame after which it is not encoded, ff_drop_deadline policy */
+#define DEFAULT_DROP_DEADLINE     1000    /* [ms] */
+
+/* Default backlog of encoded packets per output, -backlog */
+#define OUTPUT_PACKET_QUEUE_SIZE  256
+
+/* Max number of '|' separated outputs in server url */
+#define MAX_OUTPUT_SINKS          4
+
 
 #define X264_CODEC_NAME           "libx264"
 #define H263p_CODEC_NAME          "h263p"
@@ -37,6 +68,45 @@
 
 #define NOCODEC_NAME              "none"
 
+
+/* Camera frame -> encoder input frame conversion */
+enum video_conversion {
+  video_conversion_sws,     /* sws_scale() */
+  video_conversion_none,    /* encoder accepts camera frames directly */
+  video_conversion_swapuv,  /* NV21 <-> NV12 chroma swap in place */
+  video_conversion_splituv, /* NV21/NV12 -> YUV420P, luma is passed through */
+  video_conversion_yuyv,    /* YUY2 -> YUV420P, chroma of row pairs is averaged */
+};
+
+/* Adaptive bitrate: what the controller retunes in running x264 encoder */
+enum rate_control_mode {
+  rate_control_none,
+  rate_control_vbv,         /* bit_rate, rc_max_rate, rc_buffer_size */
+  rate_control_qp,          /* constant qp */
+};
+
+/* Horizontal band of the frame converted by own SwsContext */
+struct sws_slice {
+  struct SwsContext * sws;
+  int sy, sh;   /* source rows of the band with the overlap for vertical filter */
+  int dy, dh;   /* destination rows of the band */
+  int ty;       /* first band row in scaled rows */
+  uint8_t * buf[4]; /* scaled rows with overlap, NULL if the band is scaled directly into destination */
+  int buflinesize[4];
+};
+
+/* Conversion of single camera frame, shared by slice workers */
+struct video_conversion_job {
+  enum video_conversion mode;
+  const yuvconv_kernels * yuvk;
+  enum AVPixelFormat srcfmt;
+  int cx, cy;
+  uint8_t * src[4];
+  int srclinesize[4];
+  AVFrame * dst;
+  struct sws_slice * slices;
+};
+
 struct ff_output_stream {
 
   char * server;
@@ -45,16 +115,28 @@ struct ff_output_stream {
 
   char * video_codec;
   int cx, cy;
-  enum AVPixelFormat input_pixfmt;
+  int ocx, ocy;
+  const campixfmt * camfmt;
+  enum AVPixelFormat input_pixfmt;    /* camfmt as ffmpeg sees it */
+  size_t frame_size;                  /* camera frame bytes */
   int vquality;
   int vbitrate;
   int vbufs;
   int gopsize;
+  int threads;
+
+  /* adaptive bitrate */
+  enum rate_control_mode rcmode;
+  ratectl_params rcparams;
+  ratectl rc;
+  int rcvbv;        /* vbv buffer duration [ms] */
+  int rcbaseqp;
 
   char * audio_codec;
-  int audio_sample_rate;
-  size_t audio_samples_per_buffer;
+  int audio_sample_rate;              /* capture rate */
+  size_t audio_samples_per_buffer;    /* capture buffer */
   size_t audio_bytes_per_buffer;
+  int audio_wakeup_batch;             /* captured buffers which wake up parked encoder */
   int aquality;
   int abitrate;
   int abufs;
@@ -62,29 +144,66 @@ struct ff_output_stream {
   ff_output_stream_event_callback events_callback;
   void * cookie;
 
-  opensless_audio_capture * capdev;
-  int16_t * capbufs;
+  capture_source * capdev;
+  struct frm * capfrms[AUDIO_CAPTURE_BUFFERS];  /* pool frames lent to capture buffer queue */
 
   pthread_t pid;
   pthread_wait_t lock;
 
-  int64_t firstpts;
-  int64_t atime;
-  struct ccfifo ap, vp, q;
-  size_t output_fifo_size;
+  mediaclock clock;
+
+  caprec * recorder;      /* -record: raw capture input for replay, written by producers */
+
+  /* Lock-free frame rings, each one has single producer and single consumer thread:
+   *  vp: encoder -> camera,  vq: camera -> encoder,
+   *  ap: encoder -> audio,   aq: audio -> encoder,
+   *  vo: camera -> encoder.
+   * Pools, rings and arenas are created by first output_loop() run and kept until destroy_output_stream() */
+  frmarena va, aa;        /* pool frames memory */
+  ccring ap, vp;          /* free frame pools */
+  ccring aq, vq;          /* captured frames waiting for encoder */
+  ccring vo;              /* frames the camera gave back while the stream was not accepting */
+  ccwake wake;            /* wakes parked encoder */
+  int nwakeups;           /* encoder thread only */
+  atomic_bool accepting;  /* rings are ready for producers */
+  atomic_int producers;   /* producers currently touching the rings */
+
+  /* video frame drop policy */
+  enum ff_drop_policy drop_policy;
+  int drop_deadline;
+
+  /* encoder -> outputs, each one with own writer thread */
+  output_sink * sinks[MAX_OUTPUT_SINKS];
+  output_sink_state sink_states[MAX_OUTPUT_SINKS];
+  int nsinks;
+  int sink_status;          /* error of last failed output */
+  int wstatus;              /* set when all outputs have failed */
+  bool sinks_changed:1;     /* sink state changed, encoder thread updates stream state */
+  bool idr_request;         /* output (re)connected and needs a key frame, set under ctx_lock() */
+  bool idr_pending;         /* encoder thread only */
+  atomic_bool ctl_pending;  /* sinks_changed or idr_request is set, encoder skips ctx_lock() otherwise */
+  int reconnect_delay, reconnect_max;
+  int64_t start_time;       /* output_loop() start, ffmpeg_gettime_ms() */
+
+  /* capture to wire latency of video frames on primary output [us], written by its sink thread */
+  cchist latency;
+  atomic_int latency_stidx;
+
+  int64_t io_calls_mark;    /* stats poller */
 
   ff_output_stream_state state;
   int status, reason;
-  bool interrupted:1;
+  atomic_bool interrupted;
 
   struct output_stream_stats stats;
 };
 
 
 // defined below
-static void audio_capture_callback(void * cookie, void * bfr, size_t size);
-static bool start_audio_capture(ff_output_stream * ff);
+static void audio_capture_callback(void * cookie, void * bfr, size_t size, int64_t capture_time);
+static bool start_audio_capture(ff_output_stream * ff, const AVDictionary * opts);
 static void stop_audio_capture(ff_output_stream * ff);
+static void release_frame(ccring * pool, struct frm * frm);
 
 
 static void ctx_lock(ff_output_stream * ctx) {
@@ -103,11 +222,6 @@ static void ctx_signal(ff_output_stream * ctx) {
   pthread_wait_broadcast(&ctx->lock);
 }
 
-static int output_stream_interrupt_callback(void * arg) {
-  return ((ff_output_stream * )arg)->interrupted;
-}
-
-
 static void set_stream_state(ff_output_stream * ctx, ff_output_stream_state state, int reason, bool lock)
 {
   if ( lock ) {
@@ -131,26 +245,52 @@ static void set_stream_state(ff_output_stream * ctx, ff_output_stream_state stat
   }
 }
 
-static bool is_ioerror(int status)
+
+
+
+/*
+ * Prefer encoder input format which allows to feed the camera frames into encoder without sws_scale():
+ *  the camera format itself, the semi-planar format with swapped chroma (NV21 <-> NV12),
+ *  or YUV420P for YUY2 which has own conversion kernel
+ */
+static enum AVPixelFormat select_video_codec_pixfmt(const AVCodec * codec, enum AVPixelFormat input_pixfmt)
 {
-  switch ( status ) {
-    case AVERROR(EIO) :
-      case AVERROR(EREMOTEIO) :
-      case AVERROR(ETIMEDOUT) :
-      case AVERROR(EPIPE) :
-      case AVERROR(ENETDOWN) :
-      case AVERROR(ENETUNREACH) :
-      case AVERROR(ENETRESET) :
-      case AVERROR(ECONNREFUSED) :
-      case AVERROR(ECONNRESET) :
-      case AVERROR(ECONNABORTED) :
-      // case AVERROR(EHOSTUNREACH):
-      return true;
-  }
-  return false;
-}
+  enum AVPixelFormat swapped_pixfmt = AV_PIX_FMT_NONE;
 
+  if ( !codec->pix_fmts ) {
+    return input_pixfmt;
+  }
 
+  switch ( input_pixfmt ) {
+    case AV_PIX_FMT_NV21 :
+      swapped_pixfmt = AV_PIX_FMT_NV12;
+    break;
+    case AV_PIX_FMT_NV12 :
+      swapped_pixfmt = AV_PIX_FMT_NV21;
+    break;
+    case AV_PIX_FMT_YUYV422 :
+      swapped_pixfmt = AV_PIX_FMT_YUV420P;
+    break;
+    default :
+    break;
+  }
+
+  for ( int i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; ++i ) {
+    if ( codec->pix_fmts[i] == input_pixfmt ) {
+      return input_pixfmt;
+    }
+  }
+
+  if ( swapped_pixfmt != AV_PIX_FMT_NONE ) {
+    for ( int i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; ++i ) {
+      if ( codec->pix_fmts[i] == swapped_pixfmt ) {
+        return swapped_pixfmt;
+      }
+    }
+  }
+
+  return codec->pix_fmts[0];
+}
 
 static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, const AVDictionary * opts)
 {
@@ -158,6 +298,7 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
   const AVCodec * codec = NULL;
 
   enum AVPixelFormat cpixfmt;
+  int width, height;
   int bitrate, gop_size, quality;
   int qmin = 1, qmax = 31, q;
 
@@ -185,7 +326,7 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
 
 
   if ( !(e = av_dict_get(opts, "-pix_fmt", NULL, 0)) ) {
-    cpixfmt = codec->pix_fmts ? codec->pix_fmts[0] : ff->input_pixfmt;
+    cpixfmt = select_video_codec_pixfmt(codec, ff->input_pixfmt);
     PDBG("PIXFMT %d SELECTED", cpixfmt);
   }
   else if ( (cpixfmt = av_get_pix_fmt(e->value)) == AV_PIX_FMT_NONE ) {
@@ -194,6 +335,26 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
     goto end;
   }
 
+  if ( (e = av_dict_get(opts, "-s", NULL, 0)) ) {
+    if ( av_parse_video_size(&width, &height, e->value) < 0 || width < 2 || height < 2 ) {
+      PDBG("Bad output frame size specified: %s", e->value);
+      status = AVERROR(EINVAL);
+      goto end;
+    }
+  }
+  else if ( ff->ocx > 1 && ff->ocy > 1 ) {
+    width = ff->ocx;
+    height = ff->ocy;
+  }
+  else {
+    width = ff->cx;
+    height = ff->cy;
+  }
+
+  // 4:2:0 chroma
+  width &= ~1;
+  height &= ~1;
+
   if ( (e = av_dict_get(opts, "-b:v", NULL, 0)) ) {
     if ( (bitrate = (int) av_strtod(e->value, NULL)) < 1000 ) {
       PDBG("Bad output bitrate specified: %s", e->value);
@@ -231,6 +392,8 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
     av_dict_set(&codec_opts, "tune", "zerolatency", 0);
     av_dict_set(&codec_opts, "rc-lookahead", "3", 0);
     av_dict_set(&codec_opts, "profile", "Main", 0);
+    // forced key frames on output reconnects must be IDR, not just I
+    av_dict_set(&codec_opts, "forced-idr", "1", 0);
   }
 
   if ( (status = ffmpeg_filter_codec_opts(opts, codec, AV_OPT_FLAG_ENCODING_PARAM, &codec_opts)) ) {
@@ -241,8 +404,16 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
   quality = ff->vquality > 0 && ff->vquality <= 100 ? ff->vquality : 50;
 
 
+  if ( ff->rcmode != rate_control_none && strcmp(codec->name, "libx264") != 0 ) {
+    PERROR("Adaptive bitrate is supported for libx264 only, disabled for %s", codec->name);
+    ff->rcmode = rate_control_none;
+  }
+
   if ( strcmp(codec->name, "libx264") == 0 ) {
-    if ( !av_dict_get(opts, "-crf", NULL, 0) && !av_dict_get(opts, "-qp", NULL, 0) ) {
+    if ( ff->rcmode == rate_control_vbv ) {
+      /* bitrate mode, constrained by vbv below */
+    }
+    else if ( !av_dict_get(opts, "-crf", NULL, 0) && !av_dict_get(opts, "-qp", NULL, 0) ) {
       if ( (q = (100 - quality) * 50 / 100 + 10) > 51 ) {
         q = 51;
       }
@@ -277,8 +448,8 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
 
   (*cctx)->time_base = VIDEO_CODEC_TIME_BASE;
   (*cctx)->pix_fmt = cpixfmt;
-  (*cctx)->width = ff->cx;
-  (*cctx)->height = ff->cy;
+  (*cctx)->width = width;
+  (*cctx)->height = height;
   (*cctx)->bit_rate = bitrate;
   (*cctx)->gop_size = gop_size;
   (*cctx)->me_range = 1;
@@ -286,6 +457,11 @@ static int create_video_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
   (*cctx)->qmin = qmin;
   (*cctx)->qmax = qmax;
 
+  if ( ff->rcmode == rate_control_vbv ) {
+    (*cctx)->rc_max_rate = bitrate;
+    (*cctx)->rc_buffer_size = (int) ((int64_t) bitrate * ff->rcvbv / 1000);
+  }
+
   if ( (status = avcodec_open2(*cctx, codec, &codec_opts)) ) {
     PDBG("avcodec_open2('%s') fails: %s", codec->name, av_err2str(status));
     goto end;
@@ -298,7 +474,8 @@ end:
   return status;
 }
 
-static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, const AVDictionary * opts)
+static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, const AVDictionary * opts,
+    const AVOutputFormat * oformat)
 {
   const char * codec_name = NULL;
   const AVCodec * codec = NULL;
@@ -306,6 +483,7 @@ static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
   AVDictionary * codec_opts = NULL;
   AVDictionaryEntry * e = NULL;
   int q = 0, bitrate = 0;
+  int sample_rate, sample_fmt, ms;
 
   int status = 0;
 
@@ -331,9 +509,33 @@ static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
     goto end;
   }
 
-  if ( strcmp(codec->name, MP3_CODEC_NAME) == 0 ) {
+  /* capture side: native device rate and short buffers, independent on encoder frame size */
+  if ( (e = av_dict_get(opts, "-capture_rate", NULL, 0)) ) {
+    ff->audio_sample_rate = atoi(e->value);
+  }
+  if ( ff->audio_sample_rate < 8000 || ff->audio_sample_rate > 192000 ) {
+    ff->audio_sample_rate = AUDIO_CAPTURE_RATE;
+  }
+
+  if ( !(e = av_dict_get(opts, "-capture_buffer", NULL, 0)) || (ms = atoi(e->value)) < 5 || ms > 200 ) {
+    ms = AUDIO_CAPTURE_BUFFER;
+  }
+
+  ff->audio_samples_per_buffer = ff->audio_sample_rate * ms / 1000;
+  ff->audio_bytes_per_buffer = ff->audio_samples_per_buffer * AUDIO_SAMPLE_SIZE;
+
+  /* encoder side: the nearest rate the codec and muxer can take, -ar overrides */
+  if ( !(e = av_dict_get(opts, "-ar", NULL, 0)) || (sample_rate = atoi(e->value)) <= 0 ) {
+    sample_rate = ff->audio_sample_rate;
+  }
+
+  sample_rate = ffmpeg_select_samplerate(codec, oformat, sample_rate);
+
+  if ( (sample_fmt = ffmpeg_select_best_format((const int *) codec->sample_fmts, AUDIO_SAMPLE_FMT)) < 0 ) {
+    sample_fmt = AUDIO_SAMPLE_FMT;
+  }
 
-    ff->audio_sample_rate = 16000;
+  if ( strcmp(codec->name, MP3_CODEC_NAME) == 0 ) {
 
     // see https://trac.ffmpeg.org/wiki/Encode/MP3
     if ( !av_dict_get(codec_opts, "q", NULL, 0) ) {
@@ -350,12 +552,8 @@ static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
   }
   else if ( strcmp(codec->name, AMRNB_CODEC_NAME) == 0 ) {
     // fixme: prefer codec_opts if available
-    ff->audio_sample_rate = 8000;
     bitrate = ff->abitrate > 1000 ? ff->abitrate : 5150;
   }
-  else {
-    ff->audio_sample_rate = 8000;
-  }
 
   if ( !(*cctx = avcodec_alloc_context3(codec)) ) {
     PDBG("avcodec_alloc_context3('%s') fails", codec->name);
@@ -365,9 +563,9 @@ static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
 
   ///
 
-  (*cctx)->time_base = (AVRational ) { 1, ff->audio_sample_rate };
-  (*cctx)->sample_rate = ff->audio_sample_rate;
-  (*cctx)->sample_fmt = AUDIO_SAMPLE_FMT;
+  (*cctx)->time_base = (AVRational ) { 1, sample_rate };
+  (*cctx)->sample_rate = sample_rate;
+  (*cctx)->sample_fmt = sample_fmt;
   (*cctx)->channels = 1;
   (*cctx)->channel_layout = AV_CH_LAYOUT_MONO;
   (*cctx)->bit_rate = bitrate;
@@ -378,142 +576,954 @@ static int create_audio_codec(AVCodecContext ** cctx, ff_output_stream * ff, con
     goto end;
   }
 
-  if ( (*cctx)->frame_size ) {
-    ff->audio_samples_per_buffer = (*cctx)->frame_size;
-    PDBG("FRAME_SIZE: AUDIO_SAMPLES_PER_BUFFER=%zu", ff->audio_samples_per_buffer);
+  PDBG("CAPTURE: %d Hz %zu samples, ENCODER: %d Hz %s frame_size=%d", ff->audio_sample_rate,
+      ff->audio_samples_per_buffer, sample_rate, av_get_sample_fmt_name(sample_fmt), (*cctx)->frame_size);
+
+end: ;
+
+  return status;
+}
+
+
+/* Capture device is stopped: take lent frames back into the pool */
+static void return_capture_frames(ff_output_stream * ff)
+{
+  for ( int i = 0; i < AUDIO_CAPTURE_BUFFERS; ++i ) {
+    if ( ff->capfrms[i] ) {
+      release_frame(&ff->ap, ff->capfrms[i]);
+      ff->capfrms[i] = NULL;
+    }
   }
-  else {
-    ff->audio_samples_per_buffer = 320;
-    PDBG("MANUAL: AUDIO_SAMPLES_PER_BUFFER=%zu", ff->audio_samples_per_buffer);
+}
+
+/*
+ * Capture backend records directly into pool frames, see audio_capture_callback().
+ *  Called before the callback can run, so popping ff->ap here does not race with it.
+ */
+static bool start_audio_capture(ff_output_stream * ff, const AVDictionary * opts)
+{
+  AVDictionaryEntry * e;
+  const char * backend = NULL;
+  int status = 0;
+
+  capture_params params = {
+    .sample_rate = ff->audio_sample_rate,
+    .nbuffers = AUDIO_CAPTURE_BUFFERS,
+    .callback = audio_capture_callback,
+    .cookie = ff,
+    .freerun = (e = av_dict_get(opts, "-capture_freerun", NULL, 0)) && atoi(e->value),
+  };
+
+  /* default is the first backend compiled in: opensles on android, alsa or pcmfile on host */
+  if ( (e = av_dict_get(opts, "-audio_source", NULL, 0)) ) {
+    backend = e->value;
+  }
+  if ( (e = av_dict_get(opts, "-audio_device", NULL, 0)) ) {
+    params.device = e->value;
   }
 
-  ff->audio_bytes_per_buffer = ff->audio_samples_per_buffer * AUDIO_SAMPLE_SIZE; // fixme here
+  for ( int i = 0; i < AUDIO_CAPTURE_BUFFERS; ++i ) {
+    if ( !(ff->capfrms[i] = ccring_pop(&ff->ap)) ) {
+      PERROR("audio frame pool is too small");
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+  }
 
-end: ;
 
-  return status;
+  /* create capture device */
+  if ( (status = capture_create(&ff->capdev, capture_media_audio, backend, &params)) ) {
+    PERROR("capture_create(%s) fails: %s", backend ? backend : "default", av_err2str(status));
+    goto end;
+  }
+
+  /* Enqueue capture bufers */
+  for ( int i = 0; i < AUDIO_CAPTURE_BUFFERS; ++i ) {
+    if ( (status = capture_enqueue(ff->capdev, ff->capfrms[i]->data, ff->audio_bytes_per_buffer)) != 0 ) {
+      PERROR("capture_enqueue() fails: %s", av_err2str(status));
+      goto end;
+    }
+  }
+
+  /* start audio capture device */
+  if ( (status = capture_start(ff->capdev)) != 0 ) {
+    PERROR("capture_start() fails: %s", av_err2str(status));
+    goto end;
+  }
+
+  PDBG("audio source: %s", capture_name(ff->capdev));
+
+end:
+
+  if ( status ) {
+    capture_destroy(&ff->capdev);
+    return_capture_frames(ff);
+  }
+
+  return status == 0;
 }
 
+static void stop_audio_capture(ff_output_stream * ff)
+{
+  if ( ff->capdev ) {
+    capture_stop(ff->capdev);
+    capture_destroy(&ff->capdev);
+  }
+
+  return_capture_frames(ff);
+}
 
-static int add_stream(AVFormatContext * oc, AVCodecContext * codec)
+/* Return frame into the pool, encoder side */
+static void release_frame(ccring * pool, struct frm * frm)
 {
-  AVStream * os = NULL;
+  /* each arena frame is in one ring at most, so the pool is never full */
+  if ( !ccring_push(pool, frm) ) {
+    PERROR("BUG BUG BUG: frame pool overflow");
+  }
+}
 
+/* Put queued frames back into the pool at the end of output_loop(), no producers active */
+static void drain_frame_queue(ccring * queue, ccring * pool)
+{
+  struct frm * frm;
+
+  while ( (frm = ccring_pop(queue)) ) {
+    release_frame(pool, frm);
+  }
+}
+
+static void destroy_frame_pool(ccring * pool, ccring * queue, frmarena * arena)
+{
+  ccring_cleanup(pool);
+  ccring_cleanup(queue);
+  frmarena_destroy(arena);
+}
+
+/*
+ * Only the first output_loop() run allocates, later runs find the pool filled by previous one.
+ *  Geometry comes from create_output_stream() args and ffopts which do not change between runs,
+ *  so the arena is never replaced while the camera holds its frames.
+ */
+static int create_frame_pool(ccring * pool, ccring * queue, size_t queue_capacity, frmarena * arena,
+    size_t count, size_t datasize, int flags)
+{
   int status = 0;
 
-  if ( !(os = avformat_new_stream(oc, codec->codec)) ) {
-    status = AVERROR(ENOMEM);
+  if ( arena->count == count && arena->datasize == datasize ) {
+    return 0;
+  }
+
+  destroy_frame_pool(pool, queue, arena);
+
+  if ( (status = frmarena_create(arena, count, datasize, flags)) ) {
+    PERROR("frmarena_create(count=%zu size=%zu) fails: %s", count, datasize, av_err2str(status));
     goto end;
   }
 
-  if ( (status = avcodec_parameters_from_context(os->codecpar, codec)) < 0 ) {
-    PDBG("avcodec_parameters_from_context('%s') fails: %s", codec->codec->name, av_err2str(status));
+  if ( !ccring_init(pool, count) || !ccring_init(queue, FFMAX(queue_capacity, 1)) ) {
+    PERROR("ccring_init() fails");
+    status = AVERROR(ENOMEM);
     goto end;
   }
 
-  os->time_base = codec->time_base;
+  for ( size_t i = 0; i < count; ++i ) {
+    ccring_push(pool, &arena->frames[i]);
+  }
+
+  PDBG("frame arena: %zu x %zu bytes%s", count, arena->slotsize, arena->locked ? " locked" : "");
 
-end:;
+end: ;
+
+  if ( status ) {
+    destroy_frame_pool(pool, queue, arena);
+  }
 
   return status;
 }
 
 
+/*
+ * Select the way to convert camera frames into encoder input frames
+ */
+static enum video_conversion select_video_conversion(enum AVPixelFormat srcfmt, int srcw, int srch,
+    enum AVPixelFormat dstfmt, int dstw, int dsth)
+{
+  if ( srcw == dstw && srch == dsth ) {
+
+    if ( srcfmt == dstfmt ) {
+      return video_conversion_none;
+    }
+
+    if ( (srcfmt == AV_PIX_FMT_NV21 && dstfmt == AV_PIX_FMT_NV12) || (srcfmt == AV_PIX_FMT_NV12 && dstfmt == AV_PIX_FMT_NV21) ) {
+      return video_conversion_swapuv;
+    }
+
+    if ( (srcfmt == AV_PIX_FMT_NV21 || srcfmt == AV_PIX_FMT_NV12) && dstfmt == AV_PIX_FMT_YUV420P ) {
+      return video_conversion_splituv;
+    }
+
+    if ( srcfmt == AV_PIX_FMT_YUYV422 && dstfmt == AV_PIX_FMT_YUV420P ) {
+      return video_conversion_yuyv;
+    }
+  }
+
+  return video_conversion_sws;
+}
+
+static void destroy_sws_slices(struct sws_slice ** slices)
+{
+  if ( *slices ) {
+    for ( struct sws_slice * s = *slices; s->sws; ++s ) {
+      sws_freeContext(s->sws);
+      av_freep(&s->buf[0]);
+    }
+    av_freep(slices);
+  }
+}
 
-static bool start_audio_capture(ff_output_stream * ff)
+/*
+ * Split frame into nslices horizontal bands and create SwsContext per band.
+ *  Band borders are placed only where the scale maps even destination rows exactly onto even source rows,
+ *  so every band has the ratio of the whole frame and 4:2:0 chroma rows are not shared between bands.
+ *  A band scales its rows together with the neighbouring rows the vertical filter reads,
+ *  and only its own rows are copied to destination, so no seams appear at the borders.
+ *  Frame sizes without such rows are scaled by single context.
+ */
+static int create_sws_slices(struct sws_slice ** pslices, int nslices,
+    int srcw, int srch, enum AVPixelFormat srcfmt,
+    int dstw, int dsth, enum AVPixelFormat dstfmt)
 {
+  struct sws_slice * slices = NULL;
+  int unit, dunit, sunit, nunits, margin;
   int status = 0;
 
-  if ( (status = opensless_audio_initialize()) != SL_RESULT_SUCCESS ) {
-    PERROR("opensless_audio_initialize() fails: status=0x%0X", status);
+  /* smallest band which maps exactly */
+  unit = (int) av_gcd(srch, dsth);
+  dunit = dsth / unit, sunit = srch / unit;
+  if ( (dunit | sunit) & 1 ) {
+    dunit *= 2, sunit *= 2;
+  }
+  nunits = dsth / dunit;
+
+  if ( nslices > dsth / 16 ) {
+    nslices = dsth / 16;
+  }
+  if ( nslices > nunits ) {
+    nslices = nunits;
+  }
+  if ( nslices < 1 ) {
+    nslices = 1;
+  }
+
+  /* overlap in units: bilinear vertical filter reads up to ratio + 1 rows on each side, twice more for chroma */
+  margin = (2 * ((srch + dsth - 1) / dsth + 1) + sunit - 1) / sunit;
+
+  if ( !(slices = av_mallocz_array(nslices + 1, sizeof(*slices))) ) {
+    status = AVERROR(ENOMEM);
     goto end;
   }
 
-  if ( !(ff->capbufs = av_malloc(AUDIO_CAPTURE_BUFFERS * ff->audio_bytes_per_buffer)) ) {
-    PERROR("av_malloc(AUDIO_CAPTURE_BUFFERS) fails");
-    status = SL_RESULT_MEMORY_FAILURE;
+  for ( int i = 0; i < nslices; ++i ) {
+
+    struct sws_slice * s = &slices[i];
+
+    const int u0 = nunits * i / nslices, u1 = nunits * (i + 1) / nslices;
+    const int e0 = nslices > 1 ? FFMAX(u0 - margin, 0) : 0;
+    const int e1 = nslices > 1 ? FFMIN(u1 + margin, nunits) : nunits;
+
+    /* the last band takes the rows left by odd unit count, they map exactly as well */
+    const int ey = e0 * dunit, eh = (e1 < nunits ? e1 * dunit : dsth) - ey;
+
+    s->dy = u0 * dunit;
+    s->dh = (u1 < nunits ? u1 * dunit : dsth) - s->dy;
+    s->ty = s->dy - ey;
+    s->sy = e0 * sunit;
+    s->sh = (e1 < nunits ? e1 * sunit : srch) - s->sy;
+
+    if ( !(s->sws = sws_getContext(srcw, s->sh, srcfmt, dstw, eh, dstfmt, SWS_FAST_BILINEAR, NULL, NULL, NULL)) ) {
+      PERROR("sws_getContext(slice %d: %dx%d -> %dx%d) fails", i, srcw, s->sh, dstw, eh);
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+
+    if ( eh != s->dh && (status = av_image_alloc(s->buf, s->buflinesize, dstw, eh, dstfmt, 32)) < 0 ) {
+      PERROR("av_image_alloc(slice %d: %dx%d) fails: %s", i, dstw, eh, av_err2str(status));
+      goto end;
+    }
+
+    status = 0;
+  }
+
+end:
+
+  if ( status ) {
+    destroy_sws_slices(&slices);
+  }
+
+  *pslices = slices;
+
+  return status ? status : nslices;
+}
+
+/*
+ * Convert one slice of camera frame, runs on slicepool threads
+ */
+static void video_conversion_slice(void * arg, int slice, int nslices)
+{
+  const struct video_conversion_job * job = arg;
+  const int cw = (job->cx + 1) / 2, ch = (job->cy + 1) / 2;
+  const int y0 = ch * slice / nslices, y1 = ch * (slice + 1) / nslices;
+
+  AVFrame * dst = job->dst;
+
+  switch ( job->mode ) {
+
+    case video_conversion_splituv :
+      if ( job->srcfmt == AV_PIX_FMT_NV21 ) {
+        yuvconv_split_uv(job->yuvk, job->src[1], job->srclinesize[1], dst->data[2], dst->linesize[2],
+            dst->data[1], dst->linesize[1], cw, y0, y1);
+      }
+      else {
+        yuvconv_split_uv(job->yuvk, job->src[1], job->srclinesize[1], dst->data[1], dst->linesize[1],
+            dst->data[2], dst->linesize[2], cw, y0, y1);
+      }
+    break;
+
+    case video_conversion_swapuv :
+      yuvconv_swap_uv(job->yuvk, job->src[1], job->srclinesize[1], dst->data[1], dst->linesize[1], cw, y0, y1);
+    break;
+
+    case video_conversion_yuyv :
+      yuvconv_yuyv_to_yuv420p(job->yuvk, job->src[0], job->srclinesize[0], dst->data[0], dst->linesize[0],
+          dst->data[1], dst->linesize[1], dst->data[2], dst->linesize[2], job->cx, job->cy, y0, y1);
+    break;
+
+    case video_conversion_sws : {
+
+      const struct sws_slice * s = &job->slices[slice];
+      const AVPixFmtDescriptor * sd = av_pix_fmt_desc_get(job->srcfmt);
+      const AVPixFmtDescriptor * dd = av_pix_fmt_desc_get(dst->format);
+      const uint8_t * src[4] = { NULL };
+      const uint8_t * band[4] = { NULL };
+      uint8_t * dstp[4] = { NULL };
+
+      for ( int i = 0; i < 4 && job->src[i]; ++i ) {
+        const int shift = (i == 1 || i == 2) ? sd->log2_chroma_h : 0;
+        src[i] = job->src[i] + (s->sy >> shift) * job->srclinesize[i];
+      }
+
+      for ( int i = 0; i < 4 && dst->data[i]; ++i ) {
+        const int shift = (i == 1 || i == 2) ? dd->log2_chroma_h : 0;
+        dstp[i] = dst->data[i] + (s->dy >> shift) * dst->linesize[i];
+      }
+
+      if ( !s->buf[0] ) {
+        sws_scale(s->sws, src, job->srclinesize, 0, s->sh, dstp, dst->linesize);
+      }
+      else {
+        /* the overlap rows belong to neighbour bands, crop them */
+        sws_scale(s->sws, src, job->srclinesize, 0, s->sh, s->buf, s->buflinesize);
+
+        for ( int i = 0; i < 4 && s->buf[i]; ++i ) {
+          const int shift = (i == 1 || i == 2) ? dd->log2_chroma_h : 0;
+          band[i] = s->buf[i] + (s->ty >> shift) * s->buflinesize[i];
+        }
+
+        av_image_copy(dstp, dst->linesize, band, s->buflinesize, dst->format, dst->width, s->dh);
+      }
+    }
+    break;
+
+    default :
+    break;
+  }
+}
+
+/*
+ * Parse adaptive bitrate options:
+ *  -abr vbv|qp  -abr_min <bps> -abr_max <bps> -abr_hold <ms> -abr_probe <ms> -abr_maxwrite <ms> -abr_vbv <ms>
+ */
+static int parse_rate_control_opts(ff_output_stream * ff, const AVDictionary * opts)
+{
+  AVDictionaryEntry * e;
+
+  ff->rcmode = rate_control_none;
+  memset(&ff->rcparams, 0, sizeof(ff->rcparams));
+  ff->rcvbv = 1000;
+
+  if ( !(e = av_dict_get(opts, "-abr", NULL, 0)) ) {
+    return 0;
+  }
+
+  if ( strcmp(e->value, "vbv") == 0 ) {
+    ff->rcmode = rate_control_vbv;
+  }
+  else if ( strcmp(e->value, "qp") == 0 ) {
+    ff->rcmode = rate_control_qp;
+  }
+  else if ( strcmp(e->value, "none") != 0 ) {
+    PDBG("Bad adaptive bitrate mode specified: %s", e->value);
+    return AVERROR(EINVAL);
+  }
+
+  if ( (e = av_dict_get(opts, "-abr_min", NULL, 0)) ) {
+    ff->rcparams.min_bitrate = (int) av_strtod(e->value, NULL);
+  }
+  if ( (e = av_dict_get(opts, "-abr_max", NULL, 0)) ) {
+    ff->rcparams.max_bitrate = (int) av_strtod(e->value, NULL);
+  }
+  if ( (e = av_dict_get(opts, "-abr_hold", NULL, 0)) ) {
+    ff->rcparams.down_hold_ms = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-abr_probe", NULL, 0)) ) {
+    ff->rcparams.up_hold_ms = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-abr_maxwrite", NULL, 0)) ) {
+    ff->rcparams.max_write_ms = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-abr_vbv", NULL, 0)) && (ff->rcvbv = atoi(e->value)) < 100 ) {
+    ff->rcvbv = 100;
+  }
+
+  return 0;
+}
+
+static void start_rate_control(ff_output_stream * ff, AVCodecContext * v)
+{
+  int64_t qp = 0;
+
+  ff->rcparams.start_bitrate = v->bit_rate;
+  ratectl_init(&ff->rc, &ff->rcparams);
+
+  if ( ff->rcmode == rate_control_qp ) {
+    if ( av_opt_get_int(v->priv_data, "qp", 0, &qp) < 0 || qp < 0 ) {
+      PERROR("x264 is not in constant qp mode, adaptive bitrate disabled");
+      ff->rcmode = rate_control_none;
+      return;
+    }
+    ff->rcbaseqp = qp;
+  }
+
+  ff->stats.rateBitrate = ff->rc.bitrate;
+  ff->stats.rateQp = ff->rcbaseqp;
+
+  PDBG("adaptive bitrate: %s %d..%d bps", ff->rcmode == rate_control_vbv ? "vbv" : "qp",
+      ff->rc.p.min_bitrate, ff->rc.p.max_bitrate);
+}
+
+/*
+ * Sample the writer backlog and retune the encoder when controller decides so.
+ *  libx264 picks up changed bit_rate / rc_max_rate / rc_buffer_size / qp on next frame (x264_encoder_reconfig)
+ */
+static void update_rate_control(ff_output_stream * ff, AVCodecContext * v)
+{
+  struct output_sink_stats st;
+  int qp;
+
+  /* the primary output drives the bitrate */
+  output_sink_get_stats(ff->sinks[0], &st);
+
+  if ( !ratectl_update(&ff->rc, ffmpeg_gettime_ms(), (double) st.queueSize / st.queueCapacity, st.write_ms, st.bytesSent) ) {
+    return;
+  }
+
+  switch ( ff->rcmode ) {
+
+    case rate_control_vbv :
+      v->bit_rate = ff->rc.bitrate;
+      v->rc_max_rate = ff->rc.bitrate;
+      v->rc_buffer_size = (int) ((int64_t) ff->rc.bitrate * ff->rcvbv / 1000);
+    break;
+
+    case rate_control_qp :
+      /* rate roughly halves per +6 qp */
+      qp = ff->rcbaseqp + (int) lrint(6 * log2((double) ff->rc.p.start_bitrate / ff->rc.bitrate));
+      if ( qp > 51 ) {
+        qp = 51;
+      }
+      if ( qp < ff->rcbaseqp ) {
+        qp = ff->rcbaseqp;
+      }
+      av_opt_set_int(v->priv_data, "qp", qp, 0);
+      ff->stats.rateQp = qp;
+    break;
+
+    default :
+    break;
+  }
+
+  ff->stats.rateBitrate = ff->rc.bitrate;
+  ff->stats.rateDecreases = ff->rc.decreases;
+  ff->stats.rateIncreases = ff->rc.increases;
+  ff->stats.rateDecision = ff->rc.decision;
+}
+
+/*
+ * Parse video drop policy options, override create_output_stream_args:
+ *  -drop_policy deadline|latest|none  -drop_deadline <ms>
+ */
+static int parse_drop_policy_opts(ff_output_stream * ff, const AVDictionary * opts)
+{
+  AVDictionaryEntry * e;
+
+  if ( (e = av_dict_get(opts, "-drop_policy", NULL, 0)) ) {
+    if ( strcmp(e->value, "deadline") == 0 ) {
+      ff->drop_policy = ff_drop_deadline;
+    }
+    else if ( strcmp(e->value, "latest") == 0 ) {
+      ff->drop_policy = ff_drop_latest;
+    }
+    else if ( strcmp(e->value, "none") == 0 ) {
+      ff->drop_policy = ff_drop_none;
+    }
+    else {
+      PDBG("Bad drop policy specified: %s", e->value);
+      return AVERROR(EINVAL);
+    }
+  }
+
+  if ( (e = av_dict_get(opts, "-drop_deadline", NULL, 0)) ) {
+    ff->drop_deadline = atoi(e->value);
+  }
+
+  if ( ff->drop_deadline <= 0 ) {
+    ff->drop_deadline = DEFAULT_DROP_DEADLINE;
+  }
+
+  return 0;
+}
+
+/*
+ * Select next frame for encoder, consumer side of aq and vq.
+ *  Audio always goes first. Video frames which are not worth encoding any more
+ *  according to drop policy are returned into the pool here.
+ */
+static struct frm * dequeue_frame(ff_output_stream * ff)
+{
+  struct frm * frm;
+  int64_t now;
+
+  while ( (frm = ccring_pop(&ff->vo)) ) {
+    release_frame(&ff->vp, frm);
+  }
+
+  if ( (frm = ccring_pop(&ff->aq)) ) {
+    return frm;
+  }
+
+  switch ( ff->drop_policy ) {
+
+    case ff_drop_latest :
+      if ( (frm = ccring_pop(&ff->vq)) ) {
+        while ( ccring_peek(&ff->vq) ) {
+          release_frame(&ff->vp, frm);
+          ++ff->stats.videoDropsSuperseded;
+          frm = ccring_pop(&ff->vq);
+        }
+      }
+      return frm;
+
+    case ff_drop_deadline :
+      now = mediaclock_elapsed_us(&ff->clock) / 1000;
+      while ( (frm = ccring_peek(&ff->vq)) && now - frm->pts > ff->drop_deadline ) {
+        release_frame(&ff->vp, ccring_pop(&ff->vq));
+        ++ff->stats.videoDropsLate;
+      }
+    break;
+
+    default :
+    break;
+  }
+
+  return ccring_pop(&ff->vq);
+}
+
+/* Video pts are capture times relative to media clock origin [ms], so the packet age is its capture to wire latency */
+static void on_packet_sent(void * cookie, output_sink * sink, int stream_index, int64_t pts)
+{
+  ff_output_stream * ff = cookie;
+  int64_t origin;
+
+  if ( output_sink_index(sink) == 0 && stream_index == atomic_load(&ff->latency_stidx) &&
+      (origin = atomic_load(&ff->clock.origin)) > 0 ) {
+    cchist_add(&ff->latency, ffmpeg_gettime_us() - origin - pts * 1000);
+  }
+}
+
+/*
+ * Apply outputs state changes on encoder thread (it is attached to JVM for state callbacks),
+ *  returns true when the encoder must stop
+ */
+static bool encoder_should_stop(ff_output_stream * ff)
+{
+  ff_output_stream_state state;
+  int nconnected = 0, nfailed = 0, nconnecting = 0;
+  bool stop;
+
+  if ( !atomic_exchange(&ff->ctl_pending, false) ) {
+    /* nothing to apply, wstatus is written on this thread only */
+    return ff->interrupted || ff->wstatus;
+  }
+
+  ctx_lock(ff);
+
+  if ( ff->idr_request ) {
+    ff->idr_request = false;
+    ff->idr_pending = true;
+  }
+
+  if ( ff->sinks_changed ) {
+
+    ff->sinks_changed = false;
+
+    for ( int i = 0; i < ff->nsinks; ++i ) {
+      if ( ff->sink_states[i] == output_sink_established ) {
+        ++nconnected;
+      }
+      else if ( ff->sink_states[i] == output_sink_failed ) {
+        ++nfailed;
+      }
+      else if ( ff->sink_states[i] != output_sink_paused ) {
+        ++nconnecting;
+      }
+    }
+
+    ff->stats.outputsConnected = nconnected;
+
+    /* stream fails only when no one output is left */
+    if ( nfailed && nfailed == ff->nsinks && !ff->wstatus ) {
+      ff->wstatus = ff->sink_status;
+    }
+
+    state = nconnected ? ff_output_stream_established :
+        nconnecting ? ff_output_stream_connecting :
+            ff_output_stream_paused;
+    if ( state != ff->state && !ff->interrupted && !ff->wstatus ) {
+      set_stream_state(ff, state, 0, false);
+    }
+  }
+
+  stop = ff->interrupted || ff->wstatus;
+
+  ctx_unlock(ff);
+
+  return stop;
+}
+
+/*
+ * Block encoder until next frame is available or the stream is going down
+ */
+static struct frm * wait_frame(ff_output_stream * ff)
+{
+  struct frm * frm;
+
+  while ( !(frm = dequeue_frame(ff)) ) {
+
+    ccwake_prepare(&ff->wake);
+
+    if ( (frm = dequeue_frame(ff)) ) {
+      ccwake_cancel(&ff->wake);
+      break;
+    }
+
+    if ( encoder_should_stop(ff) ) {
+      ccwake_cancel(&ff->wake);
+      break;
+    }
+
+    ccwake_wait(&ff->wake);
+    ++ff->nwakeups;
+  }
+
+  return frm;
+}
+
+/*
+ * Encoder thread wakeups and context switches per second, see -audio_wakeup
+ */
+static void update_encoder_load(ff_output_stream * ff, int64_t * tmark, int64_t * csmark, int * wmark)
+{
+  const int64_t t = ffmpeg_gettime_ms();
+  struct rusage ru;
+  int64_t cs;
+
+  if ( t - *tmark >= 1000 && getrusage(RUSAGE_THREAD, &ru) == 0 ) {
+
+    cs = ru.ru_nvcsw + ru.ru_nivcsw;
+
+    if ( *tmark > 0 ) {
+      ff->stats.encoderWakeups = (int) ((ff->nwakeups - *wmark) * 1000LL / (t - *tmark));
+      ff->stats.encoderSwitches = (int) ((cs - *csmark) * 1000 / (t - *tmark));
+    }
+
+    *tmark = t;
+    *csmark = cs;
+    *wmark = ff->nwakeups;
+  }
+}
+
+/* Producers may touch the rings (except vo) and the clock only between enter_producer() and leave_producer() */
+static bool enter_producer(ff_output_stream * ff)
+{
+  atomic_fetch_add(&ff->producers, 1);
+
+  if ( !atomic_load(&ff->accepting) ) {
+    atomic_fetch_sub(&ff->producers, 1);
+    return false;
+  }
+
+  return true;
+}
+
+static void leave_producer(ff_output_stream * ff)
+{
+  atomic_fetch_sub(&ff->producers, 1);
+}
+
+/* Close the rings for producers and wait until they leave */
+static void stop_producers(ff_output_stream * ff)
+{
+  atomic_store(&ff->accepting, false);
+
+  while ( atomic_load(&ff->producers) ) {
+    sched_yield();
+  }
+}
+
+/* Called on sink thread */
+static void on_sink_state_changed(void * cookie, output_sink * sink, output_sink_state state, int status)
+{
+  ff_output_stream * ff = cookie;
+
+  ctx_lock(ff);
+
+  if ( state == output_sink_established ) {
+    /* new muxer can not start from P frame, don't make it wait for the next GOP */
+    ff->idr_request = true;
+  }
+  else if ( ff->sink_states[output_sink_index(sink)] == output_sink_established && output_sink_has_spool(sink) ) {
+    /* the link is lost and spooling starts, the spool head must be a key frame too,
+     *  otherwise the spooled GOP is dropped after reconnect */
+    ff->idr_request = true;
+  }
+
+  ff->sink_states[output_sink_index(sink)] = state;
+  if ( state == output_sink_failed ) {
+    ff->sink_status = status < 0 ? status : AVERROR_EXIT;
+  }
+  ff->sinks_changed = true;
+
+  atomic_store(&ff->ctl_pending, true);
+
+  ctx_signal(ff);
+  ctx_unlock(ff);
+
+  ccwake_signal(&ff->wake);
+}
+
+/*
+ * Start writer for each '|' separated url of ff->server.
+ *  Per output options: -f:<n> <format> -backlog[:<n>] <packets>
+ *  Store-and-forward: -spool <dir> -spool_size <MB> -spool_segments <n> -spool_rate <kbit/s>
+ *  Reconnect backoff: -reconnect_delay <ms> -reconnect_max <ms>
+ *  Interleaver: -max_interleave_delay <ms>
+ */
+static int start_output_sinks(ff_output_stream * ff, const AVDictionary * opts, AVOutputFormat * oformat)
+{
+  char * urls = NULL, * url, * saveptr = NULL;
+  AVDictionaryEntry * e;
+  AVOutputFormat * fmt;
+  char key[32];
+  int backlog;
+
+  const char * spool_dir = NULL;
+  int64_t spool_size = 0;
+  int spool_segments = 0, spool_rate = 0;
+  int max_interleave_delay = 0;
+
+  ffio_params io = {
+    .nodelay = -1,
+  };
+  bool ffmpeg_io = false;
+  int connect_timeout = 0, header_timeout = 0, write_timeout = 0;
+
+  int status = 0;
+
+  if ( (e = av_dict_get(opts, "-reconnect_delay", NULL, 0)) ) {
+    ff->reconnect_delay = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-reconnect_max", NULL, 0)) ) {
+    ff->reconnect_max = atoi(e->value);
+  }
+
+  if ( (e = av_dict_get(opts, "-max_interleave_delay", NULL, 0)) ) {
+    max_interleave_delay = atoi(e->value);
+  }
+
+  if ( (e = av_dict_get(opts, "-spool", NULL, 0)) ) {
+    spool_dir = e->value;
+  }
+  if ( (e = av_dict_get(opts, "-spool_size", NULL, 0)) ) {
+    spool_size = strtoll(e->value, NULL, 10) * 1024 * 1024;
+  }
+  if ( (e = av_dict_get(opts, "-spool_segments", NULL, 0)) ) {
+    spool_segments = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-spool_rate", NULL, 0)) ) {
+    spool_rate = atoi(e->value);
+  }
+
+  /* socket writer: latency profile flushes every packet, throughput profile sets -io_flush */
+  if ( (e = av_dict_get(opts, "-io_buffer", NULL, 0)) ) {
+    io.buffer_size = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-io_flush", NULL, 0)) ) {
+    io.flush_interval = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-io_sndbuf", NULL, 0)) ) {
+    io.sndbuf = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-io_nodelay", NULL, 0)) ) {
+    io.nodelay = atoi(e->value) != 0;
+  }
+  if ( (e = av_dict_get(opts, "-io_batch", NULL, 0)) ) {
+    io.udp_batch = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-ffmpeg_io", NULL, 0)) ) {
+    ffmpeg_io = atoi(e->value) != 0;
+  }
+
+  /* dead link detection: budgets of blocking output operations [ms], -1 disables */
+  if ( (e = av_dict_get(opts, "-connect_timeout", NULL, 0)) ) {
+    connect_timeout = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-header_timeout", NULL, 0)) ) {
+    header_timeout = atoi(e->value);
+  }
+  if ( (e = av_dict_get(opts, "-write_timeout", NULL, 0)) ) {
+    write_timeout = atoi(e->value);
+  }
+
+  if ( !(urls = av_strdup(ff->server)) ) {
+    status = AVERROR(ENOMEM);
     goto end;
   }
 
+  for ( url = av_strtok(urls, "|", &saveptr); url; url = av_strtok(NULL, "|", &saveptr) ) {
 
-  /* create capture device */
-  status = opensless_audio_capture_create(&ff->capdev, ff, audio_capture_callback, AUDIO_CAPTURE_BUFFERS, ff->audio_sample_rate);
-  if ( status ) {
-    PERROR("audio_capture_create() fails: status=0x%0X", status);
-    goto end;
-  }
+    const int n = ff->nsinks;
 
-  /* Enqueue capture bufers */
-  for ( int i = 0; i < AUDIO_CAPTURE_BUFFERS; ++i ) {
-    int16_t * capbuf = ff->capbufs + i * ff->audio_samples_per_buffer;
-    if ( (status = opensless_audio_capture_enqueue(ff->capdev, capbuf, ff->audio_bytes_per_buffer)) != 0 ) {
-      PERROR("audio_capture_enqueue() fails: status=0x%0X", status);
+    if ( n >= MAX_OUTPUT_SINKS ) {
+      PERROR("Too many outputs, max %d supported, '%s' ignored", MAX_OUTPUT_SINKS, url);
+      break;
+    }
+
+    fmt = oformat;
+    snprintf(key, sizeof(key), "-f:%d", n);
+    if ( (e = av_dict_get(opts, key, NULL, 0)) && !(fmt = av_guess_format(e->value, NULL, NULL)) ) {
+      status = AVERROR_MUXER_NOT_FOUND;
+      PERROR("av_guess_format('%s') fails: %s", e->value, av_err2str(status));
       goto end;
     }
-  }
 
-  /* start audio capture device */
-  if ( (status = opensless_audio_capture_start(ff->capdev)) != 0 ) {
-    PERROR("audio_capture_start() fails: status=0x%0X", status);
-    goto end;
+    backlog = OUTPUT_PACKET_QUEUE_SIZE;
+    snprintf(key, sizeof(key), "-backlog:%d", n);
+    if ( (e = av_dict_get(opts, key, NULL, 0)) || (e = av_dict_get(opts, "-backlog", NULL, 0)) ) {
+      backlog = atoi(e->value);
+    }
+
+    ctx_lock(ff);
+    ff->sink_states[n] = output_sink_idle;
+    ++ff->nsinks;
+    ctx_unlock(ff);
+
+    ff->sinks[n] = create_output_sink(&(struct create_output_sink_args ) {
+          .url = url,
+          .oformat = fmt,
+          .index = n,
+          .nb_streams = 0, /* connect now, streams are described when encoders are ready */
+          .backlog = backlog,
+          .max_interleave_delay = max_interleave_delay,
+          .reconnect_delay = ff->reconnect_delay,
+          .reconnect_max = ff->reconnect_max,
+          .spool_dir = spool_dir,
+          .spool_size = spool_size,
+          .spool_segments = spool_segments,
+          .spool_rate = spool_rate,
+          .io = io,
+          .ffmpeg_io = ffmpeg_io,
+          .connect_timeout = connect_timeout,
+          .header_timeout = header_timeout,
+          .write_timeout = write_timeout,
+          .callback = { .state_changed = on_sink_state_changed, .packet_sent = on_packet_sent },
+          .cookie = ff,
+        });
+
+    if ( !ff->sinks[n] ) {
+      status = AVERROR(errno ? errno : ENOMEM);
+      PERROR("create_output_sink('%s') fails: %s", url, av_err2str(status));
+      goto end;
+    }
   }
 
+  ff->stats.outputsCount = ff->nsinks;
+
 end:
 
-  if ( status ) {
+  av_free(urls);
+
+  return status;
+}
 
-    av_free(ff->capbufs);
-    opensless_audio_capture_destroy(&ff->capdev);
+/* Encoders are ready, let the sinks write headers */
+static int set_output_streams(ff_output_stream * ff, const AVCodecParameters * const * codecpar,
+    const AVRational * time_base, int nb_streams)
+{
+  int status = 0;
 
-    opensless_audio_shutdown();
+  for ( int i = 0; i < ff->nsinks; ++i ) {
+    if ( (status = output_sink_set_streams(ff->sinks[i], codecpar, time_base, nb_streams)) < 0 ) {
+      PERROR("output_sink_set_streams('%s') fails: %s", output_sink_url(ff->sinks[i]), av_err2str(status));
+      break;
+    }
   }
 
-  return status == 0;
+  return status;
 }
 
-static void stop_audio_capture(ff_output_stream * ff)
+static void stop_output_sinks(ff_output_stream * ff)
 {
-  if ( ff->capdev ) {
-    opensless_audio_capture_stop(ff->capdev);
-    opensless_audio_capture_destroy(&ff->capdev);
-    opensless_audio_shutdown();
+  output_sink * sinks[MAX_OUTPUT_SINKS];
+  int nsinks;
+
+  /* detach from stats poller first */
+  ctx_lock(ff);
+  memcpy(sinks, ff->sinks, sizeof(sinks));
+  memset(ff->sinks, 0, sizeof(ff->sinks));
+  nsinks = ff->nsinks;
+  ctx_unlock(ff);
+
+  for ( int i = 0; i < nsinks; ++i ) {
+    destroy_output_sink(&sinks[i]);
   }
 
-  av_free(ff->capbufs);
-  ff->capbufs = NULL;
+  ctx_lock(ff);
+  ff->nsinks = 0;
+  ctx_unlock(ff);
 }
 
-
-static int create_frame_poll(struct ccfifo * fifo, size_t count, size_t datasize)
+/* Share encoded packet with all outputs */
+static int push_output_packet(ff_output_stream * ff, AVPacket * pkt)
 {
-  struct frm * frm;
-  size_t frmsize;
   int status = 0;
 
-  if ( !ccfifo_init(fifo, count, sizeof(struct frm*)) ) {
-    PERROR("ccfifo_init() fails");
-    status = AVERROR(ENOMEM);
-    goto end;
-  }
-
-  frmsize = offsetof(struct frm, data) + datasize;
-  for ( uint i = 0; i < count; ++i ) {
-    if ( !(frm = av_mallocz(frmsize)) ) {
-      PERROR("av_mallocz( frame: size=%zu) fails", frmsize);
+  for ( int i = 0; i < ff->nsinks; ++i ) {
+    if ( ff->sinks[i] && output_sink_push(ff->sinks[i], pkt) == AVERROR(ENOMEM) ) {
       status = AVERROR(ENOMEM);
-      goto end;
     }
-    ccfifo_ppush(fifo, frm);
   }
 
-end: ;
-
-  if ( status ) {
-    while ( (frm = ccfifo_ppop(fifo)) ) {
-      av_free(frm);
-    }
-    ccfifo_cleanup(fifo);
-  }
+  av_packet_unref(pkt);
 
   return status;
 }
@@ -526,33 +1536,51 @@ static int output_loop(struct ff_output_stream * ff)
 
   AVCodecContext * a = NULL;
   AVFrame * output_audio_frame = NULL;
+  audioconv * aconv = NULL;
+  int aframe_size = 0;
 
   AVCodecContext * v = NULL;
   AVFrame * output_video_frame = NULL;
-  AVFrame * input_video_frame = NULL;
-  struct SwsContext * sws = NULL;
+  ffmpeg_video_frame_pool vframes = { .pools = { NULL } };
+  pktpool vpkts = { .pools = { NULL } }, apkts = { .pools = { NULL } };
+  enum video_conversion vconv = video_conversion_sws;
+  struct video_conversion_job conv;
+  struct sws_slice * sws_slices = NULL;
+  slicepool * workers = NULL;
+  uint8_t * chroma_planes = NULL;
+  int nslices = 1, nthreads;
+  motion_detector md = { .cur = NULL };
+  int64_t static_pts = 0;
+  int static_interval = 0;
+  bool repeat = false;
   int cx, cy;
+  int arena_flags = 0;
 
 
 
   const char * format_name = ff->format ? ff->format : "matroska";
   AVOutputFormat * oformat = NULL;
-  AVFormatContext * oc = NULL;
-  AVCodecContext * codec = NULL;
-  bool write_header_ok = false;
+  AVCodecParameters * codecpar[2] = { NULL, NULL };
+  AVRational time_base[2];
+  int nb_streams = 0;
 
 
   struct frm * frm;
   AVPacket pkt;
-  int pkt_size;
   int gotpkt;
 
   int stidx, astidx = -1, vstidx = -1;
+  int64_t load_tmark = 0, load_csmark = 0;
+  int load_wmark = 0;
 
   int status;
 
   PDBG("ENTER");
 
+  ff->start_time = ffmpeg_gettime_ms();
+  atomic_store(&ff->latency_stidx, -1);
+  cchist_reset(&ff->latency);
+
 
 
 
@@ -583,44 +1611,164 @@ static int output_loop(struct ff_output_stream * ff)
   }
 
 
+  /// Start server connections, they go in parallel with codecs and capture startup
+  set_stream_state(ff, ff_output_stream_connecting, 0, true);
+
+  if ( (status = start_output_sinks(ff, opts, oformat)) ) {
+    goto end;
+  }
+
+
   /// Open codecs
 
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+  /* frame arenas: huge pages cut TLB misses of conversion kernels, mlock keeps them off zram */
+  if ( (e = av_dict_get(opts, "-frame_hugepages", NULL, 0)) && atoi(e->value) ) {
+    arena_flags |= frmarena_hugepages;
+  }
+  if ( (e = av_dict_get(opts, "-frame_mlock", NULL, 0)) && atoi(e->value) ) {
+    arena_flags |= frmarena_mlock;
+  }
+
   if ( ff->video_codec && *ff->video_codec ) {
 
     if ( ff->vbufs < 1 || ff->vbufs > 16 ) {
       ff->vbufs = 3;
     }
 
+    if ( (status = parse_rate_control_opts(ff, opts)) ) {
+      goto end;
+    }
+
     if ( (status = create_video_codec(&v, ff, opts)) ) {
       PERROR("create_video_codec() fails: %s", av_err2str(status));
       goto end;
     }
 
+    if ( ff->rcmode != rate_control_none ) {
+      start_rate_control(ff, v);
+    }
+
     PDBG("VIDEO: %s %s %dx%d", v->codec->name, av_get_pix_fmt_name(ff->input_pixfmt), ff->cx, ff->cy );
 
-    if ( (status = create_frame_poll(&ff->vp, ff->vbufs, FRAME_DATA_SIZE(ff->cx, ff->cy))) ) {
-      PERROR("create_frame_poll(video) fails: %s", av_err2str(status));
+    /* key frames get worst case buffers, the rest is sized from packets of last two GOPs */
+    pktpool_init(&vpkts, av_image_get_buffer_size(v->pix_fmt, v->width, v->height, 1) * 3 / 2,
+        FFMAX(v->gop_size, 64));
+
+    if ( (status = create_frame_pool(&ff->vp, &ff->vq, ff->vbufs, &ff->va, ff->vbufs,
+        ff->frame_size, arena_flags)) ) {
+      PERROR("create_frame_pool(video) fails: %s", av_err2str(status));
       goto end;
     }
 
-    /// Alloc frame buffers
-    if ( (status = ffmpeg_create_video_frame(&input_video_frame, ff->input_pixfmt, ff->cx, ff->cy, 0)) ) {
-      PERROR("ffmpeg_create_video_frame(input_frame) fails: %s", av_err2str(status));
+    if ( !ccring_capacity(&ff->vo) && !ccring_init(&ff->vo, ff->vbufs) ) {
+      PERROR("ccring_init(vo) fails");
+      status = AVERROR(ENOMEM);
       goto end;
     }
 
-    PDBG("create output_video_frame: %s %dx%d", av_get_pix_fmt_name(v->pix_fmt), v->width, v->height );
-    if ( (status = ffmpeg_create_video_frame(&output_video_frame, v->pix_fmt, v->width, v->height, 32)) ) {
-      PERROR("ffmpeg_create_video_frame(output_frame) fails: %s", av_err2str(status));
-      goto end;
+    vconv = select_video_conversion(ff->input_pixfmt, cx, cy, v->pix_fmt, v->width, v->height);
+
+    if ( vconv != video_conversion_none ) {
+
+      if ( (e = av_dict_get(opts, "-conv_threads", NULL, 0)) ) {
+        nthreads = atoi(e->value);
+      }
+      else {
+        nthreads = ff->threads;
+      }
+
+      if ( nthreads != 1 && !(workers = slicepool_create(nthreads)) ) {
+        PERROR("slicepool_create(%d) fails, convert frames on single thread", nthreads);
+      }
+
+      nslices = slicepool_threads(workers);
     }
 
-    if ( !(sws = sws_getContext(cx, cy, ff->input_pixfmt, v->width, v->height, v->pix_fmt, SWS_FAST_BILINEAR, NULL, NULL, NULL)) ) {
-      PERROR("sws_getContext() fails");
-      goto end;
+    if ( vconv != video_conversion_sws && vconv != video_conversion_yuyv ) {
+
+      /// Encoder input frame will point directly to the camera frame data
+      PDBG("passthrough output_video_frame: %s %dx%d %s", av_get_pix_fmt_name(v->pix_fmt), v->width, v->height,
+          vconv == video_conversion_swapuv ? "swapuv" : vconv == video_conversion_splituv ? "splituv" : "");
+
+      if ( !(output_video_frame = av_frame_alloc()) ) {
+        PERROR("av_frame_alloc(output_frame) fails");
+        status = AVERROR(ENOMEM);
+        goto end;
+      }
+
+      output_video_frame->format = v->pix_fmt;
+      output_video_frame->width = v->width;
+      output_video_frame->height = v->height;
+
+      if ( vconv == video_conversion_splituv ) {
+        /// Only chroma planes need own storage, luma plane is taken from camera frame
+        output_video_frame->linesize[0] = cx;
+        output_video_frame->linesize[1] = output_video_frame->linesize[2] = FFALIGN((cx + 1) / 2, 32);
+
+        if ( !(chroma_planes = av_malloc(2 * output_video_frame->linesize[1] * ((cy + 1) / 2))) ) {
+          PERROR("av_malloc(chroma_planes) fails");
+          status = AVERROR(ENOMEM);
+          goto end;
+        }
+
+        output_video_frame->data[1] = chroma_planes;
+        output_video_frame->data[2] = chroma_planes + output_video_frame->linesize[1] * ((cy + 1) / 2);
+      }
+    }
+    else {
+
+      PDBG("create output_video_frame: %s %dx%d", av_get_pix_fmt_name(v->pix_fmt), v->width, v->height );
+      if ( (status = ffmpeg_video_frame_pool_init(&vframes, v->pix_fmt, v->width, v->height, 32)) ) {
+        PERROR("ffmpeg_video_frame_pool_init(output_frame) fails: %s", av_err2str(status));
+        goto end;
+      }
+      if ( (status = ffmpeg_create_pooled_video_frame(&output_video_frame, &vframes)) ) {
+        PERROR("ffmpeg_create_pooled_video_frame(output_frame) fails: %s", av_err2str(status));
+        goto end;
+      }
+
+      if ( vconv == video_conversion_sws ) {
+
+        if ( (status = create_sws_slices(&sws_slices, nslices, cx, cy, ff->input_pixfmt, v->width, v->height, v->pix_fmt)) < 0 ) {
+          PERROR("create_sws_slices() fails: %s", av_err2str(status));
+          goto end;
+        }
+
+        nslices = status;
+      }
+    }
+
+    PDBG("video conversion: %d slices on %d threads", nslices, slicepool_threads(workers));
+
+    conv = (struct video_conversion_job ) {
+          .mode = vconv,
+          .yuvk = yuvconv_get_kernels(),
+          .srcfmt = ff->input_pixfmt,
+          .cx = cx,
+          .cy = cy,
+          .dst = output_video_frame,
+          .slices = sws_slices,
+        };
+
+    /* fixed cameras: unchanged scene is encoded from previous picture, optionally at reduced rate */
+    if ( (e = av_dict_get(opts, "-motion_detect", NULL, 0)) && atoi(e->value) ) {
+
+      const int threshold = (e = av_dict_get(opts, "-motion_threshold", NULL, 0)) ? atoi(e->value) : 0;
+
+      if ( (status = motion_init(&md, av_image_get_linesize(ff->input_pixfmt, cx, 0), cy, threshold)) ) {
+        PERROR("motion_init() fails: %s", av_err2str(status));
+        goto end;
+      }
+
+      if ( (e = av_dict_get(opts, "-static_fps", NULL, 0)) && atof(e->value) > 0 ) {
+        static_interval = (int) (1000 / atof(e->value));
+      }
+
+      PDBG("motion detector: %dx%d tiles, '%s' kernels, static interval %d ms", md.tiles_x, md.tiles_y,
+          md.kernels, static_interval);
     }
   }
 
@@ -633,24 +1781,47 @@ static int output_loop(struct ff_output_stream * ff)
       ff->abufs = 150;
     }
 
-    if ( (status = create_audio_codec(&a, ff, opts)) ) {
+    if ( (status = create_audio_codec(&a, ff, opts, oformat)) ) {
       PERROR("create_audio_codec(%s) fails: %s", ff->audio_codec, av_err2str(status));
       goto end;
     }
 
     PDBG("AUDIO: %s %s %d Hz %d samples", a->codec->name, av_get_sample_fmt_name(a->sample_fmt), a->sample_rate, ff->audio_samples_per_buffer );
 
-    if ( (status = create_frame_poll(&ff->ap, ff->abufs, ff->audio_bytes_per_buffer)) ) {
-      PERROR("create_frame_poll(audio) fails: %s", av_err2str(status));
+    /* codecs without fixed frame size get capture buffers as is, rescaled to encoder rate */
+    if ( !(aframe_size = a->frame_size) ) {
+      aframe_size = av_rescale(ff->audio_samples_per_buffer, a->sample_rate, ff->audio_sample_rate);
+    }
+
+    pktpool_init(&apkts, FFMAX(2 * aframe_size * a->channels * av_get_bytes_per_sample(a->sample_fmt), 16384), 64);
+
+    if ( !(aconv = audioconv_create(ff->audio_sample_rate, a->sample_fmt, a->sample_rate, aframe_size)) ) {
+      PERROR("audioconv_create() fails");
+      status = AVERROR(ENOMEM);
+      goto end;
+    }
+
+    /* non-interactive profiles may let audio accumulate before the encoder is woken up */
+    ff->audio_wakeup_batch = 1;
+    if ( (e = av_dict_get(opts, "-audio_wakeup", NULL, 0)) ) {
+      ff->audio_wakeup_batch = av_rescale(FFMIN(atoi(e->value), AUDIO_WAKEUP_MAX), ff->audio_sample_rate,
+          1000 * (int64_t) ff->audio_samples_per_buffer);
+      ff->audio_wakeup_batch = av_clip(ff->audio_wakeup_batch, 1, ff->abufs / 2);
+    }
+
+    /* the capture device holds AUDIO_CAPTURE_BUFFERS frames of the pool all the time */
+    if ( (status = create_frame_pool(&ff->ap, &ff->aq, ff->abufs, &ff->aa, ff->abufs + AUDIO_CAPTURE_BUFFERS,
+        ff->audio_bytes_per_buffer, arena_flags)) ) {
+      PERROR("create_frame_pool(audio) fails: %s", av_err2str(status));
       goto end;
     }
 
-    if ( (status = ffmpeg_create_audio_frame(&output_audio_frame, a->sample_fmt, a->sample_rate, ff->audio_samples_per_buffer, 1, AV_CH_LAYOUT_MONO)) ) {
+    if ( (status = ffmpeg_create_audio_frame(&output_audio_frame, a->sample_fmt, a->sample_rate, aframe_size, 1, AV_CH_LAYOUT_MONO)) ) {
       PERROR("ffmpeg_create_audio_frame() fails: %s", av_err2str(status));
       goto end;
     }
 
-    if ( !start_audio_capture(ff) ) {
+    if ( !start_audio_capture(ff, opts) ) {
       PERROR("start_audio_capture() fails");
       status = AVERROR_EXTERNAL;
       goto end;
@@ -660,217 +1831,278 @@ static int output_loop(struct ff_output_stream * ff)
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-  if ( !(ccfifo_init(&ff->q, ff->output_fifo_size = ff->abufs + ff->vbufs, sizeof(struct frm*))) ) {
-    PERROR("ccfifo_init(frame queue) fails");
-    status = AVERROR(ENOMEM);
+  if ( (status = parse_drop_policy_opts(ff, opts)) ) {
     goto end;
   }
 
 
 
-  /// Alloc output context
-
-  if ( (status = avformat_alloc_output_context2(&oc, oformat, NULL, ff->server)) < 0 ) {
-    PERROR("avformat_alloc_output_context2() fails: %s", av_err2str(status));
-    goto end;
+  /// Describe output streams
+  if ( v ) {
+    vstidx = nb_streams++;
+    atomic_store(&ff->latency_stidx, vstidx);
+  }
+  if ( a ) {
+    astidx = nb_streams++;
   }
 
-  oc->interrupt_callback.callback = output_stream_interrupt_callback;
-  oc->interrupt_callback.opaque = ff;
-
+  for ( int i = 0; i < nb_streams; ++i ) {
 
-  /// Create video stream
+    AVCodecContext * c = i == vstidx ? v : a;
 
-  if ( v ) {
-    vstidx = 0;
-    if ( (status = add_stream(oc, v)) ) {
-      PERROR("create_video_stream('%s') fails: %s", v->codec->name, av_err2str(status));
+    if ( !(codecpar[i] = avcodec_parameters_alloc()) ) {
+      PERROR("avcodec_parameters_alloc() fails");
+      status = AVERROR(ENOMEM);
       goto end;
     }
-  }
-
 
-  /// Create audio stream
-  if ( a ) {
-    astidx = v ? 1 : 0;
-    if ( (status = add_stream(oc, a)) ) {
-      PERROR("create_audio_stream('%s') fails: %s", a->codec->name, av_err2str(status));
+    if ( (status = avcodec_parameters_from_context(codecpar[i], c)) < 0 ) {
+      PERROR("avcodec_parameters_from_context('%s') fails: %s", c->codec->name, av_err2str(status));
       goto end;
     }
-  }
-
-  /// Start server connection
-  set_stream_state(ff, ff_output_stream_connecting, 0, true);
 
-
-  PDBG("C avio_open2('%s')", ff->server);
-
-  if ( (status = avio_open2(&oc->pb, ff->server, AVIO_FLAG_WRITE, &oc->interrupt_callback, NULL)) < 0 ) {
-    PCRITICAL("avio_open(%s) fails: %s", ff->server, av_err2str(status));
-    goto end;
+    time_base[i] = c->time_base;
   }
 
-  set_stream_state(ff, ff_output_stream_established, 0, true);
-
-  /* Write the stream header */
-  PDBG("C avformat_write_header('%s')", ff->server);
+  ff->stats.encodeQueueCapacity = ccring_capacity(&ff->aq) + ccring_capacity(&ff->vq);
 
-  if ( (status = avformat_write_header(oc, NULL)) < 0 ) {
-    PERROR("avformat_write_header() fails: %s", av_err2str(status));
+  /// Sinks are probably connected by now, write headers
+  if ( (status = set_output_streams(ff, (const AVCodecParameters * const *) codecpar, time_base, nb_streams)) ) {
     goto end;
   }
 
-  PDBG("R avformat_write_header('%s')", ff->server);
+  /// Record what the producers deliver, for replay on host builds.
+  /// Producers only copy into -record_buffer <MB>, the file is written by the recorder thread
+  if ( !ff->recorder && (e = av_dict_get(opts, "-record", NULL, 0)) ) {
+    const char * path = e->value;
+    const size_t bufsize = (e = av_dict_get(opts, "-record_buffer", NULL, 0)) ? atoi(e->value) * (size_t) (1024 * 1024) : 0;
+    if ( !(ff->recorder = caprec_create(path, ff->cx, ff->cy, ff->camfmt->id, ff->audio_sample_rate, bufsize)) ) {
+      PERROR("caprec_create('%s') fails, recording disabled", path);
+    }
+  }
 
-  write_header_ok = true;
+  /// Let camera and audio producers in
+  mediaclock_init(&ff->clock, ff->audio_sample_rate,
+      (e = av_dict_get(opts, "-clock_slew", NULL, 0)) ? atoi(e->value) : 0);
 
-  ctx_lock(ff);
+  atomic_store(&ff->accepting, true);
 
   while ( status >= 0 ) {
 
-    frm = NULL;
     stidx = -1;
 
-    while ( !ff->interrupted && !(frm = ccfifo_ppop(&ff->q)) ) {
-      ctx_wait(ff, -1);
-    }
+    update_encoder_load(ff, &load_tmark, &load_csmark, &load_wmark);
 
-    if ( ff->interrupted ) {
-      status = AVERROR_EXIT;
-      if ( frm ) {
-        switch ( frm->type ) {
-          case frm_type_audio :
-            ccfifo_ppush(&ff->ap, frm);
-          break;
-          case frm_type_video :
-            ccfifo_ppush(&ff->vp, frm);
-          break;
-        }
-      }
+    if ( encoder_should_stop(ff) || !(frm = wait_frame(ff)) ) {
+      ctx_lock(ff);
+      status = ff->interrupted ? AVERROR_EXIT : ff->wstatus ? ff->wstatus : AVERROR_EXIT;
+      ctx_unlock(ff);
       break;
     }
 
-    ctx_unlock(ff);
+    if ( (ff->stats.encodeQueueSize = ccring_size(&ff->aq) + ccring_size(&ff->vq)) >= ff->stats.encodeQueueMax ) {
+      ff->stats.encodeQueueMax = ff->stats.encodeQueueSize + 1;
+    }
 
     gotpkt = false;
 
     switch ( frm->type ) {
 
       case frm_type_video: {
-        codec = v;
         stidx = vstidx;
         output_video_frame->pts = frm->pts;
-        if ( (status = av_image_fill_arrays(input_video_frame->data, input_video_frame->linesize, frm->data, input_video_frame->format, cx, cy, 1)) <= 0 ) {
-          PERROR("av_image_fill_arrays() fails: %s", av_err2str(status));
-        }
-        else if ( (status = sws_scale(sws, (const uint8_t * const*)input_video_frame->data, input_video_frame->linesize, 0, cy, output_video_frame->data, output_video_frame->linesize)) < 0 ) {
-          PERROR("sws_scale() fails: %s", av_err2str(status));
+
+        if ( ff->idr_pending ) {
+          output_video_frame->pict_type = AV_PICTURE_TYPE_I;
+          output_video_frame->key_frame = 1;
+          ff->idr_pending = false;
         }
-        else if ( (status = avcodec_encode_video2(v, &pkt, output_video_frame, &gotpkt)) < 0 ) {
-          PERROR("avcodec_encode_video2() fails: %s", av_err2str(status));
+        else {
+          output_video_frame->pict_type = AV_PICTURE_TYPE_NONE;
+          output_video_frame->key_frame = 0;
         }
-      }
-      break;
 
-      case frm_type_audio: {
-        codec = a;
-        stidx = astidx;
-        output_audio_frame->pts = frm->pts;
-        output_audio_frame->nb_samples = ff->audio_samples_per_buffer;
-        if ( (status = avcodec_fill_audio_frame(output_audio_frame, 1, AUDIO_SAMPLE_FMT, frm->data, frm->size, 0)) < 0 ) {
-          PERROR("avcodec_fill_audio_frame() fails: %s", av_err2str(status));
+        if ( (status = campixfmt_fill_arrays(conv.src, conv.srclinesize, frm->data, ff->camfmt, cx, cy)) <= 0 ) {
+          PERROR("campixfmt_fill_arrays() fails: %s", av_err2str(status));
+          break;
         }
-        else if ( (status = avcodec_encode_audio2(a, &pkt, output_audio_frame, &gotpkt)) < 0 ) {
-          PERROR("avcodec_encode_audio2() fails: %s", av_err2str(status));
+
+        /* Nothing moved since last converted picture: the encoder gets that picture again and codes it
+         *  with skip blocks, -static_fps frames in between are not encoded at all.
+         *  Pass-through routes have no own copy of the picture and are converted as usual,
+         *  so is splituv: its luma is the camera buffer, repeated chroma would not match it. */
+        repeat = false;
+
+        if ( md.cur ) {
+
+          if ( (ff->stats.motionScore = motion_measure(&md, conv.src[0], conv.srclinesize[0])) > 0 ||
+              output_video_frame->key_frame ) {
+            motion_set_reference(&md);
+            static_pts = frm->pts;
+          }
+          else if ( frm->pts - static_pts < static_interval ) {
+            ++ff->stats.videoDropsStatic;
+            status = 0;
+            break;
+          }
+          else {
+            repeat = vconv == video_conversion_sws || vconv == video_conversion_yuyv;
+            ff->stats.staticRepeats += repeat;
+            static_pts = frm->pts;
+          }
         }
-      }
-      break;
-    }
 
+        /* encoder may still reference previous picture (frame threads), it gets fresh planes then */
+        if ( !repeat && (vconv == video_conversion_sws || vconv == video_conversion_yuyv) && !av_frame_is_writable(output_video_frame) &&
+            (status = ffmpeg_video_frame_pool_get(&vframes, output_video_frame)) ) {
+          PERROR("ffmpeg_video_frame_pool_get() fails: %s", av_err2str(status));
+          break;
+        }
 
-    if ( gotpkt ) {
+        switch ( vconv ) {
+          case video_conversion_none :
+            memcpy(output_video_frame->data, conv.src, sizeof(conv.src));
+            memcpy(output_video_frame->linesize, conv.srclinesize, sizeof(conv.srclinesize));
+          break;
+          case video_conversion_swapuv :
+            /* in place */
+            memcpy(output_video_frame->data, conv.src, sizeof(conv.src));
+            memcpy(output_video_frame->linesize, conv.srclinesize, sizeof(conv.srclinesize));
+            slicepool_run(workers, video_conversion_slice, &conv, nslices);
+          break;
+          case video_conversion_splituv :
+            output_video_frame->data[0] = conv.src[0];
+            slicepool_run(workers, video_conversion_slice, &conv, nslices);
+          break;
+          case video_conversion_sws :
+          case video_conversion_yuyv :
+            if ( !repeat ) {
+              slicepool_run(workers, video_conversion_slice, &conv, nslices);
+            }
+          break;
+        }
 
-      const AVStream * os = oc->streams[pkt.stream_index = stidx];
+        /* encoder writes into pooled buffer, sinks share it by reference */
+        if ( (status = pktpool_get(&vpkts, &pkt, output_video_frame->key_frame)) ) {
+          break;
+        }
 
-      if ( codec->time_base.num != os->time_base.num || codec->time_base.den != os->time_base.den ) {
-        av_packet_rescale_ts(&pkt, codec->time_base, os->time_base);
+        if ( (status = avcodec_encode_video2(v, &pkt, output_video_frame, &gotpkt)) >= 0 ) {
+          if ( gotpkt ) {
+            pktpool_update(&vpkts, pkt.size);
+          }
+        }
+        else if ( pktpool_miss(&vpkts) ) {
+          /* the frame is lost, decoder needs fresh reference */
+          PERROR("encoded picture exceeds %d bytes packet buffer, dropped", PKTPOOL_SIZE(vpkts.lastclass));
+          ff->idr_pending = true;
+          gotpkt = false;
+          status = 0;
+        }
+        else {
+          PERROR("avcodec_encode_video2() fails: %s", av_err2str(status));
+        }
       }
+      break;
 
-//      {
-//        int64_t upts = av_rescale_ts(pkt.pts, os->time_base, (AVRational){1, 1000});
-//        int64_t udts = av_rescale_ts(pkt.dts, os->time_base, (AVRational){1, 1000});
-//        PDBG("av_write_frame(): st=%d pts=%s dts=%s ctb=%s stb=%s upts=%s udts=%s size=%d",stidx,
-//            av_ts2str(pkt.pts), av_ts2str(pkt.dts),
-//            av_tb2str(codec->time_base), av_tb2str(os->time_base),
-//            av_ts2str(upts), av_ts2str(udts),
-//            pkt.size);
-//      }
-
+      case frm_type_audio: {
+        stidx = astidx;
 
-      // av_interleaved_write_frame() will destroy pkt
-      pkt_size = pkt.size;
+        /* capture rate -> encoder rate, drain all captured audio first and encode it back-to-back */
+        for ( struct frm * f = frm; f; f = ccring_pop(&ff->aq) ) {
+          status = audioconv_write(aconv, (const int16_t *) f->data, f->size / AUDIO_SAMPLE_SIZE, f->pts);
+          if ( f != frm ) {
+            release_frame(&ff->ap, f);
+          }
+          if ( status < 0 ) {
+            break;
+          }
+        }
 
-      if ( oc->nb_streams > 1 ) {
-        if ( (status = av_interleaved_write_frame(oc, &pkt)) < 0 ) {
-          PERROR("av_interleaved_write_frame(st=%d) fails: status=%d %s", stidx, status, av_err2str(status));
+        if ( status < 0 ) {
+          PERROR("audioconv_write() fails: %s", av_err2str(status));
+          break;
         }
-      }
-      else if ( (status = av_write_frame(oc, &pkt)) < 0 ) {
-        PERROR("av_write_frame() fails: status=%d %s", status, av_err2str(status));
-      }
 
-      if ( status >= 0 ) {
-        if ( stidx == vstidx ) {
-          ++ff->stats.framesSent;
+        while ( (status = audioconv_read(aconv, output_audio_frame)) > 0 ) {
+
+          if ( (status = pktpool_get(&apkts, &pkt, false)) ) {
+            break;
+          }
+
+          if ( (status = avcodec_encode_audio2(a, &pkt, output_audio_frame, &gotpkt)) < 0 ) {
+            if ( !pktpool_miss(&apkts) ) {
+              PERROR("avcodec_encode_audio2() fails: %s", av_err2str(status));
+              break;
+            }
+            PERROR("encoded audio exceeds %d bytes packet buffer, dropped", PKTPOOL_SIZE(apkts.lastclass));
+            gotpkt = false;
+            status = 0;
+          }
+
+          if ( !gotpkt ) {
+            av_packet_unref(&pkt);
+          }
+          else {
+            pktpool_update(&apkts, pkt.size);
+            pkt.stream_index = stidx;
+            if ( (status = push_output_packet(ff, &pkt)) < 0 ) {
+              PERROR("push_output_packet() fails: %s", av_err2str(status));
+              break;
+            }
+            gotpkt = false;
+          }
         }
-        ff->stats.bytesSent += pkt_size;
       }
-
-      av_packet_unref(&pkt);
+      break;
     }
 
-    ctx_lock(ff);
 
-    if ( frm ) {
-      switch ( frm->type ) {
-        case frm_type_audio :
-          ccfifo_ppush(&ff->ap, frm);
-        break;
-        case frm_type_video :
-          ccfifo_ppush(&ff->vp, frm);
-        break;
+    if ( gotpkt ) {
+      /* timestamps are in codec time base, sinks rescale them for own muxers */
+      pkt.stream_index = stidx;
+      if ( (status = push_output_packet(ff, &pkt)) < 0 ) {
+        PERROR("push_output_packet() fails: %s", av_err2str(status));
       }
     }
-  }
+    else {
+      /* pool buffer back */
+      av_packet_unref(&pkt);
+    }
 
-  ctx_unlock(ff);
+    if ( status >= 0 && frm->type == frm_type_video && ff->rcmode != rate_control_none ) {
+      update_rate_control(ff, v);
+    }
+
+    release_frame(frm->type == frm_type_audio ? &ff->ap : &ff->vp, frm);
+  }
 
 end:
 
+  stop_producers(ff);
+
   PDBG("C set_output_stream_state(disconnecting, status=%d)", status);
   set_stream_state(ff, ff_output_stream_disconnecting, status, true);
 
   stop_audio_capture(ff);
 
-  if ( write_header_ok && !is_ioerror(status) ) {
-    int status2 = av_write_trailer(oc);
-    if ( status2 ) {
-      PERROR("av_write_trailer() fails: %s", av_err2str(status2));
-      if ( status == 0 ) {
-        status = status2;
-      }
-    }
-  }
+  /* each sink writes own trailer */
+  stop_output_sinks(ff);
 
   ctx_lock(ff);
 
+  av_packet_unref(&pkt);
   av_frame_free(&output_audio_frame);
   av_frame_free(&output_video_frame);
-  av_frame_free(&input_video_frame);
+  ffmpeg_video_frame_pool_cleanup(&vframes);
+  pktpool_cleanup(&vpkts);
+  pktpool_cleanup(&apkts);
+  motion_cleanup(&md);
+  audioconv_destroy(&aconv);
+  av_free(chroma_planes);
 
-  if ( sws ) {
-    sws_freeContext(sws);
-  }
+  destroy_sws_slices(&sws_slices);
+  slicepool_destroy(&workers);
 
   if ( v ) {
     if ( avcodec_is_open(v) ) {
@@ -886,26 +2118,15 @@ end:
     avcodec_free_context(&a);
   }
 
-  if ( oc ) {
-    avio_closep(&oc->pb);
-    avformat_free_context(oc);
+  for ( int i = 0; i < nb_streams; ++i ) {
+    avcodec_parameters_free(&codecpar[i]);
   }
 
   av_dict_free(&opts);
 
-  while ( (frm = ccfifo_ppop(&ff->q)) ) {
-    av_free(frm);
-  }
-  while ( (frm = ccfifo_ppop(&ff->ap)) ) {
-    av_free(frm);
-  }
-  while ( (frm = ccfifo_ppop(&ff->vp)) ) {
-    av_free(frm);
-  }
-
-  ccfifo_cleanup(&ff->ap);
-  ccfifo_cleanup(&ff->vp);
-  ccfifo_cleanup(&ff->q);
+  /* pools are kept for the next run */
+  drain_frame_queue(&ff->aq, &ff->ap);
+  drain_frame_queue(&ff->vq, &ff->vp);
 
   ctx_unlock(ff);
 
@@ -918,22 +2139,25 @@ end:
 static void * output_stream_thread(void * arg)
 {
   struct ff_output_stream * ff = arg;
+#ifdef __ANDROID__
   JNIEnv * env = NULL;
-  int64_t tmo;
-
+#endif
+  int64_t t, tmo;
+  int attempt = 0;
 
   int status = 0;
 
   PDBG("ENTER");
 
+#ifdef __ANDROID__
+  /* state callbacks call into java */
   java_attach_current_thread(&env);
+#endif
 
   ctx_lock(ff);
 
   while ( !ff->interrupted && status >= 0 ) {
 
-    ff->firstpts = 0;
-    ff->atime = 0;
     memset(&ff->stats, 0, sizeof(ff->stats));
 
     ctx_unlock(ff);
@@ -945,15 +2169,16 @@ static void * output_stream_thread(void * arg)
 
     ctx_lock(ff);
 
-    if ( !ff->interrupted && is_ioerror(status) ) {
+    if ( !ff->interrupted && ffmpeg_is_ioerror(status) ) {
 
       //PDEBUG("Make a short delay");
 
       set_stream_state(ff, ff_output_stream_paused, 0, false);
 
-      tmo = ffmpeg_gettime_ms() + 2 * 1000;
-      while ( !ff->interrupted && ffmpeg_gettime_ms() < tmo ) {
-        ctx_wait(ff, 500);
+      /* outputs reconnect by themselves, here only the whole session has failed to start */
+      tmo = ffmpeg_gettime_ms() + ffmpeg_backoff_delay(++attempt, 1000, 30000);
+      while ( !ff->interrupted && (t = ffmpeg_gettime_ms()) < tmo ) {
+        ctx_wait(ff, (int) (tmo - t));
       }
 
       //PDEBUG("Delay finished");
@@ -966,7 +2191,9 @@ static void * output_stream_thread(void * arg)
 
   ctx_unlock(ff);
 
+#ifdef __ANDROID__
   java_deatach_current_thread();
+#endif
 
   PDBG("LEAVE: interrupted=%d", ff->interrupted);
   return NULL;
@@ -1014,20 +2241,36 @@ ff_output_stream * create_output_stream(const create_output_stream_args * args)
 
   ff->cx = args->cx;
   ff->cy = args->cy;
-  ff->input_pixfmt = args->pxfmt;
+  ff->camfmt = campixfmt_get(args->pxfmt);
+  if ( !(ff->frame_size = campixfmt_frame_size(ff->camfmt, ff->cx, ff->cy)) ) {
+    PERROR("camera format %d can not have %dx%d frames", args->pxfmt, ff->cx, ff->cy);
+    errno = EINVAL;
+    goto end;
+  }
+  ff->input_pixfmt = ff->camfmt->avfmt;
 
   ff->vquality = args->cvquality;
   ff->vbitrate = args->cvbitrate;
   ff->vbufs = args->cvbufs;
   ff->gopsize = args->gopsize;
+  ff->drop_policy = args->drop_policy;
+  ff->drop_deadline = args->drop_deadline;
+  ff->ocx = args->ocx;
+  ff->ocy = args->ocy;
+  ff->threads = args->threads;
 
   ff->aquality = args->caquality;
   ff->abitrate = args->cabitrate;
   ff->abufs = args->cabufs;
+  ff->audio_sample_rate = args->casamplerate;
 
   ff->state = ff_output_stream_idle;
   ff->status = 0;
 
+  if ( pthread_wait_init(&ff->lock) || ccwake_init(&ff->wake) ) {
+    goto end;
+  }
+
 
   fok = true;
 
@@ -1053,6 +2296,12 @@ void destroy_output_stream(ff_output_stream * ff)
     av_free(ff->format);
     av_free(ff->video_codec);
     av_free(ff->ffopts);
+    caprec_close(&ff->recorder);
+    destroy_frame_pool(&ff->vp, &ff->vq, &ff->va);
+    destroy_frame_pool(&ff->ap, &ff->aq, &ff->aa);
+    ccring_cleanup(&ff->vo);
+    pthread_wait_destroy(&ff->lock);
+    ccwake_destroy(&ff->wake);
     av_free(ff);
   }
 }
@@ -1092,6 +2341,7 @@ void stop_output_stream(ff_output_stream * ff)
   while ( ff->state != ff_output_stream_idle ) {
     PDBG("WAIT STATE");
     ctx_signal(ff);
+    ccwake_signal(&ff->wake);
     ctx_wait(ff, -1);
   }
 
@@ -1115,73 +2365,136 @@ void * get_output_stream_cookie(const ff_output_stream * ff)
 
 size_t get_video_frame_data_size(const ff_output_stream * ff)
 {
-  return FRAME_DATA_SIZE(ff->cx, ff->cy);
+  return ff->frame_size;
+}
+
+struct frm * get_video_frame_by_data(ff_output_stream * ff, const void * bfr)
+{
+  return frmarena_frame(&ff->va, bfr);
+}
+
+/* Producer side of aq and vq, must be called between enter_producer() and leave_producer() */
+static void enqueue_frame(ff_output_stream * ff, struct frm * frm)
+{
+  /* queues can hold all frames of the pool, so push fails only on a bug */
+  if ( frm->type != frm_type_audio ) {
+    if ( !ccring_push(&ff->vq, frm) ) {
+      PERROR("BUG BUG BUG: video queue overflow");
+    }
+  }
+  else if ( !ccring_push(&ff->aq, frm) ) {
+    PERROR("BUG BUG BUG: audio queue overflow");
+  }
+  else if ( (int) ccring_size(&ff->aq) < ff->audio_wakeup_batch ) {
+    /* let audio accumulate, the encoder drains it in one pass */
+    return;
+  }
+
+  ccwake_signal(&ff->wake);
 }
 
 struct frm * pop_video_frame(ff_output_stream * ff)
 {
   struct frm * frm = NULL;
 
-  ctx_lock(ff);
-
   ++ff->stats.framesRead;
 
-  if ( ff->state == ff_output_stream_established ) {
-    frm = ccfifo_ppop(&ff->vp);
+  if ( enter_producer(ff) ) {
+    if ( !(frm = ccring_pop(&ff->vp)) ) {
+      ++ff->stats.videoDropsNoBuffer;
+    }
+    leave_producer(ff);
   }
 
-  ctx_unlock(ff);
-
   return frm;
 }
 
-void push_video_frame(ff_output_stream * ff, struct frm * frm)
+void release_video_frame(ff_output_stream * ff, struct frm * frm)
 {
-  frm->type = frm_type_video;
-  frm->pts = ffmpeg_gettime_ms();
+  /* vp has the encoder as its only producer, the frame goes back through vo */
+  if ( !ccring_push(&ff->vo, frm) ) {
+    PERROR("BUG BUG BUG: vo overflow");
+  }
 
-  ctx_lock(ff);
+  --ff->stats.framesRead;
+}
 
-  if ( !ff->firstpts ) {
-    ff->firstpts = frm->pts;
+void push_video_frame(ff_output_stream * ff, struct frm * frm, int64_t capture_time)
+{
+  if ( !enter_producer(ff) ) {
+    /* the stream was restarted or stopped while the frame was out, encoder takes it back from vo */
+    if ( !ccring_push(&ff->vo, frm) ) {
+      PERROR("BUG BUG BUG: vo overflow");
+    }
+    return;
   }
 
-  frm->pts -= ff->firstpts;
-  frm->size = FRAME_DATA_SIZE(ff->cx, ff->cy);
-  ccfifo_ppush(&ff->q, frm);
+  if ( capture_time <= 0 ) {
+    capture_time = ffmpeg_gettime_us();
+  }
 
-  ctx_signal(ff);
-  ctx_unlock(ff);
+  frm->type = frm_type_video;
+  frm->pts = mediaclock_video_pts(&ff->clock, capture_time) / 1000;
+  frm->size = ff->frame_size;
+
+  if ( ff->recorder ) {
+    caprec_write(ff->recorder, caprec_video, capture_time, frm->data, frm->size);
+  }
+
+  enqueue_frame(ff, frm);
+
+  leave_producer(ff);
 }
 
-static void audio_capture_callback(void * cookie, void * bfr, size_t size)
+/*
+ * Capture backend thread, must never block.
+ *  bfr is data of a pool frame: it goes to the encoder as is and a fresh pool frame is lent to the backend instead.
+ *  If the pool is empty the same buffer is recorded over again.
+ */
+static void audio_capture_callback(void * cookie, void * bfr, size_t size, int64_t capture_time)
 {
   ff_output_stream * ff = cookie;
-  struct frm * frm = NULL;
-
-  ctx_lock(ff);
+  struct frm * frm = frmarena_frame(&ff->aa, bfr);
+  struct frm * fresh = NULL;
+  int slot;
 
   if ( !ff->interrupted ) {
 
-    ff->atime += ff->audio_samples_per_buffer;
-    if ( !ff->firstpts ) {
-      ff->firstpts = ffmpeg_gettime_ms();
+    for ( slot = 0; slot < AUDIO_CAPTURE_BUFFERS && ff->capfrms[slot] != frm; ++slot ) {
+    }
+
+    if ( slot == AUDIO_CAPTURE_BUFFERS ) {
+      PERROR("BUG BUG BUG: unknown capture buffer %p", bfr);
+      return;
     }
 
-    if ( ff->state == ff_output_stream_established && (frm = ccfifo_ppop(&ff->ap)) ) {
+    if ( enter_producer(ff) ) {
+
+      /* buffer has just been filled, stamp it now: the sample clock must advance even if the buffer is dropped */
+      const int64_t t = capture_time > 0 ? capture_time : ffmpeg_gettime_us();
+      const int64_t pts = mediaclock_audio_pts(&ff->clock, t, size / AUDIO_SAMPLE_SIZE);
+
+      if ( ff->recorder ) {
+        caprec_write(ff->recorder, caprec_audio, t, bfr, size);
+      }
 
-      frm->type = frm_type_audio;
-      frm->pts = ff->atime;
-      memcpy(frm->data, bfr, frm->size = size);
-      ccfifo_ppush(&ff->q, frm);
-      ctx_signal(ff);
+      if ( !(fresh = ccring_pop(&ff->ap)) ) {
+        ++ff->stats.audioDropsNoBuffer;
+      }
+      else {
+        frm->type = frm_type_audio;
+        frm->pts = pts;
+        frm->size = size;
+        enqueue_frame(ff, frm);
+        ff->capfrms[slot] = frm = fresh;
+      }
+      leave_producer(ff);
     }
 
-    if ( opensless_audio_capture_enqueue(ff->capdev, bfr, ff->audio_bytes_per_buffer) != 0 ) {
+    if ( capture_enqueue(ff->capdev, frm->data, ff->audio_bytes_per_buffer) != 0 ) {
       PERROR("BUG BUG BUG: audio_capture_enqueue() fails");
     }
   }
-  ctx_unlock(ff);
 }
 
 
@@ -1190,17 +2503,69 @@ const struct output_stream_stats * get_output_stream_stats(ff_output_stream * ff
 {
   int64_t t = ffmpeg_gettime_ms();
 
+  struct output_sink_stats st;
+  int64_t spool_bytes = 0, io_calls = 0;
+  int drops = 0, spool_packets = 0, spool_drops = 0;
+  int stalls = 0, timeouts = 0;
+
   ctx_lock(ff);
 
-  ff->stats.bytesRead = ff->stats.framesRead * FRAME_DATA_SIZE(ff->cx, ff->cy);
+  /* primary output reports send stats, drops are summed over all outputs */
+  for ( int i = 0; i < ff->nsinks; ++i ) {
+    if ( ff->sinks[i] ) {
+
+      output_sink_get_stats(ff->sinks[i], &st);
+      drops += st.drops;
+      spool_bytes += st.spoolBytes;
+      spool_packets += st.spoolPackets;
+      spool_drops += st.spoolDrops;
+      stalls += st.stalls;
+      timeouts += st.timeouts;
+
+      if ( i == 0 ) {
+        ff->stats.framesSent = st.framesSent;
+        ff->stats.bytesSent = st.bytesSent;
+        ff->stats.sendQueueSize = st.queueSize;
+        ff->stats.sendQueueCapacity = st.queueCapacity;
+        ff->stats.sendQueueMax = st.queueMax;
+        ff->stats.writeLatency = (int) (st.write_ms + 0.5);
+        ff->stats.interleaveDelay = (int) (st.interleave_ms + 0.5);
+        ff->stats.recoverTime = st.recover_ms;
+        io_calls = st.ioCalls;
+        ff->stats.stallP99 = st.stall_p99_ms;
+        ff->stats.stallMax = st.stall_max_ms;
+        if ( st.first_packet_time > 0 ) {
+          ff->stats.firstPacketTime = (int) (st.first_packet_time - ff->start_time);
+        }
+      }
+    }
+  }
+
+  if ( ff->nsinks ) {
+    ff->stats.sendDrops = drops;
+    ff->stats.spoolBytes = spool_bytes;
+    ff->stats.spoolPackets = spool_packets;
+    ff->stats.spoolDrops = spool_drops;
+    ff->stats.stalls = stalls;
+    ff->stats.stallTimeouts = timeouts;
+  }
+
+  ff->stats.bytesRead = ff->stats.framesRead * ff->frame_size;
+  ff->stats.clockDrift = (int) mediaclock_drift_us(&ff->clock);
+  ff->stats.clockCorrection = (int) mediaclock_offset_us(&ff->clock);
+  ff->stats.latencyP50 = (int) ((cchist_percentile(&ff->latency, 0.50) + 500) / 1000);
+  ff->stats.latencyP99 = (int) ((cchist_percentile(&ff->latency, 0.99) + 500) / 1000);
 
   if ( t > ff->stats.timer ) {
     ff->stats.inputFps = (ff->stats.framesRead - ff->stats.inputFpsMark) * 1000.0 / (t - ff->stats.timer);
     ff->stats.inputBitrate = (ff->stats.bytesRead - ff->stats.inputBitrateMark) * 8000LL / (t - ff->stats.timer);
     ff->stats.outputFps = (ff->stats.framesSent - ff->stats.outputFpsMark) * 1000.0 / (t - ff->stats.timer);
     ff->stats.outputBitrate = (ff->stats.bytesSent - ff->stats.outputBitrateMark) * 8000LL / (t - ff->stats.timer);
+    ff->stats.sendCalls = (int) ((io_calls - ff->io_calls_mark) * 1000 / (t - ff->stats.timer));
   }
 
+  ff->io_calls_mark = io_calls;
+
   ff->stats.timer = t;
   ff->stats.inputFpsMark = ff->stats.framesRead;
   ff->stats.inputBitrateMark = ff->stats.bytesRead;
@@ -36,23 +36,29 @@ enum ff_output_stream_state {
 } ff_output_stream_state;
 
 
-// Fixme: Only NV21 assumed
-#define FRAME_DATA_SIZE(cx,cy)  ((cx) * (cy) * 12 / 8)
-
-
 enum {
   frm_type_video,
   frm_type_audio
 };
 
+/* Pool frame, data is 64-byte aligned slot of the stream frame arena */
 struct frm {
   int64_t pts;
   uint32_t size;
   uint32_t type;
-  uint8_t data[];
+  uint8_t * data;
 };
 
 
+/* What to do with captured video frames when encoder can not keep up */
+typedef
+enum ff_drop_policy {
+  ff_drop_deadline = 0,   /* drop queued frames older than drop_deadline ms */
+  ff_drop_latest = 1,     /* encode only the newest queued frame, for live preview */
+  ff_drop_none = 2,       /* encode everything, drop only when no free buffers left */
+} ff_drop_policy;
+
+
 typedef
 struct ff_output_stream_event_callback {
   void (*stream_state_changed)(void * cookie, ff_output_stream * s,  ff_output_stream_state state, int reason);
@@ -63,14 +69,14 @@ struct ff_output_stream_event_callback {
 
 typedef
 struct create_output_stream_args {
-  const char * server;
+  const char * server;    /* one or more '|' separated output urls, the first one is primary */
   const char * format;
   const char * ffopts;
   const char * cvcodec;
   const char * cacodec;
   const ff_output_stream_event_callback * events_callback;
   void * cookie;
-  int cx, cy, pxfmt;
+  int cx, cy, pxfmt;      /* pxfmt is enum campixfmt_id, see campixfmt.h */
 
   int cvquality;
   int caquality;
@@ -81,7 +87,19 @@ struct create_output_stream_args {
   int cvbufs;
   int cabufs;
 
+  /* audio capture rate [Hz], 0 means 48000. Use the device native rate to keep Android resampler out */
+  int casamplerate;
+
   int gopsize;
+
+  ff_drop_policy drop_policy;
+  int drop_deadline;      /* [ms], 0 means default */
+
+  /* encoder frame size, 0 means camera frame size */
+  int ocx, ocy;
+
+  /* threads for frame conversion, 0 means one per cpu core */
+  int threads;
 } create_output_stream_args;
 
 
@@ -96,7 +114,12 @@ void * get_output_stream_cookie(const ff_output_stream * ctx);
 size_t get_video_frame_data_size(const ff_output_stream * ctx);
 
 struct frm * pop_video_frame(ff_output_stream * ctx);
-void push_video_frame(ff_output_stream * ctx, struct frm * frm);
+/* capture_time: CLOCK_MONOTONIC [us] when the camera delivered the frame, 0 means now */
+void push_video_frame(ff_output_stream * ctx, struct frm * frm, int64_t capture_time);
+/* give back frame of pop_video_frame() which was not filled, it is not encoded. Camera thread only */
+void release_video_frame(ff_output_stream * ctx, struct frm * frm);
+/* pool frame whose data is bfr, for capture backends which give back data pointers only */
+struct frm * get_video_frame_by_data(ff_output_stream * ctx, const void * bfr);
 
 
 struct output_stream_stats {
@@ -107,6 +130,55 @@ struct output_stream_stats {
   int64_t inputFpsMark, outputFpsMark;
   double  inputFps, outputFps;
   int inputBitrate, outputBitrate;
+
+  /* pipeline stages: captured frames waiting for encoder, encoded packets waiting for network writer */
+  int encodeQueueSize, encodeQueueCapacity, encodeQueueMax;
+  int sendQueueSize, sendQueueCapacity, sendQueueMax;
+
+  /* adaptive bitrate: current target and qp, last decision (0 steady, 1 decrease, 2 increase), decision counters */
+  int rateBitrate, rateQp, rateDecision;
+  int rateDecreases, rateIncreases;
+
+  /* smoothed network write duration, smoothed time packets wait in interleaver [ms] */
+  int writeLatency;
+  int interleaveDelay;
+
+  /* outputs: configured, currently connected, packets dropped on backlog overflows */
+  int outputsCount, outputsConnected;
+
+  /* primary output: time from link loss to reconnect, time from start to the first packet written [ms] */
+  int recoverTime;
+  int firstPacketTime;
+
+  /* audio device clock against monotonic clock: filtered drift, correction applied to audio pts [us] */
+  int clockDrift, clockCorrection;
+  int sendDrops;
+
+  /* store-and-forward spool of all outputs: backlog on disk, packets evicted on overflow */
+  int64_t spoolBytes;
+  int spoolPackets, spoolDrops;
+
+  /* dropped frames by reason: no free capture buffer, too old when reached encoder, replaced by newer frame */
+  int videoDropsNoBuffer, videoDropsLate, videoDropsSuperseded;
+  int audioDropsNoBuffer;
+
+  /* encoder thread: wakeups from park, context switches (voluntary and involuntary) per second */
+  int encoderWakeups, encoderSwitches;
+
+  /* capture to wire latency of video frames on primary output since stream start, percentiles [ms] */
+  int latencyP50, latencyP99;
+
+  /* primary output socket syscalls per second, tcp:// and udp:// outputs without -ffmpeg_io only */
+  int sendCalls;
+
+  /* output operations blocked longer than 50 ms and aborted on exceeded time budget (all outputs),
+   *  primary output stall durations [ms] */
+  int stalls, stallTimeouts;
+  int stallP99, stallMax;
+
+  /* -motion_detect: changed 64x64 tiles of last frame [per mille], frames encoded from previous picture
+   *  without conversion, frames not encoded at all by -static_fps */
+  int motionScore, staticRepeats, videoDropsStatic;
 };
 
 
@@ -0,0 +1,172 @@
+/*
+ * slicepool.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include "slicepool.h"
+#include "pthread_wait.h"
+#include "debug.h"
+#include <string.h>
+
+#define SLICEPOOL_MAX_THREADS   16
+
+
+struct slicepool {
+  pthread_wait_t lock;
+  pthread_t pids[SLICEPOOL_MAX_THREADS];
+  int nthreads;     /* including the caller of slicepool_run() */
+
+  slicepool_job job;
+  void * arg;
+  int nslices;
+  int next;         /* next slice to grab */
+  int done;         /* number of completed slices */
+  unsigned generation;
+  bool stop:1;
+};
+
+
+/* Grab and process slices of current job until none left, called with lock held */
+static void run_slices(slicepool * pool)
+{
+  slicepool_job job;
+  void * arg;
+  int slice, nslices;
+
+  while ( pool->next < pool->nslices ) {
+
+    job = pool->job;
+    arg = pool->arg;
+    nslices = pool->nslices;
+    slice = pool->next++;
+
+    pthread_wait_unlock(&pool->lock);
+    job(arg, slice, nslices);
+    pthread_wait_lock(&pool->lock);
+
+    if ( ++pool->done == nslices ) {
+      pthread_wait_broadcast(&pool->lock);
+    }
+  }
+}
+
+static void * slicepool_thread(void * arg)
+{
+  slicepool * pool = arg;
+  unsigned generation = 0;
+
+  pthread_wait_lock(&pool->lock);
+
+  while ( !pool->stop ) {
+
+    if ( pool->generation == generation ) {
+      pthread_wait(&pool->lock, -1);
+      continue;
+    }
+
+    generation = pool->generation;
+    run_slices(pool);
+  }
+
+  pthread_wait_unlock(&pool->lock);
+
+  return NULL;
+}
+
+
+slicepool * slicepool_create(int nthreads)
+{
+  slicepool * pool = NULL;
+  int status;
+
+  if ( nthreads <= 0 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    nthreads = 1;
+  }
+
+  if ( nthreads > SLICEPOOL_MAX_THREADS ) {
+    nthreads = SLICEPOOL_MAX_THREADS;
+  }
+
+  if ( !(pool = calloc(1, sizeof(*pool))) ) {
+    PERROR("calloc(slicepool) fails");
+    goto end;
+  }
+
+  if ( (status = pthread_wait_init(&pool->lock)) ) {
+    PERROR("pthread_wait_init() fails: %s", strerror(status));
+    free(pool);
+    pool = NULL;
+    goto end;
+  }
+
+  pool->nthreads = 1;
+
+  for ( int i = 1; i < nthreads; ++i ) {
+    if ( (status = pthread_create(&pool->pids[i], NULL, slicepool_thread, pool)) ) {
+      PERROR("pthread_create(slicepool_thread) fails: %s", strerror(status));
+      break;
+    }
+    ++pool->nthreads;
+  }
+
+  PDBG("slicepool: %d threads", pool->nthreads);
+
+end:
+
+  return pool;
+}
+
+void slicepool_destroy(slicepool ** pool)
+{
+  if ( pool && *pool ) {
+
+    pthread_wait_lock(&(*pool)->lock);
+    (*pool)->stop = true;
+    pthread_wait_broadcast(&(*pool)->lock);
+    pthread_wait_unlock(&(*pool)->lock);
+
+    for ( int i = 1; i < (*pool)->nthreads; ++i ) {
+      pthread_join((*pool)->pids[i], NULL);
+    }
+
+    pthread_wait_destroy(&(*pool)->lock);
+    free(*pool);
+    *pool = NULL;
+  }
+}
+
+int slicepool_threads(const slicepool * pool)
+{
+  return pool ? pool->nthreads : 1;
+}
+
+void slicepool_run(slicepool * pool, slicepool_job job, void * arg, int nslices)
+{
+  if ( !pool || pool->nthreads < 2 || nslices < 2 ) {
+    for ( int i = 0; i < nslices; ++i ) {
+      job(arg, i, nslices);
+    }
+    return;
+  }
+
+  pthread_wait_lock(&pool->lock);
+
+  pool->job = job;
+  pool->arg = arg;
+  pool->nslices = nslices;
+  pool->next = 0;
+  pool->done = 0;
+  ++pool->generation;
+
+  pthread_wait_broadcast(&pool->lock);
+
+  run_slices(pool);
+
+  while ( pool->done < nslices ) {
+    pthread_wait(&pool->lock, -1);
+  }
+
+  pthread_wait_unlock(&pool->lock);
+}
@@ -0,0 +1,49 @@
+/*
+ * slicepool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Fixed set of worker threads which run a job over the slices of a frame
+ */
+
+#pragma once
+
+#ifndef __slicepool_h__
+#define __slicepool_h__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct slicepool
+  slicepool;
+
+/* Process slice number 'slice' of 'nslices' */
+typedef void (*slicepool_job)(void * arg, int slice, int nslices);
+
+
+/**
+ * Create pool with nthreads - 1 workers, the caller of slicepool_run() is the last one.
+ *  nthreads <= 0 means one thread per online cpu core.
+ */
+slicepool * slicepool_create(int nthreads);
+
+void slicepool_destroy(slicepool ** pool);
+
+/** Total number of threads which run the slices, including the caller */
+int slicepool_threads(const slicepool * pool);
+
+/** Run job over nslices in parallel, returns when all slices are done */
+void slicepool_run(slicepool * pool, slicepool_job job, void * arg, int nslices);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __slicepool_h__ */
@@ -0,0 +1,345 @@
+/*
+ * spool.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __ANDROID__
+# include <android/api-level.h>
+#endif
+#include "spool.h"
+#include "debug.h"
+
+#define SPOOL_MAX_SEGMENTS  256
+#define SPOOL_RECORD_MAGIC  0x4C4F4F53  /* 'SOOL' */
+#define SPOOL_ZERO_CHUNK    (64 * 1024)
+
+
+/* Packet record in segment file, followed by pkt data */
+struct spool_record {
+  uint32_t magic;
+  uint32_t size;
+  int32_t stream_index;
+  int32_t flags;
+  int64_t pts, dts, duration;
+};
+
+struct spool_segment {
+  int fd;
+  int64_t used;     /* bytes written */
+  int npkts;        /* packets not yet read */
+  char * path;
+};
+
+struct spool {
+  struct spool_segment seg[SPOOL_MAX_SEGMENTS];
+  int nsegments;
+  int64_t segsize;
+
+  int wseg, rseg;   /* write and read segment */
+  int64_t rpos;     /* read position in rseg */
+
+  int npkts;
+  int64_t nbytes;
+};
+
+
+/*
+ * Reserve disk space of segment file from offset up to size, returns 0 or errno.
+ *  bionic has posix_fallocate() since android-21 only, older platforms write zeros
+ *  as glibc does on filesystems without fallocate().
+ */
+static int preallocate(int fd, int64_t offset, int64_t size)
+{
+#if defined(__ANDROID__) && __ANDROID_API__ < 21
+  static const uint8_t zeros[SPOOL_ZERO_CHUNK];
+  ssize_t n;
+
+  if ( lseek(fd, offset, SEEK_SET) != offset ) {
+    return errno;
+  }
+
+  for ( ; offset < size; offset += n ) {
+    if ( (n = write(fd, zeros, FFMIN(size - offset, SPOOL_ZERO_CHUNK))) < 0 ) {
+      if ( errno != EINTR ) {
+        return errno;
+      }
+      n = 0;
+    }
+  }
+
+  return 0;
+#else
+  return posix_fallocate(fd, offset, size - offset);
+#endif
+}
+
+
+spool * spool_create(const char * dir, const char * prefix, int64_t max_bytes, int nsegments)
+{
+  spool * sp = NULL;
+  struct spool_segment * seg;
+  struct stat st;
+  int status;
+
+  bool fok = false;
+
+  if ( !dir || !*dir || nsegments < 2 || nsegments > SPOOL_MAX_SEGMENTS || max_bytes / nsegments < 65536 ) {
+    PERROR("invalid args: dir=%s max_bytes=%"PRId64" nsegments=%d", dir, max_bytes, nsegments);
+    errno = EINVAL;
+    goto end;
+  }
+
+  /* segments are addressed by off_t, which is 32-bit on armeabi-v7a */
+  if ( sizeof(off_t) < sizeof(int64_t) && max_bytes / nsegments > INT32_MAX ) {
+    PERROR("spool segment size %"PRId64" exceeds 2 GiB, use more segments", max_bytes / nsegments);
+    errno = EFBIG;
+    goto end;
+  }
+
+  if ( mkdir(dir, 0775) != 0 && errno != EEXIST ) {
+    PERROR("mkdir('%s') fails: %s", dir, strerror(errno));
+    goto end;
+  }
+
+  if ( !(sp = av_mallocz(sizeof(*sp))) ) {
+    goto end;
+  }
+
+  for ( int i = 0; i < SPOOL_MAX_SEGMENTS; ++i ) {
+    sp->seg[i].fd = -1;
+  }
+
+  sp->nsegments = nsegments;
+  sp->segsize = max_bytes / nsegments;
+
+  for ( int i = 0; i < nsegments; ++i ) {
+
+    seg = &sp->seg[i];
+
+    if ( !(seg->path = av_asprintf("%s/%s-%03d.spool", dir, prefix ? prefix : "spool", i)) ) {
+      goto end;
+    }
+
+    /* files of previous sessions are reused as they are, only the missing tail is allocated */
+    if ( (seg->fd = open(seg->path, O_RDWR | O_CREAT | O_CLOEXEC, 0664)) < 0 || fstat(seg->fd, &st) != 0 ) {
+      PERROR("open('%s') fails: %s", seg->path, strerror(errno));
+      goto end;
+    }
+
+    /* reserve disk space now so an outage can not fail on ENOSPC */
+    if ( st.st_size < sp->segsize && (status = preallocate(seg->fd, st.st_size, sp->segsize)) ) {
+      PERROR("preallocate('%s', %"PRId64") fails: %s", seg->path, sp->segsize, strerror(status));
+      errno = status;
+      goto end;
+    }
+
+    if ( st.st_size > sp->segsize && ftruncate(seg->fd, sp->segsize) != 0 ) {
+      PDBG("ftruncate('%s', %"PRId64") fails: %s", seg->path, sp->segsize, strerror(errno));
+    }
+  }
+
+  PDBG("spool '%s/%s': %d x %"PRId64" bytes", dir, prefix, nsegments, sp->segsize);
+
+  fok = true;
+
+end:
+
+  if ( !fok && sp ) {
+    spool_destroy(&sp);
+  }
+
+  return sp;
+}
+
+
+void spool_destroy(spool ** psp)
+{
+  spool * sp;
+
+  if ( psp && (sp = *psp) ) {
+
+    for ( int i = 0; i < sp->nsegments; ++i ) {
+      if ( sp->seg[i].fd >= 0 ) {
+        close(sp->seg[i].fd);
+      }
+      if ( sp->seg[i].path ) {
+        av_free(sp->seg[i].path);
+      }
+    }
+
+    av_freep(psp);
+  }
+}
+
+
+void spool_reset(spool * sp)
+{
+  for ( int i = 0; i < sp->nsegments; ++i ) {
+    sp->seg[i].used = 0;
+    sp->seg[i].npkts = 0;
+  }
+
+  sp->wseg = sp->rseg = 0;
+  sp->rpos = 0;
+  sp->npkts = 0;
+  sp->nbytes = 0;
+}
+
+
+/* Drop unread packets of read segment and move reader to the next one */
+static int evict_segment(spool * sp)
+{
+  struct spool_segment * seg = &sp->seg[sp->rseg];
+  int evicted = seg->npkts;
+
+  sp->npkts -= seg->npkts;
+  sp->nbytes -= seg->used - sp->rpos;
+  seg->npkts = 0;
+  seg->used = 0;
+
+  sp->rseg = (sp->rseg + 1) % sp->nsegments;
+  sp->rpos = 0;
+
+  return evicted;
+}
+
+
+int spool_write(spool * sp, const AVPacket * pkt)
+{
+  struct spool_segment * seg;
+  struct spool_record hdr;
+  const int64_t size = sizeof(hdr) + pkt->size;
+  int next, evicted = 0;
+
+  if ( size > sp->segsize ) {
+    return AVERROR(EFBIG);
+  }
+
+  seg = &sp->seg[sp->wseg];
+
+  if ( seg->used + size > sp->segsize ) {
+
+    next = (sp->wseg + 1) % sp->nsegments;
+
+    if ( next == sp->rseg && sp->npkts > 0 ) {
+      /* ring is full, the oldest data goes away */
+      evicted = evict_segment(sp);
+    }
+
+    sp->wseg = next;
+    seg = &sp->seg[next];
+    seg->used = 0;
+    seg->npkts = 0;
+  }
+
+  hdr = (struct spool_record ) {
+        .magic = SPOOL_RECORD_MAGIC,
+        .size = pkt->size,
+        .stream_index = pkt->stream_index,
+        .flags = pkt->flags,
+        .pts = pkt->pts,
+        .dts = pkt->dts,
+        .duration = pkt->duration,
+      };
+
+  if ( pwrite(seg->fd, &hdr, sizeof(hdr), seg->used) != sizeof(hdr) ||
+      (pkt->size > 0 && pwrite(seg->fd, pkt->data, pkt->size, seg->used + sizeof(hdr)) != pkt->size) ) {
+    int status = AVERROR(errno ? errno : EIO);
+    PERROR("pwrite('%s') fails: %s", seg->path, av_err2str(status));
+    return status;
+  }
+
+  seg->used += size;
+  ++seg->npkts;
+  ++sp->npkts;
+  sp->nbytes += size;
+
+  return evicted;
+}
+
+
+int spool_read(spool * sp, AVPacket * pkt)
+{
+  struct spool_segment * seg;
+  struct spool_record hdr;
+  int status;
+
+  if ( sp->npkts < 1 ) {
+    return AVERROR_EOF;
+  }
+
+  seg = &sp->seg[sp->rseg];
+
+  while ( seg->npkts < 1 ) {
+    /* reader has finished this segment, writer is ahead */
+    seg->used = 0;
+    sp->rseg = (sp->rseg + 1) % sp->nsegments;
+    sp->rpos = 0;
+    seg = &sp->seg[sp->rseg];
+  }
+
+  if ( pread(seg->fd, &hdr, sizeof(hdr), sp->rpos) != sizeof(hdr) ) {
+    status = AVERROR(errno ? errno : EIO);
+    PERROR("pread('%s') fails: %s", seg->path, av_err2str(status));
+    return status;
+  }
+
+  if ( hdr.magic != SPOOL_RECORD_MAGIC || sp->rpos + (int64_t) sizeof(hdr) + hdr.size > seg->used ) {
+    PERROR("corrupted record in '%s' at %"PRId64", drop segment", seg->path, sp->rpos);
+    evict_segment(sp);
+    return AVERROR_INVALIDDATA;
+  }
+
+  if ( (status = av_new_packet(pkt, hdr.size)) < 0 ) {
+    return status;
+  }
+
+  if ( hdr.size > 0 && pread(seg->fd, pkt->data, hdr.size, sp->rpos + sizeof(hdr)) != hdr.size ) {
+    status = AVERROR(errno ? errno : EIO);
+    PERROR("pread('%s') fails: %s", seg->path, av_err2str(status));
+    av_packet_unref(pkt);
+    return status;
+  }
+
+  pkt->stream_index = hdr.stream_index;
+  pkt->flags = hdr.flags;
+  pkt->pts = hdr.pts;
+  pkt->dts = hdr.dts;
+  pkt->duration = hdr.duration;
+
+  sp->rpos += sizeof(hdr) + hdr.size;
+  sp->nbytes -= sizeof(hdr) + hdr.size;
+  --seg->npkts;
+
+  if ( --sp->npkts == 0 ) {
+    /* rewind to keep the working set small */
+    spool_reset(sp);
+  }
+
+  return 0;
+}
+
+
+bool spool_is_empty(const spool * sp)
+{
+  return sp->npkts == 0;
+}
+
+int spool_packets(const spool * sp)
+{
+  return sp->npkts;
+}
+
+int64_t spool_bytes(const spool * sp)
+{
+  return sp->nbytes;
+}
+
+int64_t spool_capacity(const spool * sp)
+{
+  return sp->segsize * sp->nsegments;
+}
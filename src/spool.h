@@ -0,0 +1,62 @@
+/*
+ * spool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  On-disk ring of encoded packets: fixed number of preallocated segment files.
+ *  When the ring is full the oldest segment is evicted.
+ *  Not thread safe, the caller serializes spool_write() and spool_read().
+ */
+
+#pragma once
+
+#ifndef __spool_h__
+#define __spool_h__
+
+#include "ffmpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct spool
+  spool;
+
+
+/**
+ * Create nsegments segment files '<prefix>-<k>.spool' in directory dir,
+ *  each one preallocated to max_bytes / nsegments.
+ */
+spool * spool_create(const char * dir, const char * prefix, int64_t max_bytes, int nsegments);
+
+/* closes segment files, they are kept on disk for reuse by next spool_create() */
+void spool_destroy(spool ** sp);
+
+/**
+ * Append packet to the ring.
+ *  Returns number of packets evicted (>= 0) to make room, or negative AVERROR code.
+ */
+int spool_write(spool * sp, const AVPacket * pkt);
+
+/**
+ * Read the oldest packet into pkt, which must be blank.
+ *  Returns 0 on success, AVERROR_EOF if the spool is empty, or negative AVERROR code
+ */
+int spool_read(spool * sp, AVPacket * pkt);
+
+/* drop everything spooled */
+void spool_reset(spool * sp);
+
+bool spool_is_empty(const spool * sp);
+int spool_packets(const spool * sp);
+int64_t spool_bytes(const spool * sp);
+int64_t spool_capacity(const spool * sp);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __spool_h__ */
@@ -0,0 +1,116 @@
+/*
+ * audioconv-bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Measure CPU cost of the capture -> encoder audio stage for typical rate pairs
+ *
+ *  Usage: audioconv-bench [seconds of audio]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "audioconv.h"
+#include "ffmpeg.h"
+
+
+static double get_cputime_ms(void)
+{
+  struct timespec tm;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tm);
+  return (double) tm.tv_sec * 1e3 + (double) tm.tv_nsec * 1e-6;
+}
+
+static void bench_pair(int in_rate, int out_rate, enum AVSampleFormat out_fmt, int frame_size, int seconds)
+{
+  const int nb_in = in_rate / 50;   /* 20 ms capture buffers */
+  const int nbuffers = seconds * 50;
+
+  audioconv * ac = NULL;
+  AVFrame * frame = NULL;
+  int16_t * samples = NULL;
+  int64_t pts = 0, nb_out = 0;
+  double t0, ms;
+  int status;
+
+  if ( !(samples = av_malloc(nb_in * sizeof(*samples))) ) {
+    fprintf(stderr, "av_malloc() fails\n");
+    goto end;
+  }
+
+  /* 1 kHz tone */
+  for ( int i = 0; i < nb_in; ++i ) {
+    samples[i] = (int16_t) (8000 * sin(2 * M_PI * 1000 * i / in_rate));
+  }
+
+  if ( !(ac = audioconv_create(in_rate, out_fmt, out_rate, frame_size)) ) {
+    fprintf(stderr, "audioconv_create(%d -> %d) fails\n", in_rate, out_rate);
+    goto end;
+  }
+
+  if ( (status = ffmpeg_create_audio_frame(&frame, out_fmt, out_rate, frame_size, 1, AV_CH_LAYOUT_MONO)) ) {
+    fprintf(stderr, "ffmpeg_create_audio_frame() fails: %s\n", av_err2str(status));
+    goto end;
+  }
+
+  t0 = get_cputime_ms();
+
+  for ( int i = 0; i < nbuffers; ++i, pts += nb_in ) {
+    if ( (status = audioconv_write(ac, samples, nb_in, pts)) < 0 ) {
+      fprintf(stderr, "audioconv_write() fails: %s\n", av_err2str(status));
+      goto end;
+    }
+    while ( audioconv_read(ac, frame) > 0 ) {
+      nb_out += frame->nb_samples;
+    }
+  }
+
+  ms = get_cputime_ms() - t0;
+
+  printf("%6d -> %-6d %-5s %-11s %8.4f ms/buffer %6.3f%% of realtime  out=%"PRId64"/%"PRId64"\n",
+      in_rate, out_rate, av_get_sample_fmt_name(out_fmt),
+      audioconv_is_passthrough(ac) ? "passthrough" : "swr",
+      ms / nbuffers, 100 * ms / (seconds * 1e3),
+      nb_out, (int64_t) seconds * out_rate);
+
+end:
+
+  av_frame_free(&frame);
+  audioconv_destroy(&ac);
+  av_free(samples);
+}
+
+
+int main(int argc, char *argv[])
+{
+  static const struct {
+    int in_rate, out_rate;
+    enum AVSampleFormat out_fmt;
+    int frame_size;
+  } pairs[] = {
+    { 8000, 8000, AV_SAMPLE_FMT_S16P, 160 },      /* old pipeline: capture at encoder rate */
+    { 16000, 16000, AV_SAMPLE_FMT_S16P, 576 },
+    { 48000, 48000, AV_SAMPLE_FMT_S16P, 1152 },
+    { 48000, 44100, AV_SAMPLE_FMT_S16P, 1152 },   /* mp3 */
+    { 48000, 16000, AV_SAMPLE_FMT_S16P, 576 },
+    { 48000, 8000, AV_SAMPLE_FMT_S16, 160 },      /* amr-nb */
+    { 48000, 48000, AV_SAMPLE_FMT_FLTP, 1024 },   /* aac */
+    { 44100, 48000, AV_SAMPLE_FMT_FLTP, 1024 },
+  };
+
+  int seconds = 60;
+
+  if ( argc > 1 && (seconds = atoi(argv[1])) < 1 ) {
+    fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  for ( size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); ++i ) {
+    bench_pair(pairs[i].in_rate, pairs[i].out_rate, pairs[i].out_fmt, pairs[i].frame_size, seconds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,574 @@
+/*
+ * ffbench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  End-to-end streaming benchmark:
+ *    synthetic camera and tone -> encoder -> muxer -> loopback tcp / udp receiver or file,
+ *  for every combination of the listed parameters. Results go to stdout as JSON array, one object per run.
+ *
+ *  Usage: ffbench [options]
+ *    -s WxH[,WxH...]     video frame sizes, default 640x480
+ *    -r fps[,fps...]     video frame rates, default 25
+ *    -vcodec list        video codecs, 'all' for every supported one, default libx264
+ *    -acodec list        audio codecs, 'all' for every supported one, 'none', default libmp3lame
+ *    -f list             containers, default matroska
+ *    -sink list          tcp, udp, file, default tcp
+ *    -vq quality         video quality 1..100
+ *    -vb bitrate         video target bitrate [bps], checked against measured payload bitrate
+ *    -ab bitrate         audio bitrate [bps], part of the target
+ *    -g gop              gop size
+ *    -t seconds          measured time per run, default 10
+ *    -warmup seconds     not measured start of each run, default 2
+ *    -opts "ffopts"      extra stream options
+ *
+ *  Reported per run:
+ *    fps                 video frames written per second
+ *    cpu_ms_per_frame    process CPU time per written frame, loopback receiver excluded
+ *    latency_p50/p99     capture to wire latency of video frames [ms], over the whole run
+ *    stalls              output writes blocked longer than 50 ms, aborted ones, over the whole run
+ *    drops               frames dropped by the pipeline, by reason
+ *    payload_kbps        encoded bitrate, wire_kbps with container and transport overhead
+ *    bitrate_error       payload / target - 1 when -vb is given
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sendvideo.h"
+#include "capture.h"
+#include "capture-feed.h"
+#include "campixfmt.h"
+#include "ffmpeg.h"
+#include "debug.h"
+
+#define MAX_LIST                16
+
+
+/* Loopback end of the stream: counts what arrives, discards it */
+struct receiver {
+  const char * kind;
+  char url[256];
+  char path[64];        /* file sink */
+  int fd;               /* listening tcp or bound udp socket */
+  pthread_t pid;
+  clockid_t cpuclock;
+  bool started;
+  atomic_bool stop;
+  _Atomic int64_t bytes;
+};
+
+struct run {
+  int cx, cy, fps;
+  const char * vcodec, * acodec, * format, * sink;
+};
+
+struct sample {
+  int64_t t;            /* [us] */
+  double cpu_ms;        /* process */
+  double rcv_cpu_ms;    /* receiver thread */
+  int64_t framesRead, framesSent, bytesSent, wireBytes;
+  int64_t drops[5];
+};
+
+
+static volatile sig_atomic_t interrupted;
+
+static void on_signal(int sig)
+{
+  (void) sig;
+  interrupted = 1;
+}
+
+
+static double get_cputime_ms(clockid_t clk)
+{
+  struct timespec tm;
+  clock_gettime(clk, &tm);
+  return (double) tm.tv_sec * 1e3 + (double) tm.tv_nsec * 1e-6;
+}
+
+static int split_list(char * s, const char * items[MAX_LIST])
+{
+  char * saveptr = NULL;
+  int n = 0;
+
+  for ( char * tok = strtok_r(s, ",", &saveptr); tok && n < MAX_LIST; tok = strtok_r(NULL, ",", &saveptr) ) {
+    items[n++] = tok;
+  }
+
+  return n;
+}
+
+/* 'all' expands to supported codecs which are compiled into this ffmpeg */
+static int codec_list(char * s, enum codec_type type, const char * items[MAX_LIST])
+{
+  const struct codec_opts * c;
+  int n = 0;
+
+  if ( strcmp(s, "all") != 0 ) {
+    return split_list(s, items);
+  }
+
+  for ( c = get_supported_codecs(); c->name && n < MAX_LIST; ++c ) {
+    if ( c->type == type && strcmp(c->name, "none") != 0 && avcodec_find_encoder_by_name(c->name) ) {
+      items[n++] = c->name;
+    }
+  }
+
+  return n;
+}
+
+
+static void * receiver_thread(void * arg)
+{
+  struct receiver * r = arg;
+  struct pollfd pfd = { .events = POLLIN };
+  int cfd = -1;
+  ssize_t n;
+
+  static uint8_t bfr[256 * 1024];
+
+  while ( !atomic_load(&r->stop) ) {
+
+    if ( strcmp(r->kind, "tcp") == 0 && cfd < 0 ) {
+      pfd.fd = r->fd;
+      if ( poll(&pfd, 1, 100) > 0 && (cfd = accept(r->fd, NULL, NULL)) < 0 ) {
+        PERROR("accept() fails: %s", strerror(errno));
+        break;
+      }
+      continue;
+    }
+
+    pfd.fd = cfd >= 0 ? cfd : r->fd;
+    if ( poll(&pfd, 1, 100) <= 0 ) {
+      continue;
+    }
+
+    if ( (n = recv(pfd.fd, bfr, sizeof(bfr), 0)) > 0 ) {
+      atomic_fetch_add(&r->bytes, n);
+    }
+    else if ( cfd >= 0 ) {
+      /* sender has reconnected */
+      close(cfd);
+      cfd = -1;
+    }
+  }
+
+  if ( cfd >= 0 ) {
+    close(cfd);
+  }
+
+  return NULL;
+}
+
+static int start_receiver(struct receiver * r, const char * kind)
+{
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+
+  socklen_t addrlen = sizeof(addr);
+  int rcvbuf = 4 * 1024 * 1024;
+  int status;
+
+  memset(r, 0, sizeof(*r));
+  r->kind = kind;
+  r->fd = -1;
+
+  if ( strcmp(kind, "file") == 0 ) {
+    strcpy(r->path, "/tmp/ffbench-XXXXXX");
+    if ( (r->fd = mkstemp(r->path)) < 0 ) {
+      status = AVERROR(errno);
+      PERROR("mkstemp() fails: %s", strerror(errno));
+      return status;
+    }
+    close(r->fd), r->fd = -1;
+    snprintf(r->url, sizeof(r->url), "file:%s", r->path);
+    return 0;
+  }
+
+  if ( strcmp(kind, "tcp") != 0 && strcmp(kind, "udp") != 0 ) {
+    PERROR("Invalid sink '%s', expected tcp, udp or file", kind);
+    return AVERROR(EINVAL);
+  }
+
+  if ( (r->fd = socket(AF_INET, *kind == 't' ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0 ) {
+    status = AVERROR(errno);
+    PERROR("socket() fails: %s", strerror(errno));
+    return status;
+  }
+
+  setsockopt(r->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  if ( bind(r->fd, (struct sockaddr*) &addr, sizeof(addr)) || getsockname(r->fd, (struct sockaddr*) &addr, &addrlen)
+      || (*kind == 't' && listen(r->fd, 4)) ) {
+    status = AVERROR(errno);
+    PERROR("bind() fails: %s", strerror(errno));
+    close(r->fd), r->fd = -1;
+    return status;
+  }
+
+  snprintf(r->url, sizeof(r->url), *kind == 't' ? "tcp://127.0.0.1:%d" : "udp://127.0.0.1:%d?pkt_size=1316",
+      ntohs(addr.sin_port));
+
+  if ( (status = pthread_create(&r->pid, NULL, receiver_thread, r)) ) {
+    PERROR("pthread_create() fails: %s", strerror(status));
+    close(r->fd), r->fd = -1;
+    return AVERROR(status);
+  }
+
+  pthread_getcpuclockid(r->pid, &r->cpuclock);
+  r->started = true;
+
+  return 0;
+}
+
+static int64_t receiver_bytes(struct receiver * r)
+{
+  struct stat st;
+
+  if ( *r->path ) {
+    return stat(r->path, &st) == 0 ? st.st_size : 0;
+  }
+
+  return atomic_load(&r->bytes);
+}
+
+static double receiver_cputime_ms(struct receiver * r)
+{
+  return r->started ? get_cputime_ms(r->cpuclock) : 0;
+}
+
+static void stop_receiver(struct receiver * r)
+{
+  if ( r->started ) {
+    atomic_store(&r->stop, true);
+    pthread_join(r->pid, NULL);
+    r->started = false;
+  }
+
+  if ( r->fd >= 0 ) {
+    close(r->fd), r->fd = -1;
+  }
+
+  if ( *r->path ) {
+    unlink(r->path);
+  }
+}
+
+
+static void take_sample(struct sample * s, ff_output_stream * ff, struct receiver * r)
+{
+  const struct output_stream_stats * st = get_output_stream_stats(ff);
+
+  s->t = ffmpeg_gettime_us();
+  s->cpu_ms = get_cputime_ms(CLOCK_PROCESS_CPUTIME_ID);
+  s->rcv_cpu_ms = receiver_cputime_ms(r);
+  s->framesRead = st->framesRead;
+  s->framesSent = st->framesSent;
+  s->bytesSent = st->bytesSent;
+  s->wireBytes = receiver_bytes(r);
+  s->drops[0] = st->videoDropsNoBuffer;
+  s->drops[1] = st->videoDropsLate;
+  s->drops[2] = st->videoDropsSuperseded;
+  s->drops[3] = st->audioDropsNoBuffer;
+  s->drops[4] = st->sendDrops;
+}
+
+
+static void print_result(const struct run * run, const create_output_stream_args * args, int status,
+    const struct sample * s0, const struct sample * s1, ff_output_stream * ff, bool first)
+{
+  const struct output_stream_stats * st;
+  const double dt = s1 ? (s1->t - s0->t) * 1e-6 : 0;
+  int64_t frames;
+
+  printf("%s  {\n", first ? "" : ",\n");
+  printf("    \"size\": \"%dx%d\", \"fps_target\": %d, \"vcodec\": \"%s\", \"acodec\": \"%s\", "
+      "\"format\": \"%s\", \"sink\": \"%s\",\n",
+      run->cx, run->cy, run->fps, run->vcodec, run->acodec, run->format, run->sink);
+
+  if ( status || dt <= 0 ) {
+    printf("    \"status\": \"%s\"\n  }", status ? av_err2str(status) : "no data");
+    return;
+  }
+
+  st = get_output_stream_stats(ff);
+  frames = s1->framesSent - s0->framesSent;
+
+  printf("    \"status\": \"ok\", \"seconds\": %.3f,\n", dt);
+  printf("    \"fps\": %.2f, \"fps_in\": %.2f,\n", frames / dt, (s1->framesRead - s0->framesRead) / dt);
+  printf("    \"cpu_ms_per_frame\": %.3f,\n",
+      frames > 0 ? ((s1->cpu_ms - s0->cpu_ms) - (s1->rcv_cpu_ms - s0->rcv_cpu_ms)) / frames : 0);
+  printf("    \"latency_p50_ms\": %d, \"latency_p99_ms\": %d,\n", st->latencyP50, st->latencyP99);
+  printf("    \"stalls\": %d, \"stall_timeouts\": %d, \"stall_p99_ms\": %d,\n", st->stalls, st->stallTimeouts,
+      st->stallP99);
+  printf("    \"drops\": { \"video_no_buffer\": %"PRId64", \"video_late\": %"PRId64", \"video_superseded\": %"PRId64", "
+      "\"audio_no_buffer\": %"PRId64", \"send\": %"PRId64" },\n",
+      s1->drops[0] - s0->drops[0], s1->drops[1] - s0->drops[1], s1->drops[2] - s0->drops[2],
+      s1->drops[3] - s0->drops[3], s1->drops[4] - s0->drops[4]);
+  printf("    \"payload_kbps\": %.1f, \"wire_kbps\": %.1f,\n", (s1->bytesSent - s0->bytesSent) * 8e-3 / dt,
+      (s1->wireBytes - s0->wireBytes) * 8e-3 / dt);
+
+  if ( args->cvbitrate > 0 ) {
+    /* audio is part of the payload, count its nominal bitrate into the target */
+    const double target = args->cvbitrate + (strcmp(run->acodec, "none") ? FFMAX(args->cabitrate, 0) : 0);
+    printf("    \"target_kbps\": %.1f, \"bitrate_error\": %.4f\n", target * 1e-3,
+        (s1->bytesSent - s0->bytesSent) * 8 / dt / target - 1);
+  }
+  else {
+    printf("    \"target_kbps\": null, \"bitrate_error\": null\n");
+  }
+
+  printf("  }");
+}
+
+
+static int bench(const struct run * run, create_output_stream_args * args, double warmup, double duration,
+    bool first)
+{
+  struct receiver r;
+  struct sample s0, s1;
+  bool measured = false;
+
+  capture_params params = {
+    .nbuffers = CAPTURE_FEED_BUFFERS,
+    .callback = capture_feed_callback,
+  };
+
+  capture_feed feed = {
+    .ff = NULL,
+  };
+
+  int64_t tstart, t;
+  int status;
+
+  fprintf(stderr, "%dx%d@%d %s/%s %s -> %s\n", run->cx, run->cy, run->fps, run->vcodec, run->acodec,
+      run->format, run->sink);
+
+  if ( (status = start_receiver(&r, run->sink)) ) {
+    print_result(run, args, status, NULL, NULL, NULL, first);
+    return status;
+  }
+
+  args->server = r.url;
+  args->format = run->format;
+  args->cvcodec = run->vcodec;
+  args->cacodec = run->acodec;
+  args->cx = run->cx;
+  args->cy = run->cy;
+
+  if ( !(feed.ff = create_output_stream(args)) ) {
+    status = AVERROR(errno ? errno : EINVAL);
+    goto end;
+  }
+
+  feed.frame_size = get_video_frame_data_size(feed.ff);
+
+  params.cx = run->cx;
+  params.cy = run->cy;
+  params.fps = run->fps;
+  params.cookie = &feed;
+
+  if ( (status = capture_create(&feed.src, capture_media_video, "nv21file", &params)) ) {
+    goto end;
+  }
+
+  if ( !start_output_stream(feed.ff) ) {
+    status = AVERROR_EXTERNAL;
+    goto end;
+  }
+
+  if ( (status = capture_start(feed.src)) ) {
+    goto end;
+  }
+
+  tstart = ffmpeg_gettime_ms();
+
+  while ( !interrupted && (t = ffmpeg_gettime_ms() - tstart) < (warmup + duration) * 1000 ) {
+
+    if ( !measured && t >= warmup * 1000 ) {
+      take_sample(&s0, feed.ff, &r);
+      measured = true;
+    }
+
+    capture_feed_refill(&feed);
+    usleep(2000);
+  }
+
+  if ( measured ) {
+    take_sample(&s1, feed.ff, &r);
+  }
+
+  if ( get_output_stream_state(feed.ff) != ff_output_stream_established ) {
+    status = AVERROR(ENOTCONN);
+  }
+
+end:
+
+  if ( feed.src ) {
+    capture_stop(feed.src);
+  }
+
+  print_result(run, args, status, &s0, measured ? &s1 : NULL, feed.ff, first);
+
+  if ( feed.ff ) {
+    stop_output_stream(feed.ff);
+  }
+
+  capture_destroy(&feed.src);
+  destroy_output_stream(feed.ff);
+  stop_receiver(&r);
+
+  return status;
+}
+
+
+int main(int argc, char *argv[])
+{
+  char * sizes = NULL, * rates = NULL, * vcodecs = NULL, * acodecs = NULL, * formats = NULL, * sinks = NULL;
+  const char * size_list[MAX_LIST], * rate_list[MAX_LIST];
+  const char * vcodec_list[MAX_LIST], * acodec_list[MAX_LIST];
+  const char * format_list[MAX_LIST], * sink_list[MAX_LIST];
+  int nsizes, nrates, nvcodecs, nacodecs, nformats, nsinks;
+  char * ffopts = NULL;
+  const char * extra_opts = "";
+  double warmup = 2, duration = 10;
+  int nruns = 0;
+
+  create_output_stream_args args = {
+    .pxfmt = campixfmt_nv21,
+    .cvquality = -1,
+    .caquality = -1,
+    .drop_policy = ff_drop_deadline,
+  };
+
+  struct run run;
+
+  for ( int i = 1; i < argc; ++i ) {
+
+    const char * arg = argv[i];
+    char * val = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if ( !val ) {
+      fprintf(stderr, "Missing value for %s\n", arg);
+      return 1;
+    }
+
+    ++i;
+
+    if ( strcmp(arg, "-s") == 0 ) {
+      sizes = val;
+    }
+    else if ( strcmp(arg, "-r") == 0 ) {
+      rates = val;
+    }
+    else if ( strcmp(arg, "-vcodec") == 0 ) {
+      vcodecs = val;
+    }
+    else if ( strcmp(arg, "-acodec") == 0 ) {
+      acodecs = val;
+    }
+    else if ( strcmp(arg, "-f") == 0 ) {
+      formats = val;
+    }
+    else if ( strcmp(arg, "-sink") == 0 ) {
+      sinks = val;
+    }
+    else if ( strcmp(arg, "-vq") == 0 ) {
+      args.cvquality = atoi(val);
+    }
+    else if ( strcmp(arg, "-vb") == 0 ) {
+      args.cvbitrate = atoi(val);
+    }
+    else if ( strcmp(arg, "-ab") == 0 ) {
+      args.cabitrate = atoi(val);
+    }
+    else if ( strcmp(arg, "-g") == 0 ) {
+      args.gopsize = atoi(val);
+    }
+    else if ( strcmp(arg, "-t") == 0 ) {
+      duration = atof(val);
+    }
+    else if ( strcmp(arg, "-warmup") == 0 ) {
+      warmup = atof(val);
+    }
+    else if ( strcmp(arg, "-opts") == 0 ) {
+      extra_opts = val;
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-s WxH,..] [-r fps,..] [-vcodec list|all] [-acodec list|all|none] [-f list] "
+          "[-sink tcp,udp,file] [-vq quality] [-vb bitrate] [-ab bitrate] [-g gop] [-t seconds] [-warmup seconds] "
+          "[-opts \"ffopts\"]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  g_log_level = LOG_ERR;
+
+  av_log_set_level(AV_LOG_ERROR);
+  av_register_all();
+  avformat_network_init();
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  nsizes = split_list(sizes ? sizes : (char[]) { "640x480" }, size_list);
+  nrates = split_list(rates ? rates : (char[]) { "25" }, rate_list);
+  nvcodecs = codec_list(vcodecs ? vcodecs : (char[]) { "libx264" }, codec_type_video, vcodec_list);
+  nacodecs = codec_list(acodecs ? acodecs : (char[]) { "libmp3lame" }, codec_type_audio, acodec_list);
+  nformats = split_list(formats ? formats : (char[]) { "matroska" }, format_list);
+  nsinks = split_list(sinks ? sinks : (char[]) { "tcp" }, sink_list);
+
+  printf("[\n");
+
+  for ( int is = 0; is < nsizes && !interrupted; ++is ) {
+    if ( sscanf(size_list[is], "%dx%d", &run.cx, &run.cy) != 2 || run.cx < 2 || run.cy < 2 ) {
+      fprintf(stderr, "Invalid frame size %s\n", size_list[is]);
+      continue;
+    }
+    for ( int ir = 0; ir < nrates && !interrupted; ++ir ) {
+      if ( (run.fps = atoi(rate_list[ir])) < 1 ) {
+        fprintf(stderr, "Invalid frame rate %s\n", rate_list[ir]);
+        continue;
+      }
+      for ( int iv = 0; iv < nvcodecs && !interrupted; ++iv ) {
+        for ( int ia = 0; ia < nacodecs && !interrupted; ++ia ) {
+          for ( int iff = 0; iff < nformats && !interrupted; ++iff ) {
+            for ( int ik = 0; ik < nsinks && !interrupted; ++ik ) {
+
+              run.vcodec = vcodec_list[iv];
+              run.acodec = acodec_list[ia];
+              run.format = format_list[iff];
+              run.sink = sink_list[ik];
+
+              /* synthetic 440 Hz tone as microphone */
+              av_free(ffopts);
+              ffopts = av_asprintf("%s%s", strcmp(run.acodec, "none") ? "-audio_source pcmfile " : "", extra_opts);
+              args.ffopts = ffopts;
+
+              bench(&run, &args, warmup, duration, nruns++ == 0);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  printf("\n]\n");
+
+  av_free(ffopts);
+
+  return 0;
+}
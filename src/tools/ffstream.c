@@ -0,0 +1,320 @@
+/*
+ * ffstream.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Host command line front end of the streaming core:
+ *    capture backend -> encoder -> muxer -> outputs, the same pipeline as on device.
+ *
+ *  Usage: ffstream [options] url
+ *    -s WxH              video frame size, default 640x480
+ *    -r fps              video frame rate, default 25
+ *    -t seconds          stop after seconds, default until Ctrl+C
+ *    -f format           output format, default matroska
+ *    -vcodec name        video codec or 'none', default libx264
+ *    -acodec name        audio codec or 'none', default libmp3lame
+ *    -vq quality         video quality 1..100
+ *    -vb bitrate         video bitrate [bps]
+ *    -g gop              gop size
+ *    -vsrc backend       video capture backend, default nv21file
+ *    -vdev path          video source file, default synthetic pattern
+ *    -opts "ffopts"      stream options, e.g. "-audio_source pcmfile -audio_device in.pcm -backlog 512"
+ *    -replay file        replay capture record (ffopts "-record file" on device), sets size, rate and sources
+ *    -fast               with -replay: feed records as fast as the encoder takes them
+ *    -stats              print stream stats every second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include "sendvideo.h"
+#include "capture.h"
+#include "capture-feed.h"
+#include "caprec.h"
+#include "campixfmt.h"
+#include "ffmpeg.h"
+#include "debug.h"
+
+
+static volatile sig_atomic_t interrupted;
+
+static void on_signal(int sig)
+{
+  (void) sig;
+  interrupted = 1;
+}
+
+static void on_state_changed(void * cookie, ff_output_stream * s, ff_output_stream_state state, int reason)
+{
+  (void) cookie, (void) s;
+  fprintf(stderr, "stream state: %d reason: %d (%s)\n", state, reason, reason ? av_err2str(reason) : "");
+}
+
+/* Take frame size and audio rate from record file and route both capture sources to it */
+static char * setup_replay(const char * path, bool fast, create_output_stream_args * args, capture_params * params)
+{
+  caprec * rec;
+  const struct caprec_header * hdr;
+  bool have_audio = false;
+  char * opts;
+
+  if ( !(rec = caprec_open(path)) ) {
+    fprintf(stderr, "caprec_open('%s') fails: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  hdr = caprec_get_header(rec);
+
+  for ( int i = 0; i < caprec_count(rec) && !have_audio; ++i ) {
+    have_audio = caprec_get_entry(rec, i)->type == caprec_audio;
+  }
+
+  fprintf(stderr, "replay '%s': %dx%d %d Hz, %d records\n", path, hdr->cx, hdr->cy, hdr->sample_rate, caprec_count(rec));
+
+  args->cx = hdr->cx;
+  args->cy = hdr->cy;
+  args->pxfmt = hdr->pixfmt;
+  if ( !have_audio ) {
+    args->cacodec = "none";
+  }
+
+  params->device = path;
+  params->freerun = fast;
+
+  if ( fast ) {
+    /* throughput run: nothing is late */
+    args->drop_policy = ff_drop_none;
+  }
+
+  opts = av_asprintf("%s -audio_source replay -audio_device %s -capture_rate %d -capture_freerun %d",
+      args->ffopts ? args->ffopts : "", path, hdr->sample_rate, fast);
+
+  caprec_close(&rec);
+
+  return opts;
+}
+
+static void print_stats(ff_output_stream * ff)
+{
+  const struct output_stream_stats * st = get_output_stream_stats(ff);
+
+  fprintf(stderr, "in: %6.2f fps %6d kbps  out: %6.2f fps %6d kbps  encq: %3d/%-3d sendq: %3d/%-3d "
+      "drops: %d/%d/%d write: %d ms wakeups: %d/s switches: %d/s send: %d/s stalls: %d/%d max %d ms "
+      "motion: %d static: %d/%d\n",
+      st->inputFps, st->inputBitrate / 1000, st->outputFps, st->outputBitrate / 1000,
+      st->encodeQueueSize, st->encodeQueueCapacity, st->sendQueueSize, st->sendQueueCapacity,
+      st->videoDropsNoBuffer, st->videoDropsLate, st->sendDrops,
+      st->writeLatency, st->encoderWakeups, st->encoderSwitches, st->sendCalls,
+      st->stalls, st->stallTimeouts, st->stallMax,
+      st->motionScore, st->staticRepeats, st->videoDropsStatic);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char * url = NULL;
+  const char * vsrc = NULL;
+  const char * replay = NULL;
+  char * replay_opts = NULL;
+  int cx = 640, cy = 480, fps = 25;
+  double duration = 0;
+  bool stats = false, fast = false;
+
+  static const ff_output_stream_event_callback events_callback = {
+    .stream_state_changed = on_state_changed,
+  };
+
+  create_output_stream_args args = {
+    .format = "matroska",
+    .cvcodec = "libx264",
+    .cacodec = "libmp3lame",
+    .events_callback = &events_callback,
+    .pxfmt = campixfmt_nv21,
+    .cvquality = -1,
+    .caquality = -1,
+  };
+
+  capture_params params = {
+    .nbuffers = CAPTURE_FEED_BUFFERS,
+    .callback = capture_feed_callback,
+  };
+
+  capture_feed feed = {
+    .ff = NULL,
+  };
+
+  int64_t tstart, tstats;
+  int status = 1;
+
+  for ( int i = 1; i < argc; ++i ) {
+
+    const char * arg = argv[i];
+    const char * val = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if ( strcmp(arg, "-stats") == 0 ) {
+      stats = true;
+      continue;
+    }
+
+    if ( strcmp(arg, "-fast") == 0 ) {
+      fast = true;
+      continue;
+    }
+
+    if ( *arg != '-' ) {
+      url = arg;
+      continue;
+    }
+
+    if ( !val ) {
+      fprintf(stderr, "Missing value for %s\n", arg);
+      return 1;
+    }
+
+    ++i;
+
+    if ( strcmp(arg, "-s") == 0 ) {
+      if ( sscanf(val, "%dx%d", &cx, &cy) != 2 ) {
+        fprintf(stderr, "Invalid frame size %s\n", val);
+        return 1;
+      }
+    }
+    else if ( strcmp(arg, "-r") == 0 ) {
+      fps = atoi(val);
+    }
+    else if ( strcmp(arg, "-t") == 0 ) {
+      duration = atof(val);
+    }
+    else if ( strcmp(arg, "-f") == 0 ) {
+      args.format = val;
+    }
+    else if ( strcmp(arg, "-vcodec") == 0 ) {
+      args.cvcodec = val;
+    }
+    else if ( strcmp(arg, "-acodec") == 0 ) {
+      args.cacodec = val;
+    }
+    else if ( strcmp(arg, "-vq") == 0 ) {
+      args.cvquality = atoi(val);
+    }
+    else if ( strcmp(arg, "-vb") == 0 ) {
+      args.cvbitrate = atoi(val);
+    }
+    else if ( strcmp(arg, "-g") == 0 ) {
+      args.gopsize = atoi(val);
+    }
+    else if ( strcmp(arg, "-vsrc") == 0 ) {
+      vsrc = val;
+    }
+    else if ( strcmp(arg, "-vdev") == 0 ) {
+      params.device = val;
+    }
+    else if ( strcmp(arg, "-opts") == 0 ) {
+      args.ffopts = val;
+    }
+    else if ( strcmp(arg, "-replay") == 0 ) {
+      replay = val;
+    }
+    else {
+      fprintf(stderr, "Invalid argument %s\n", arg);
+      return 1;
+    }
+  }
+
+  if ( !url || cx < 2 || cy < 2 || fps < 1 ) {
+    fprintf(stderr, "Usage: %s [-s WxH] [-r fps] [-t seconds] [-f format] [-vcodec name] [-acodec name] "
+        "[-vq quality] [-vb bitrate] [-g gop] [-vsrc backend] [-vdev path] [-opts \"ffopts\"] [-replay file [-fast]] "
+        "[-stats] url\n",
+        argv[0]);
+    return 1;
+  }
+
+  g_log_level = stats ? LOG_ERR : LOG_DEBUG;
+
+  av_log_set_level(AV_LOG_WARNING);
+  av_register_all();
+  avformat_network_init();
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  args.server = url;
+  args.cx = cx;
+  args.cy = cy;
+
+  if ( replay ) {
+    if ( !(replay_opts = setup_replay(replay, fast, &args, &params)) ) {
+      goto end;
+    }
+    args.ffopts = replay_opts;
+    vsrc = "replay";
+    cx = args.cx;
+    cy = args.cy;
+  }
+
+  if ( !(feed.ff = create_output_stream(&args)) ) {
+    fprintf(stderr, "create_output_stream() fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  feed.frame_size = get_video_frame_data_size(feed.ff);
+
+  params.cx = cx;
+  params.cy = cy;
+  params.fps = fps;
+  params.cookie = &feed;
+
+  if ( (status = capture_create(&feed.src, capture_media_video, vsrc, &params)) ) {
+    fprintf(stderr, "capture_create(%s) fails: %s\n", vsrc ? vsrc : "default", av_err2str(status));
+    goto end;
+  }
+
+  if ( !start_output_stream(feed.ff) ) {
+    fprintf(stderr, "start_output_stream() fails\n");
+    status = 1;
+    goto end;
+  }
+
+  if ( (status = capture_start(feed.src)) ) {
+    fprintf(stderr, "capture_start() fails: %s\n", av_err2str(status));
+    goto end;
+  }
+
+  tstart = tstats = ffmpeg_gettime_ms();
+
+  while ( !interrupted && !capture_is_eof(feed.src) && (duration <= 0 || ffmpeg_gettime_ms() - tstart < duration * 1000) ) {
+
+    capture_feed_refill(&feed);
+
+    if ( stats && ffmpeg_gettime_ms() - tstats >= 1000 ) {
+      print_stats(feed.ff);
+      tstats = ffmpeg_gettime_ms();
+    }
+
+    usleep(fast ? 500 : 5000);
+  }
+
+  if ( stats ) {
+    fprintf(stderr, "%.3f s\n", (ffmpeg_gettime_ms() - tstart) * 1e-3);
+  }
+
+  status = 0;
+
+end:
+
+  if ( feed.src ) {
+    capture_stop(feed.src);
+  }
+
+  if ( feed.ff ) {
+    stop_output_stream(feed.ff);
+  }
+
+  capture_destroy(&feed.src);
+  destroy_output_stream(feed.ff);
+  av_free(replay_opts);
+
+  return status ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * yuvconv-bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Measure NV21 -> YUV420P / NV12 throughput of yuvconv kernels vs sws_scale()
+ *
+ *  Usage: yuvconv-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "yuvconv.h"
+#include "ffmpeg.h"
+
+
+static double get_realtime_ms(void)
+{
+  struct timespec tm;
+  clock_gettime(CLOCK_MONOTONIC, &tm);
+  return (double) tm.tv_sec * 1e3 + (double) tm.tv_nsec * 1e-6;
+}
+
+static void report(const char * name, const char * op, int cx, int cy, int iterations, double ms)
+{
+  const double bytes = (double) av_image_get_buffer_size(AV_PIX_FMT_NV21, cx, cy, 1) * iterations;
+  printf("%-6s %-8s %4dx%-4d %9.3f ms/frame %9.1f MB/s\n", name, op, cx, cy, ms / iterations, bytes / (ms * 1e3));
+}
+
+static void bench_size(int cx, int cy, int iterations)
+{
+  const int cw = (cx + 1) / 2, ch = (cy + 1) / 2;
+  const int size = av_image_get_buffer_size(AV_PIX_FMT_NV21, cx, cy, 1);
+  const yuvconv_kernels * k;
+
+  uint8_t * nv21 = NULL, * nv12 = NULL;
+  AVFrame * yuv = NULL;
+  struct SwsContext * sws = NULL;
+  uint8_t * src_data[4];
+  int src_linesize[4];
+  double t0;
+
+  if ( !(nv21 = av_malloc(size)) || !(nv12 = av_malloc(size)) ) {
+    fprintf(stderr, "av_malloc(%d) fails\n", size);
+    goto end;
+  }
+
+  if ( ffmpeg_create_video_frame(&yuv, AV_PIX_FMT_YUV420P, cx, cy, 32) ) {
+    fprintf(stderr, "ffmpeg_create_video_frame() fails\n");
+    goto end;
+  }
+
+  for ( int i = 0; i < size; ++i ) {
+    nv21[i] = rand();
+  }
+
+  for ( k = yuvconv_get_kernel_list(); k->name; ++k ) {
+
+    t0 = get_realtime_ms();
+    for ( int i = 0; i < iterations; ++i ) {
+      av_image_copy_plane(yuv->data[0], yuv->linesize[0], nv21, cx, cx, cy);
+      yuvconv_split_uv(k, nv21 + cx * cy, 2 * cw, yuv->data[2], yuv->linesize[2], yuv->data[1], yuv->linesize[1], cw, 0, ch);
+    }
+    report(k->name, "yuv420p", cx, cy, iterations, get_realtime_ms() - t0);
+
+    t0 = get_realtime_ms();
+    for ( int i = 0; i < iterations; ++i ) {
+      yuvconv_swap_uv(k, nv21 + cx * cy, 2 * cw, nv21 + cx * cy, 2 * cw, cw, 0, ch);
+    }
+    report(k->name, "swap-ip", cx, cy, iterations, get_realtime_ms() - t0);
+  }
+
+  if ( av_image_fill_arrays(src_data, src_linesize, nv21, AV_PIX_FMT_NV21, cx, cy, 1) < 0 ) {
+    fprintf(stderr, "av_image_fill_arrays() fails\n");
+    goto end;
+  }
+
+  if ( (sws = sws_getContext(cx, cy, AV_PIX_FMT_NV21, cx, cy, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL)) ) {
+    t0 = get_realtime_ms();
+    for ( int i = 0; i < iterations; ++i ) {
+      sws_scale(sws, (const uint8_t * const *) src_data, src_linesize, 0, cy, yuv->data, yuv->linesize);
+    }
+    report("sws", "yuv420p", cx, cy, iterations, get_realtime_ms() - t0);
+    sws_freeContext(sws);
+  }
+
+  if ( (sws = sws_getContext(cx, cy, AV_PIX_FMT_NV21, cx, cy, AV_PIX_FMT_NV12, SWS_POINT, NULL, NULL, NULL)) ) {
+    uint8_t * dst_data[4];
+    int dst_linesize[4];
+
+    av_image_fill_arrays(dst_data, dst_linesize, nv12, AV_PIX_FMT_NV12, cx, cy, 1);
+
+    t0 = get_realtime_ms();
+    for ( int i = 0; i < iterations; ++i ) {
+      sws_scale(sws, (const uint8_t * const *) src_data, src_linesize, 0, cy, dst_data, dst_linesize);
+    }
+    report("sws", "nv12", cx, cy, iterations, get_realtime_ms() - t0);
+    sws_freeContext(sws);
+  }
+
+end:
+
+  av_frame_free(&yuv);
+  av_free(nv21);
+  av_free(nv12);
+}
+
+
+int main(int argc, char *argv[])
+{
+  static const struct {
+    int cx, cy;
+  } sizes[] = {
+    { 640, 480 },
+    { 1280, 720 },
+    { 1920, 1080 },
+  };
+
+  int iterations = 200;
+  const yuvconv_kernels * k;
+
+  if ( argc > 1 && (iterations = atoi(argv[1])) < 1 ) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  for ( k = yuvconv_get_kernel_list(); k->name; ++k ) {
+    printf("%-6s selfcheck: %s\n", k->name, yuvconv_selfcheck(k) ? "OK" : "FAIL");
+  }
+  printf("selected: %s\n\n", yuvconv_get_kernels()->name);
+
+  for ( size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i ) {
+    bench_size(sizes[i].cx, sizes[i].cy, iterations);
+    printf("\n");
+  }
+
+  return 0;
+}
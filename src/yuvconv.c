@@ -0,0 +1,490 @@
+/*
+ * yuvconv.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Semi-planar chroma (NV21/NV12) and packed YUYV conversion kernels: scalar reference, NEON, SSE2, AVX2.
+ *  ARM kernels are selected at compile time (armeabi-v7a is built with -mfpu=neon),
+ *  x86 kernels are selected at run time, so host builds can test all of them.
+ */
+
+#include "yuvconv.h"
+#include "ffmpeg.h"
+#include "debug.h"
+#include <pthread.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+# define HAVE_YUVCONV_NEON  1
+# include <arm_neon.h>
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+# define HAVE_YUVCONV_X86   1
+# include <immintrin.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// scalar reference
+
+static void deinterleave_uv_c(const uint8_t * src, uint8_t * dst0, uint8_t * dst1, size_t n)
+{
+  for ( size_t i = 0; i < n; ++i ) {
+    dst0[i] = src[2 * i];
+    dst1[i] = src[2 * i + 1];
+  }
+}
+
+static void swap_uv_c(const uint8_t * src, uint8_t * dst, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 2 <= n; i += 2 ) {
+    uint32_t w;
+    memcpy(&w, src + 2 * i, sizeof(w));
+    w = ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF);
+    memcpy(dst + 2 * i, &w, sizeof(w));
+  }
+
+  for ( ; i < n; ++i ) {
+    const uint8_t c = src[2 * i];
+    dst[2 * i] = src[2 * i + 1];
+    dst[2 * i + 1] = c;
+  }
+}
+
+static void yuyv_to_i420_c(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+    uint8_t * u, uint8_t * v, size_t n)
+{
+  for ( size_t i = 0; i < n; ++i ) {
+    y0[2 * i] = src0[4 * i];
+    y0[2 * i + 1] = src0[4 * i + 2];
+    y1[2 * i] = src1[4 * i];
+    y1[2 * i + 1] = src1[4 * i + 2];
+    u[i] = (src0[4 * i + 1] + src1[4 * i + 1] + 1) >> 1;
+    v[i] = (src0[4 * i + 3] + src1[4 * i + 3] + 1) >> 1;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARM NEON
+
+#if HAVE_YUVCONV_NEON
+
+static void deinterleave_uv_neon(const uint8_t * src, uint8_t * dst0, uint8_t * dst1, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 16 <= n; i += 16 ) {
+    const uint8x16x2_t uv = vld2q_u8(src + 2 * i);
+    vst1q_u8(dst0 + i, uv.val[0]);
+    vst1q_u8(dst1 + i, uv.val[1]);
+  }
+
+  deinterleave_uv_c(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+static void swap_uv_neon(const uint8_t * src, uint8_t * dst, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 8 <= n; i += 8 ) {
+    vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+  }
+
+  swap_uv_c(src + 2 * i, dst + 2 * i, n - i);
+}
+
+static void yuyv_to_i420_neon(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+    uint8_t * u, uint8_t * v, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 16 <= n; i += 16 ) {
+    const uint8x16x4_t a = vld4q_u8(src0 + 4 * i);  // Y0 U Y1 V
+    const uint8x16x4_t b = vld4q_u8(src1 + 4 * i);
+    vst2q_u8(y0 + 2 * i, (uint8x16x2_t ) { { a.val[0], a.val[2] } });
+    vst2q_u8(y1 + 2 * i, (uint8x16x2_t ) { { b.val[0], b.val[2] } });
+    vst1q_u8(u + i, vrhaddq_u8(a.val[1], b.val[1]));
+    vst1q_u8(v + i, vrhaddq_u8(a.val[3], b.val[3]));
+  }
+
+  yuyv_to_i420_c(src0 + 4 * i, src1 + 4 * i, y0 + 2 * i, y1 + 2 * i, u + i, v + i, n - i);
+}
+
+#endif /* HAVE_YUVCONV_NEON */
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// x86 SSE2 / AVX2
+
+#if HAVE_YUVCONV_X86
+
+__attribute__((target("sse2")))
+static void deinterleave_uv_sse2(const uint8_t * src, uint8_t * dst0, uint8_t * dst1, size_t n)
+{
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  size_t i = 0;
+
+  for ( ; i + 16 <= n; i += 16 ) {
+    const __m128i a = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+    const __m128i b = _mm_loadu_si128((const __m128i *) (src + 2 * i + 16));
+    _mm_storeu_si128((__m128i *) (dst0 + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+    _mm_storeu_si128((__m128i *) (dst1 + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+  }
+
+  deinterleave_uv_c(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void swap_uv_sse2(const uint8_t * src, uint8_t * dst, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 8 <= n; i += 8 ) {
+    const __m128i a = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+    _mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)));
+  }
+
+  swap_uv_c(src + 2 * i, dst + 2 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void yuyv_to_i420_sse2(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+    uint8_t * u, uint8_t * v, size_t n)
+{
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  size_t i = 0;
+
+  for ( ; i + 16 <= n; i += 16 ) {
+    __m128i a[4], b[4], c[2];
+
+    for ( int k = 0; k < 4; ++k ) {
+      a[k] = _mm_loadu_si128((const __m128i *) (src0 + 4 * i + 16 * k));
+      b[k] = _mm_loadu_si128((const __m128i *) (src1 + 4 * i + 16 * k));
+    }
+
+    // luma is even bytes
+    _mm_storeu_si128((__m128i *) (y0 + 2 * i), _mm_packus_epi16(_mm_and_si128(a[0], mask), _mm_and_si128(a[1], mask)));
+    _mm_storeu_si128((__m128i *) (y0 + 2 * i + 16), _mm_packus_epi16(_mm_and_si128(a[2], mask), _mm_and_si128(a[3], mask)));
+    _mm_storeu_si128((__m128i *) (y1 + 2 * i), _mm_packus_epi16(_mm_and_si128(b[0], mask), _mm_and_si128(b[1], mask)));
+    _mm_storeu_si128((__m128i *) (y1 + 2 * i + 16), _mm_packus_epi16(_mm_and_si128(b[2], mask), _mm_and_si128(b[3], mask)));
+
+    // odd bytes are U V pairs, average rows then split
+    for ( int k = 0; k < 2; ++k ) {
+      c[k] = _mm_avg_epu8(_mm_packus_epi16(_mm_srli_epi16(a[2 * k], 8), _mm_srli_epi16(a[2 * k + 1], 8)),
+          _mm_packus_epi16(_mm_srli_epi16(b[2 * k], 8), _mm_srli_epi16(b[2 * k + 1], 8)));
+    }
+
+    _mm_storeu_si128((__m128i *) (u + i), _mm_packus_epi16(_mm_and_si128(c[0], mask), _mm_and_si128(c[1], mask)));
+    _mm_storeu_si128((__m128i *) (v + i), _mm_packus_epi16(_mm_srli_epi16(c[0], 8), _mm_srli_epi16(c[1], 8)));
+  }
+
+  yuyv_to_i420_c(src0 + 4 * i, src1 + 4 * i, y0 + 2 * i, y1 + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void deinterleave_uv_avx2(const uint8_t * src, uint8_t * dst0, uint8_t * dst1, size_t n)
+{
+  const __m256i mask = _mm256_set1_epi16(0x00FF);
+  size_t i = 0;
+
+  for ( ; i + 32 <= n; i += 32 ) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *) (src + 2 * i));
+    const __m256i b = _mm256_loadu_si256((const __m256i *) (src + 2 * i + 32));
+    // packus works inside 128-bit lanes, restore qword order with permute
+    const __m256i e = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    const __m256i o = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+    _mm256_storeu_si256((__m256i *) (dst0 + i), _mm256_permute4x64_epi64(e, 0xD8));
+    _mm256_storeu_si256((__m256i *) (dst1 + i), _mm256_permute4x64_epi64(o, 0xD8));
+  }
+
+  deinterleave_uv_sse2(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_uv_avx2(const uint8_t * src, uint8_t * dst, size_t n)
+{
+  size_t i = 0;
+
+  for ( ; i + 16 <= n; i += 16 ) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *) (src + 2 * i));
+    _mm256_storeu_si256((__m256i *) (dst + 2 * i), _mm256_or_si256(_mm256_slli_epi16(a, 8), _mm256_srli_epi16(a, 8)));
+  }
+
+  swap_uv_sse2(src + 2 * i, dst + 2 * i, n - i);
+}
+
+#endif /* HAVE_YUVCONV_X86 */
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// dispatch
+
+enum {
+  max_kernels = 8
+};
+
+static yuvconv_kernels kernel_list[max_kernels];
+static const yuvconv_kernels * best_kernels;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+
+static void init_kernel_list(void)
+{
+  int n = 0;
+
+#if HAVE_YUVCONV_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx2") ) {
+    kernel_list[n++] = (yuvconv_kernels ) { "avx2", deinterleave_uv_avx2, swap_uv_avx2, yuyv_to_i420_sse2 };
+  }
+  if ( __builtin_cpu_supports("sse2") ) {
+    kernel_list[n++] = (yuvconv_kernels ) { "sse2", deinterleave_uv_sse2, swap_uv_sse2, yuyv_to_i420_sse2 };
+  }
+#endif
+
+#if HAVE_YUVCONV_NEON
+  kernel_list[n++] = (yuvconv_kernels ) { "neon", deinterleave_uv_neon, swap_uv_neon, yuyv_to_i420_neon };
+#endif
+
+  kernel_list[n++] = (yuvconv_kernels ) { "c", deinterleave_uv_c, swap_uv_c, yuyv_to_i420_c };
+  kernel_list[n].name = NULL;
+
+  /* list is sorted by preference, take first one which produces correct output */
+  for ( int i = 0; i < n; ++i ) {
+    if ( yuvconv_selfcheck(&kernel_list[i]) ) {
+      best_kernels = &kernel_list[i];
+      break;
+    }
+    PERROR("yuvconv_selfcheck('%s') fails, kernels disabled", kernel_list[i].name);
+  }
+
+  if ( !best_kernels ) {
+    best_kernels = &kernel_list[n - 1];
+  }
+
+  PDBG("yuvconv kernels: '%s'", best_kernels->name);
+}
+
+const yuvconv_kernels * yuvconv_get_kernels(void)
+{
+  pthread_once(&init_once, init_kernel_list);
+  return best_kernels;
+}
+
+const yuvconv_kernels * yuvconv_get_kernel_list(void)
+{
+  pthread_once(&init_once, init_kernel_list);
+  return kernel_list;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void yuvconv_split_uv(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dst0, int dst0_linesize,
+    uint8_t * dst1, int dst1_linesize,
+    int width, int y0, int y1)
+{
+  if ( src_linesize == 2 * width && dst0_linesize == width && dst1_linesize == width ) {
+    /* contiguous planes, single streaming pass */
+    k->deinterleave_uv(src + y0 * src_linesize, dst0 + y0 * dst0_linesize, dst1 + y0 * dst1_linesize,
+        (size_t) width * (y1 - y0));
+  }
+  else {
+    for ( int y = y0; y < y1; ++y ) {
+      k->deinterleave_uv(src + y * src_linesize, dst0 + y * dst0_linesize, dst1 + y * dst1_linesize, width);
+    }
+  }
+}
+
+void yuvconv_swap_uv(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dst, int dst_linesize,
+    int width, int y0, int y1)
+{
+  if ( src_linesize == 2 * width && dst_linesize == 2 * width ) {
+    k->swap_uv(src + y0 * src_linesize, dst + y0 * dst_linesize, (size_t) width * (y1 - y0));
+  }
+  else {
+    for ( int y = y0; y < y1; ++y ) {
+      k->swap_uv(src + y * src_linesize, dst + y * dst_linesize, width);
+    }
+  }
+}
+
+void yuvconv_yuyv_to_yuv420p(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dsty, int dsty_linesize,
+    uint8_t * dstu, int dstu_linesize,
+    uint8_t * dstv, int dstv_linesize,
+    int cx, int cy, int y0, int y1)
+{
+  for ( int y = y0; y < y1; ++y ) {
+    /* odd height: the last chroma row is made of single luma row */
+    const int r0 = 2 * y, r1 = FFMIN(2 * y + 1, cy - 1);
+
+    k->yuyv_to_i420(src + r0 * src_linesize, src + r1 * src_linesize,
+        dsty + r0 * dsty_linesize, dsty + r1 * dsty_linesize,
+        dstu + y * dstu_linesize, dstv + y * dstv_linesize,
+        (cx + 1) / 2);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// self check against sws_scale()
+
+static int sws_to_yuv420p(enum AVPixelFormat srcfmt, const uint8_t * src, int cx, int cy, AVFrame * dst)
+{
+  struct SwsContext * sws;
+  uint8_t * src_data[4];
+  int src_linesize[4];
+  int status;
+
+  if ( (status = av_image_fill_arrays(src_data, src_linesize, src, srcfmt, cx, cy, 1)) < 0 ) {
+    return status;
+  }
+
+  if ( !(sws = sws_getContext(cx, cy, srcfmt, cx, cy, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL)) ) {
+    return AVERROR(ENOMEM);
+  }
+
+  status = sws_scale(sws, (const uint8_t * const *) src_data, src_linesize, 0, cy, dst->data, dst->linesize);
+  sws_freeContext(sws);
+
+  return status < 0 ? status : 0;
+}
+
+static bool compare_planes(const uint8_t * a, int alinesize, const uint8_t * b, int blinesize, int width, int height)
+{
+  for ( int y = 0; y < height; ++y ) {
+    if ( memcmp(a + y * alinesize, b + y * blinesize, width) != 0 ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool selfcheck_size(const yuvconv_kernels * k, int cx, int cy)
+{
+  const int cw = (cx + 1) / 2, ch = (cy + 1) / 2;
+  const int size = av_image_get_buffer_size(AV_PIX_FMT_NV21, cx, cy, 1);
+
+  uint8_t * nv21 = NULL, * nv12 = NULL, * u = NULL, * v = NULL, * yuyv = NULL;
+  AVFrame * ref = NULL, * tst = NULL;
+  uint32_t seed = 0x12345678;
+
+  bool fok = false;
+
+  if ( !(nv21 = av_malloc(size)) || !(nv12 = av_malloc(size)) || !(u = av_malloc(cw * ch)) || !(v = av_malloc(cw * ch)) ) {
+    goto end;
+  }
+
+  if ( !(yuyv = av_malloc(4 * cw * cy)) ) {
+    goto end;
+  }
+
+  if ( ffmpeg_create_video_frame(&ref, AV_PIX_FMT_YUV420P, cx, cy, 32) ) {
+    goto end;
+  }
+
+  if ( ffmpeg_create_video_frame(&tst, AV_PIX_FMT_YUV420P, cx, cy, 32) ) {
+    goto end;
+  }
+
+  for ( int i = 0; i < size; ++i ) {
+    nv21[i] = (seed = seed * 1103515245 + 12345) >> 24;
+  }
+
+  for ( int i = 0; i < 4 * cw * cy; ++i ) {
+    yuyv[i] = (seed = seed * 1103515245 + 12345) >> 24;
+  }
+
+  if ( sws_to_yuv420p(AV_PIX_FMT_NV21, nv21, cx, cy, ref) ) {
+    goto end;
+  }
+
+  /* NV21 -> YUV420P: V goes first */
+  yuvconv_split_uv(k, nv21 + cx * cy, 2 * cw, v, cw, u, cw, cw, 0, ch);
+
+  if ( !compare_planes(ref->data[1], ref->linesize[1], u, cw, cw, ch) ) {
+    goto end;
+  }
+
+  if ( !compare_planes(ref->data[2], ref->linesize[2], v, cw, cw, ch) ) {
+    goto end;
+  }
+
+  /* NV21 -> NV12, then both through sws must match */
+  memcpy(nv12, nv21, cx * cy);
+  yuvconv_swap_uv(k, nv21 + cx * cy, 2 * cw, nv12 + cx * cy, 2 * cw, cw, 0, ch);
+
+  if ( sws_to_yuv420p(AV_PIX_FMT_NV12, nv12, cx, cy, tst) ) {
+    goto end;
+  }
+
+  if ( !compare_planes(ref->data[1], ref->linesize[1], tst->data[1], tst->linesize[1], cw, ch) ) {
+    goto end;
+  }
+
+  if ( !compare_planes(ref->data[2], ref->linesize[2], tst->data[2], tst->linesize[2], cw, ch) ) {
+    goto end;
+  }
+
+  /* in place swap back must restore the source */
+  yuvconv_swap_uv(k, nv12 + cx * cy, 2 * cw, nv12 + cx * cy, 2 * cw, cw, 0, ch);
+
+  if ( memcmp(nv12, nv21, size) != 0 ) {
+    goto end;
+  }
+
+  /* YUYV -> YUV420P must match scalar reference */
+  yuvconv_yuyv_to_yuv420p(k, yuyv, 4 * cw, ref->data[0], ref->linesize[0], ref->data[1], ref->linesize[1],
+      ref->data[2], ref->linesize[2], cx, cy, 0, ch);
+
+  yuvconv_yuyv_to_yuv420p(&(const yuvconv_kernels ) { .yuyv_to_i420 = yuyv_to_i420_c }, yuyv, 4 * cw,
+      tst->data[0], tst->linesize[0], tst->data[1], tst->linesize[1], tst->data[2], tst->linesize[2],
+      cx, cy, 0, ch);
+
+  fok = compare_planes(ref->data[0], ref->linesize[0], tst->data[0], tst->linesize[0], cx, cy) &&
+      compare_planes(ref->data[1], ref->linesize[1], tst->data[1], tst->linesize[1], cw, ch) &&
+      compare_planes(ref->data[2], ref->linesize[2], tst->data[2], tst->linesize[2], cw, ch);
+
+end:
+
+  av_frame_free(&ref);
+  av_frame_free(&tst);
+  av_free(nv21);
+  av_free(nv12);
+  av_free(u);
+  av_free(v);
+  av_free(yuyv);
+
+  return fok;
+}
+
+bool yuvconv_selfcheck(const yuvconv_kernels * k)
+{
+  static const struct {
+    int cx, cy;
+  } sizes[] = {
+    { 64, 48 },
+    { 176, 144 },
+    { 318, 238 },   // odd chroma width to cover the tails
+    { 1280, 720 },
+  };
+
+  for ( size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i ) {
+    if ( !selfcheck_size(k, sizes[i].cx, sizes[i].cy) ) {
+      PDBG("'%s' FAILS at %dx%d", k->name, sizes[i].cx, sizes[i].cy);
+      return false;
+    }
+  }
+
+  return true;
+}
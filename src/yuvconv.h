@@ -0,0 +1,88 @@
+/*
+ * yuvconv.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: amyznikov
+ *
+ *  Semi-planar chroma (NV21/NV12) and packed YUYV conversion kernels
+ */
+
+#pragma once
+
+#ifndef __yuvconv_h__
+#define __yuvconv_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct yuvconv_kernels {
+
+  const char * name;
+
+  /* Split n interleaved byte pairs: dst0[i] = src[2*i], dst1[i] = src[2*i+1] */
+  void (*deinterleave_uv)(const uint8_t * src, uint8_t * dst0, uint8_t * dst1, size_t n);
+
+  /* Swap bytes in n interleaved byte pairs: dst may be equal to src */
+  void (*swap_uv)(const uint8_t * src, uint8_t * dst, size_t n);
+
+  /* n YUYV pixel pairs of two rows: luma into y0 and y1, chroma averaged over both rows into u and v */
+  void (*yuyv_to_i420)(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+      uint8_t * u, uint8_t * v, size_t n);
+
+} yuvconv_kernels;
+
+
+/** Best kernels available on this CPU which passed yuvconv_selfcheck() */
+const yuvconv_kernels * yuvconv_get_kernels(void);
+
+/** All kernels compiled in and supported by this CPU, terminated by entry with name = NULL */
+const yuvconv_kernels * yuvconv_get_kernel_list(void);
+
+/** Compare kernels output against sws_scale() at few frame sizes, returns true on match */
+bool yuvconv_selfcheck(const yuvconv_kernels * k);
+
+
+/**
+ * Deinterleave rows [y0, y1) of semi-planar chroma plane into two planes.
+ *  width is number of chroma samples (byte pairs) per row.
+ *  For NV21 dst0 receives V, dst1 receives U; for NV12 vice versa.
+ */
+void yuvconv_split_uv(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dst0, int dst0_linesize,
+    uint8_t * dst1, int dst1_linesize,
+    int width, int y0, int y1);
+
+/**
+ * Swap chroma order of rows [y0, y1) of semi-planar chroma plane (NV21 <-> NV12).
+ *  May be called in place with dst == src.
+ */
+void yuvconv_swap_uv(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dst, int dst_linesize,
+    int width, int y0, int y1);
+
+/**
+ * Convert packed YUYV 4:2:2 frame cx x cy into YUV420P planes.
+ *  y0, y1 are chroma rows [y0, y1), each one is made of luma rows 2*y and 2*y+1.
+ */
+void yuvconv_yuyv_to_yuv420p(const yuvconv_kernels * k,
+    const uint8_t * src, int src_linesize,
+    uint8_t * dsty, int dsty_linesize,
+    uint8_t * dstu, int dstu_linesize,
+    uint8_t * dstv, int dstv_linesize,
+    int cx, int cy, int y0, int y1);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __yuvconv_h__ */